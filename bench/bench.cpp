@@ -0,0 +1,266 @@
+/*
+	Headless benchmark runner: loads the app's scenarios into a world without a
+	window, steps them as fast as possible and prints steps per second, the
+	average time spent in each phase of a step, and a hash of the final state.
+
+	Steps are a fixed 1/60 s, so the same scenario & step count always ends in
+	the same state (for any thread count), and a changed hash means the
+	simulation changed.
+
+	Given a trace file, the state hash after every step is checked against it,
+	and the first step each scenario diverged at is printed. The exit code is 1
+	if any did, if one isn't in the trace, or if the file can't be read. With
+	--record the trace is written instead, so a golden trace is made by running
+	once on a build that's known to be right.
+
+	--check-threads runs every scenario with each of THREAD_COUNTS threads &
+	checks the hashes after every step match the single threaded run's, which
+	needs no trace (CTest runs it, see CMakeLists.txt).
+
+	Usage: 3VG3_bench [scenario (-1 for all)] [steps] [threads] [trace file] [--record]
+	       3VG3_bench --check-threads [scenario (-1 for all)] [steps]
+*/
+#include "physics/physics_world.h"
+#include "physics/scenarios.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+// Set by CMake to the source tree's scenarios, so the runner works from anywhere
+#ifndef SCENARIO_DIRECTORY
+	#define SCENARIO_DIRECTORY "resources/scenarios"
+#endif
+
+// The first is the one the others are checked against
+constexpr int THREAD_COUNTS[] = { 1, 2, 3, 8 };
+
+// Hashes after every step, by scenario name. As text: a "scenario <name>" line,
+// then one hash in hex per line
+typedef std::map<std::string, std::vector<uint64_t>> Trace;
+
+static bool LoadTrace(const char* path, Trace& outTrace)
+{
+	FILE* file = fopen(path, "r");
+	if (file == nullptr)
+		return false;
+
+	char line[256];
+	std::vector<uint64_t>* hashes = nullptr;
+	while (fgets(line, sizeof(line), file))
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		if (strncmp(line, "scenario ", 9) == 0)
+			hashes = &outTrace[line + 9];
+		else if (hashes != nullptr && line[0] != '\0')
+			hashes->push_back(strtoull(line, nullptr, 16));
+	}
+	fclose(file);
+	return true;
+}
+
+static bool SaveTrace(const char* path, const Trace& trace)
+{
+	FILE* file = fopen(path, "w");
+	if (file == nullptr)
+		return false;
+
+	for (const auto& scenario : trace)
+	{
+		fprintf(file, "scenario %s\n", scenario.first.c_str());
+		for (uint64_t hash : scenario.second)
+			fprintf(file, "%016llx\n", (unsigned long long)hash);
+	}
+	return fclose(file) == 0;
+}
+
+// Returns false if the scenario diverged from golden
+static bool CheckTrace(const std::vector<uint64_t>& hashes, const std::vector<uint64_t>* golden)
+{
+	if (golden == nullptr)
+	{
+		printf("    NOT IN THE TRACE\n");
+		return false;
+	}
+
+	size_t count = std::min(hashes.size(), golden->size());
+	for (size_t i = 0; i < count; i++)
+	{
+		if (hashes[i] != (*golden)[i])
+		{
+			printf("    DIVERGED at step %d\n", (int)i + 1);
+			return false;
+		}
+	}
+	if (count < hashes.size())
+		printf("    matches the trace's %d steps\n", (int)count);
+	return true;
+}
+
+// Fills outHashes with the state hash after every step, if given. Returns false
+// if the scenario couldn't be loaded
+static bool RunScenario(PhysicsWorld& world, const ScenarioInfo& scenario, int steps, std::vector<uint64_t>* outHashes)
+{
+	world.Init();
+	if (!LoadScenario(world, scenario))
+	{
+		printf("%-18s couldn't be loaded\n", scenario.name.c_str());
+		return false;
+	}
+
+	StepTimings sum;
+	double seconds = 0.0;
+	for (int i = 0; i < steps; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		world.Update(1.0f / 60.0f);
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (outHashes)
+			outHashes->push_back(world.HashState());
+
+		sum.broadphase += world.timings.broadphase;
+		sum.narrowphase += world.timings.narrowphase;
+		sum.integrate += world.timings.integrate;
+		sum.solve += world.timings.solve;
+		sum.sleep += world.timings.sleep;
+		sum.continuous += world.timings.continuous;
+		sum.particles += world.timings.particles;
+	}
+
+	uint64_t hash = world.HashState();
+
+	printf("%-18s %7d %10.0f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f   %016llx\n",
+		scenario.name.c_str(), world.bodies.Size() + world.particles.Size(), steps / seconds,
+		sum.broadphase / steps, sum.narrowphase / steps, sum.integrate / steps, sum.solve / steps, sum.sleep / steps,
+		sum.continuous / steps, sum.particles / steps,
+		(unsigned long long)hash);
+	return true;
+}
+
+static void PrintHeader(int steps, int threads)
+{
+#ifdef STRICT_DETERMINISM
+	const char* floatMode = "strict";
+#else
+	const char* floatMode = "relaxed";
+#endif
+	printf("%d steps, %d threads, %s integrator, %s float\n\n", steps, threads, SimdLevelName(DetectSimdLevel()), floatMode);
+	printf("%-18s %7s %10s %8s %8s %8s %8s %8s %8s %8s   %s\n", "scenario", "objects", "steps/s",
+		"broad", "narrow", "integ", "solve", "sleep", "ccd", "particle", "state hash");
+}
+
+// Runs the scenarios with every one of THREAD_COUNTS, returns false if any run
+// diverged from the first
+static bool CheckThreadCounts(const std::vector<ScenarioInfo>& scenarios, int scenario, int steps)
+{
+	Trace reference;
+	bool diverged = false;
+	for (int threads : THREAD_COUNTS)
+	{
+		PhysicsWorld world;
+		world.jobs.SetThreadCount(threads);
+		PrintHeader(steps, world.jobs.ThreadCount());
+
+		Trace trace;
+		for (int i = 0; i < (int)scenarios.size(); i++)
+		{
+			if (scenario >= 0 && scenario != i)
+				continue;
+
+			std::vector<uint64_t>& hashes = trace[scenarios[i].name];
+			if (!RunScenario(world, scenarios[i], steps, &hashes))
+				diverged = true;
+			else if (threads != THREAD_COUNTS[0])
+			{
+				auto found = reference.find(scenarios[i].name);
+				if (!CheckTrace(hashes, found != reference.end() ? &found->second : nullptr))
+					diverged = true;
+			}
+		}
+		if (threads == THREAD_COUNTS[0])
+			reference = std::move(trace);
+		printf("\n");
+	}
+
+	printf("%s\n", diverged ? "Thread counts diverged" : "Every thread count matches");
+	return !diverged;
+}
+
+int main(int argc, char** argv)
+{
+	// Flags go anywhere, the rest are in order
+	bool record = false, checkThreads = false;
+	std::vector<const char*> args;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--record") == 0)
+			record = true;
+		else if (strcmp(argv[i], "--check-threads") == 0)
+			checkThreads = true;
+		else
+			args.push_back(argv[i]);
+	}
+
+	int scenario = args.size() > 0 ? atoi(args[0]) : -1;
+	int steps = args.size() > 1 ? atoi(args[1]) : 600;
+	int threads = args.size() > 2 ? atoi(args[2]) : JobSystem::DefaultThreadCount();
+	const char* tracePath = args.size() > 3 ? args[3] : nullptr;
+
+	std::vector<ScenarioInfo> scenarios = FindScenarios(SCENARIO_DIRECTORY);
+	if (scenario >= (int)scenarios.size() || steps <= 0 || (record && tracePath == nullptr))
+	{
+		fprintf(stderr, "Usage: %s [scenario 0-%d, -1 for all] [steps] [threads] [trace file] [--record]\n"
+			"       %s --check-threads [scenario] [steps]\n", argv[0], (int)scenarios.size() - 1, argv[0]);
+		return 1;
+	}
+
+	if (checkThreads)
+		return CheckThreadCounts(scenarios, scenario, steps) ? 0 : 1;
+
+	Trace golden, trace;
+	bool checking = tracePath != nullptr && !record;
+	if (checking && !LoadTrace(tracePath, golden))
+	{
+		fprintf(stderr, "Couldn't read %s (--record writes one)\n", tracePath);
+		return 1;
+	}
+	bool diverged = false;
+
+	PhysicsWorld world;
+	world.jobs.SetThreadCount(threads);
+	PrintHeader(steps, world.jobs.ThreadCount());
+
+	for (int i = 0; i < (int)scenarios.size(); i++)
+	{
+		if (scenario >= 0 && scenario != i)
+			continue;
+
+		std::vector<uint64_t>* hashes = tracePath ? &trace[scenarios[i].name] : nullptr;
+		if (!RunScenario(world, scenarios[i], steps, hashes))
+			diverged = true;
+		else if (checking)
+		{
+			auto found = golden.find(scenarios[i].name);
+			if (!CheckTrace(*hashes, found != golden.end() ? &found->second : nullptr))
+				diverged = true;
+		}
+	}
+	printf("\nPhase times are average ms per step\n");
+
+	if (checking)
+		printf("%s\n", diverged ? "Diverged from the trace" : "Matches the trace");
+	else if (record)
+	{
+		if (!SaveTrace(tracePath, trace))
+		{
+			fprintf(stderr, "Couldn't write %s\n", tracePath);
+			return 1;
+		}
+		printf("Wrote trace to %s\n", tracePath);
+	}
+	return diverged ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+/*
+	Broadphase benchmark on bodies of very different sizes: most have a bounding
+	radius of 1, some 10 and a few 100 (the big ones static, like level geometry).
+	The small ones drift around and bounce off the edges of the area, and every
+	broadphase finds pairs each step. The pairs are checked against brute force,
+	which is skipped above 20000 bodies.
+
+	Usage: 3VG3_bench_broadphase [bodies] [steps] [threads]
+*/
+#include "physics/broadphase.h"
+#include "physics/random.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static const int BRUTE_FORCE_LIMIT = 20000;
+
+static void BuildScene(BodyStore& bodies, int count, float& halfSize)
+{
+	Random random;
+	random.Seed(7);
+
+	// Roughly the same crowding at every body count
+	halfSize = 10.0f * sqrtf((float)count);
+
+	bodies.Clear();
+	bodies.Reserve(count);
+	for (int i = 0; i < count; i++)
+	{
+		RigidBody2D rb;
+		float size = random.NextFloat();
+		float boundingRadius = size < 0.9f ? 1.0f : size < 0.99f ? 10.0f : 100.0f;
+		rb.radius = boundingRadius / sqrtf(2.0f); // squares, reaching their bounding radius at the corners
+		rb.position = RVector3(random.Range(-halfSize, halfSize), random.Range(-halfSize, halfSize), 0);
+
+		if (boundingRadius >= 100.0f)
+		{
+			rb.inverseMass = 0.0f;
+			rb.inverseMOI = 0.0f;
+		}
+		else
+		{
+			float angle = random.Range(0.0f, 2.0f * PI);
+			float speed = random.Range(0.5f, 5.0f);
+			rb.velocity = RVector3(cosf(angle) * speed, sinf(angle) * speed, 0);
+		}
+		bodies.Add(rb);
+	}
+}
+
+static void MoveBodies(BodyStore& bodies, float halfSize, float dt)
+{
+	for (int i = 0; i < bodies.Size(); i++)
+	{
+		bodies.oldPos.x[i] = bodies.position.x[i];
+		bodies.oldPos.y[i] = bodies.position.y[i];
+		bodies.position.x[i] += bodies.velocity.x[i] * dt;
+		bodies.position.y[i] += bodies.velocity.y[i] * dt;
+		if (fabsf(bodies.position.x[i]) > halfSize) bodies.velocity.x[i] = -bodies.velocity.x[i];
+		if (fabsf(bodies.position.y[i]) > halfSize) bodies.velocity.y[i] = -bodies.velocity.y[i];
+	}
+}
+
+// Order independent, so broadphases that find pairs in different orders agree
+static uint64_t HashPairs(std::vector<BodyPair>& pairs)
+{
+	std::sort(pairs.begin(), pairs.end(), [](const BodyPair& p, const BodyPair& q) {
+		return p.a != q.a ? p.a < q.a : p.b < q.b;
+	});
+	uint64_t hash = 14695981039346656037ull;
+	for (const BodyPair& pair : pairs)
+	{
+		hash = (hash ^ (uint64_t)pair.a) * 1099511628211ull;
+		hash = (hash ^ (uint64_t)pair.b) * 1099511628211ull;
+	}
+	return hash;
+}
+
+static void RunSize(int count, int steps, JobSystem& jobs)
+{
+	printf("%d bodies\n", count);
+	printf("%-18s %10s %10s %18s\n", "broadphase", "ms/step", "pairs", "pairs hash");
+
+	uint64_t bruteForceHash = 0;
+	for (int type = 0; type < (int)BroadphaseType::Count; type++)
+	{
+		if (type == (int)BroadphaseType::BruteForce && count > BRUTE_FORCE_LIMIT)
+		{
+			printf("%-18s %10s\n", BroadphaseTypeName((BroadphaseType)type), "skipped");
+			continue;
+		}
+
+		BodyStore bodies;
+		float halfSize;
+		BuildScene(bodies, count, halfSize);
+		std::unique_ptr<Broadphase> broadphase = CreateBroadphase((BroadphaseType)type);
+		std::vector<BodyPair> pairs;
+
+		// The first step builds whatever is kept between steps
+		broadphase->FindPairs(bodies, pairs, jobs);
+
+		double seconds = 0.0;
+		for (int i = 0; i < steps; i++)
+		{
+			MoveBodies(bodies, halfSize, 1.0f / 60.0f);
+			auto start = std::chrono::steady_clock::now();
+			broadphase->FindPairs(bodies, pairs, jobs);
+			seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		uint64_t hash = HashPairs(pairs);
+		if (type == (int)BroadphaseType::BruteForce)
+			bruteForceHash = hash;
+		bool mismatch = count <= BRUTE_FORCE_LIMIT && hash != bruteForceHash;
+
+		printf("%-18s %10.3f %10d %18llx%s\n", BroadphaseTypeName((BroadphaseType)type), seconds * 1000.0 / steps,
+			(int)pairs.size(), (unsigned long long)hash, mismatch ? "  MISMATCH" : "");
+	}
+	printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+	int count = argc > 1 ? atoi(argv[1]) : 0;
+	int steps = argc > 2 ? atoi(argv[2]) : 100;
+	int threads = argc > 3 ? atoi(argv[3]) : JobSystem::DefaultThreadCount();
+
+	JobSystem jobs;
+	jobs.SetThreadCount(threads);
+	printf("%d steps, %d threads, bounding radii 1 (90%%), 10 (9%%) & 100 (1%%)\n\n", steps, jobs.ThreadCount());
+
+	if (count > 0)
+		RunSize(count, steps, jobs);
+	else
+	{
+		for (int size : { 2000, 20000, 100000 })
+			RunSize(size, steps, jobs);
+	}
+	return 0;
+}
@@ -0,0 +1,162 @@
+/*
+	Force generator benchmark: a field of attractors & drag over lots of bodies,
+	accumulated the way a per-body virtual call per generator would do it, then
+	with ForceAccumulator at every SIMD level the CPU supports (on one thread, then
+	on all of them). Checks they all come out with the same accelerations.
+
+	Usage: 3VG3_bench_forces [bodyCount] [attractors] [iterations]
+*/
+#include "bench_timing.h"
+#include "physics/force_accumulator.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+
+static void FillBodies(BodyStore& bodies, int count)
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> dist(-100.0f, 100.0f);
+
+	bodies.Clear();
+	bodies.Reserve(count);
+	for (int i = 0; i < count; i++)
+	{
+		RigidBody2D rb;
+		rb.position = RVector3(dist(rng), dist(rng), 0);
+		rb.velocity = RVector3(dist(rng) * 0.1f, dist(rng) * 0.1f, 0);
+		rb.angularVelocity = dist(rng) * 0.01f;
+		// A few static ones & some outside the fields' groups
+		if (i % 50 == 0)
+			rb.inverseMass = 0.0f;
+		rb.forceGroups = (i % 7) == 0 ? 2 : 1;
+		bodies.Add(rb);
+	}
+}
+
+static void AddGenerators(ForceAccumulator& forces, int attractors)
+{
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> dist(-80.0f, 80.0f);
+	for (int i = 0; i < attractors; i++)
+	{
+		float radius = (i % 2) == 0 ? 0.0f : 60.0f;
+		forces.AddAttractor(1, { dist(rng), dist(rng) }, (i % 3) == 0 ? -500.0f : 1000.0f, 1.0f, radius);
+	}
+	forces.AddDrag(ForceAccumulator::ALL_GROUPS, 0.1f, 0.01f, 0.05f);
+}
+
+// The usual object oriented way: every generator a class, asked about one body at a time
+class Effect {
+public:
+	virtual ~Effect() {}
+	virtual void Apply(const BodyStore& bodies, int i, float& ax, float& ay, float& aw) const = 0;
+};
+
+class AttractorEffect : public Effect {
+public:
+	explicit AttractorEffect(const ForceGenerator& g) : g(g) {}
+	void Apply(const BodyStore& bodies, int i, float& ax, float& ay, float&) const override
+	{
+		float reach2 = g.radius > 0.0f ? g.radius * g.radius : INFINITY;
+		float dx = g.x - bodies.position.x[i];
+		float dy = g.y - bodies.position.y[i];
+		float d2 = dx * dx + dy * dy;
+		if (!(bodies.forceGroups[i] & g.mask) || !(bodies.inverseMass[i] > 0.0f) || !(d2 <= reach2))
+			return;
+		float s2 = d2 + g.softening * g.softening;
+		float pull = g.strength / (s2 * sqrtf(s2));
+		ax += dx * pull;
+		ay += dy * pull;
+	}
+	ForceGenerator g;
+};
+
+class DragEffect : public Effect {
+public:
+	explicit DragEffect(const ForceGenerator& g) : g(g) {}
+	void Apply(const BodyStore& bodies, int i, float& ax, float& ay, float& aw) const override
+	{
+		if (!(bodies.forceGroups[i] & g.mask))
+			return;
+		float vx = bodies.velocity.x[i], vy = bodies.velocity.y[i];
+		float k = g.strength + g.quadratic * sqrtf(vx * vx + vy * vy);
+		ax -= k * vx * bodies.inverseMass[i];
+		ay -= k * vy * bodies.inverseMass[i];
+		aw -= g.angular * bodies.angularVelocity[i] * bodies.inverseMOI[i];
+	}
+	ForceGenerator g;
+};
+
+static void AccumulateReference(const BodyStore& bodies, const std::vector<std::unique_ptr<Effect>>& effects,
+	std::vector<float>& ax, std::vector<float>& ay, std::vector<float>& aw)
+{
+	for (int i = 0; i < bodies.Size(); i++)
+	{
+		ax[i] = bodies.force.x[i] * bodies.inverseMass[i];
+		ay[i] = bodies.force.y[i] * bodies.inverseMass[i];
+		aw[i] = bodies.torque[i] * bodies.inverseMOI[i];
+		for (const auto& effect : effects)
+			effect->Apply(bodies, i, ax[i], ay[i], aw[i]);
+	}
+}
+
+static bool SameBits(const std::vector<float>& a, const std::vector<float>& b)
+{
+	return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	int count = argc > 1 ? atoi(argv[1]) : 100000;
+	int attractors = argc > 2 ? atoi(argv[2]) : 8;
+	int iterations = argc > 3 ? atoi(argv[3]) : 50;
+
+	printf("%d attractors & drag over %d bodies, best of %d runs (CPU supports %s)\n\n",
+		attractors, count, iterations, SimdLevelName(DetectSimdLevel()));
+
+	BodyStore bodies;
+	FillBodies(bodies, count);
+	ForceAccumulator forces;
+	AddGenerators(forces, attractors);
+
+	std::vector<std::unique_ptr<Effect>> effects;
+	for (const ForceGenerator& g : forces.generators)
+	{
+		if (g.type == ForceType::Attractor)
+			effects.emplace_back(new AttractorEffect(g));
+		else
+			effects.emplace_back(new DragEffect(g));
+	}
+
+	std::vector<float> refX(count), refY(count), refW(count);
+	double baselineMs = BestTimeMs(iterations, [&]() { AccumulateReference(bodies, effects, refX, refY, refW); });
+	Report("Virtual per body", baselineMs, count, baselineMs);
+
+	JobSystem jobs;
+	bool allMatch = true;
+	for (int threads : { 1, JobSystem::DefaultThreadCount() })
+	{
+		jobs.SetThreadCount(threads);
+		for (int level = 0; level <= (int)DetectSimdLevel(); level++)
+		{
+			double ms = BestTimeMs(iterations, [&]() { forces.Accumulate(bodies, (SimdLevel)level, jobs); });
+			char name[64];
+			snprintf(name, sizeof(name), "%s, %d thread%s", SimdLevelName((SimdLevel)level), threads, threads == 1 ? "" : "s");
+			Report(name, ms, count, baselineMs);
+
+			if (!SameBits(forces.accelX, refX) || !SameBits(forces.accelY, refY) || !SameBits(forces.angularAccel, refW))
+			{
+				printf("  MISMATCH\n");
+				allMatch = false;
+			}
+		}
+		if (JobSystem::DefaultThreadCount() == 1)
+			break;
+	}
+
+	return allMatch ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+/*
+	Integrator micro-benchmark: times the original per-body RVector3 loop against
+	IntegrateBodies at every SIMD level the CPU supports, and checks they all give
+	the same result.
+
+	Usage: 3VG3_bench_integrator [bodyCount] [iterations]
+*/
+#include "bench_timing.h"
+#include "physics/integrator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+static const float dt = 1.0f / 60.0f;
+static const RVector3 gravity = RVector3(0, -9.8f, 0);
+
+static void FillBodies(BodyStore& bodies, int count)
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> dist(-100.0f, 100.0f);
+
+	bodies.Clear();
+	bodies.Reserve(count);
+	for (int i = 0; i < count; i++)
+	{
+		RigidBody2D rb;
+		rb.position = RVector3(dist(rng), dist(rng), dist(rng));
+		rb.velocity = RVector3(dist(rng), dist(rng), 0);
+		rb.angularVelocity = dist(rng) * 0.01f;
+		rb.doGravity = (i % 3) != 0;
+		rb.sleeping = (i % 5) == 0;
+		bodies.Add(rb);
+	}
+}
+
+// The integration loop PhysicsWorld::Update used before IntegrateBodies
+static void IntegrateReference(std::vector<RigidBody2D>& rigidbodies)
+{
+	for (auto& body : rigidbodies)
+	{
+		RVector3 acceleration = { 0, 0, 0 };
+		if (body.doGravity && !body.sleeping) acceleration += gravity;
+
+		body.oldPos = body.position;
+		body.oldRotation = body.rotation;
+		body.velocity += acceleration * dt;
+		body.position += body.velocity * dt;
+
+		float torqueY = 0.0f;
+		body.angularVelocity += torqueY * body.inverseMOI * dt;
+		body.rotation += body.angularVelocity * dt;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int count = argc > 1 ? atoi(argv[1]) : 100000;
+	int iterations = argc > 2 ? atoi(argv[2]) : 200;
+
+	printf("Integrating %d bodies, best of %d runs (CPU supports %s)\n\n",
+		count, iterations, SimdLevelName(DetectSimdLevel()));
+
+	BodyStore bodies;
+	FillBodies(bodies, count);
+	std::vector<RigidBody2D> aos;
+	for (int i = 0; i < count; i++)
+		aos.push_back(bodies.GetAt(i));
+
+	double baselineMs = BestTimeMs(iterations, [&]() { IntegrateReference(aos); });
+	Report("RigidBody2D loop", baselineMs, count, baselineMs);
+
+	bool allMatch = true;
+	for (int level = 0; level <= (int)DetectSimdLevel(); level++)
+	{
+		// Same number of steps from the same start as the reference
+		FillBodies(bodies, count);
+		double ms = BestTimeMs(iterations, [&]() { IntegrateBodies(bodies, gravity, dt, (SimdLevel)level); });
+		Report(SimdLevelName((SimdLevel)level), ms, count, baselineMs);
+
+		for (int i = 0; i < count; i++)
+		{
+			RigidBody2D body = bodies.GetAt(i);
+			if (body.position != aos[i].position || body.velocity != aos[i].velocity ||
+				body.oldPos != aos[i].oldPos || body.rotation != aos[i].rotation ||
+				body.oldRotation != aos[i].oldRotation)
+			{
+				printf("  MISMATCH at body %d\n", i);
+				allMatch = false;
+				break;
+			}
+		}
+	}
+
+	return allMatch ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+/*
+	Joint solver benchmark: the Chain scenario's chain of capsules (see AddChain),
+	stepped with 1 to 256 velocity iterations. For each, prints the time per step
+	against how far the chain's joints have pulled apart under its weight (the
+	error, in world units): the mean & max over the joints at the end, and the
+	worst any joint got during the run. Sequential impulses need more iterations
+	the longer the chain, a thousand links is well past what a few can hold.
+
+	Then steps it with 1, 2, 4, 8 and 16 threads, and checks every run ends in
+	exactly the same state. Sleeping is off, so every step does the same work and
+	it's mostly the solver's.
+
+	Usage: 3VG3_bench_joints [links] [steps]
+*/
+#include "physics/physics_world.h"
+#include "physics/scenarios.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+struct ChainResult {
+	double ms;
+	float meanError, maxError, peakError;
+	int colors;
+	uint64_t hash;
+};
+
+static ChainResult RunChain(int links, int steps, int iterations, int threads)
+{
+	PhysicsWorld world;
+	world.jobs.SetThreadCount(threads);
+	world.Init();
+	world.allowSleeping = false;
+	world.contactSolver.velocityIterations = iterations;
+	AddChain(world, links);
+
+	ChainResult result = {};
+	double totalMs = 0.0;
+	for (int i = 0; i < steps; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		world.Update(1.0f / 60.0f);
+		totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		result.meanError = 0.0f;
+		result.maxError = 0.0f;
+		for (int j = 0; j < world.jointSolver.Count(); j++)
+		{
+			float error = world.jointSolver.PositionError(world.bodies, j);
+			result.meanError += error;
+			result.maxError = std::max(result.maxError, error);
+		}
+		result.meanError /= std::max(world.jointSolver.Count(), 1);
+		result.peakError = std::max(result.peakError, result.maxError);
+	}
+
+	result.ms = totalMs / steps;
+	result.colors = world.jointSolver.ColorCount();
+	result.hash = world.bodies.HashState();
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	int links = argc > 1 ? atoi(argv[1]) : 1000;
+	int steps = argc > 2 ? atoi(argv[2]) : 300;
+
+	printf("Chain of %d links, %d steps, %d threads\n\n", links, steps, JobSystem::DefaultThreadCount());
+	printf("%10s %10s %12s %12s %12s\n", "iterations", "ms/step", "mean error", "max error", "peak error");
+	const int iterationCounts[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256 };
+	int colors = 0;
+	for (int iterations : iterationCounts)
+	{
+		ChainResult result = RunChain(links, steps, iterations, JobSystem::DefaultThreadCount());
+		printf("%10d %10.3f %12.5f %12.5f %12.5f\n", iterations, result.ms, result.meanError, result.maxError, result.peakError);
+		colors = result.colors;
+	}
+	printf("Joints solved in %d colors\n\n", colors);
+
+	// Thread scaling, with enough iterations that the joint solve is most of the step
+	const int threadCounts[] = { 1, 2, 4, 8, 16 };
+	const int iterations = 16;
+	printf("%d iterations\n", iterations);
+	printf("%8s %10s %10s %18s\n", "threads", "ms/step", "speedup", "state hash");
+
+	double baseMs = 0.0;
+	uint64_t baseHash = 0;
+	bool deterministic = true;
+	for (int threads : threadCounts)
+	{
+		ChainResult result = RunChain(links, steps, iterations, threads);
+		if (threads == 1)
+		{
+			baseMs = result.ms;
+			baseHash = result.hash;
+		}
+		deterministic = deterministic && result.hash == baseHash;
+
+		printf("%8d %10.3f %9.2fx %18llx%s\n", threads, result.ms, baseMs / result.ms,
+			(unsigned long long)result.hash, result.hash == baseHash ? "" : "  MISMATCH");
+	}
+
+	printf("%s\n", deterministic ? "All thread counts ended in the same state" : "Thread counts disagree!");
+	return deterministic ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+/*
+	Narrowphase benchmark: runs the corner test (CollideSquareSquare) and the SAT
+	manifold narrowphase over every broadphase pair of a dense pile of boxes, and
+	counts heap allocations while doing it. The old std::vector based corner test
+	is kept here for comparison.
+
+	Usage: 3VG3_bench_narrowphase [boxesPerSide] [iterations]
+*/
+#include "physics/physics_world.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+// Count every allocation made through operator new
+static std::atomic<long long> allocationCount(0);
+
+void* operator new(size_t size)
+{
+	allocationCount++;
+	if (void* p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// CollideSquareSquare before it used the per-step vertex cache
+static bool LegacyCollideSquareSquare(PhysicsWorld& world, int body1, int body2, CollisionInfo& outInfo)
+{
+	const BodyStore& bodies = world.bodies;
+	RVector3 pos1 = bodies.position.Get(body1);
+	RVector3 pos2 = bodies.position.Get(body2);
+
+	std::vector<RVector3> s1, s2;
+	RVector3 square[] = { {-1,-1,0}, {-1,1,0}, {1,1,0}, {1,-1,0} };
+	for (int i = 0; i < 4; i++)
+	{
+		s1.push_back(pos1 + (square[i] * bodies.radius[body1]).RotateByQuaternion(RQuaternion::FromAxisAngle({ 0,0,1 }, bodies.rotation[body1])));
+		s2.push_back(pos2 + (square[i] * bodies.radius[body2]).RotateByQuaternion(RQuaternion::FromAxisAngle({ 0,0,1 }, bodies.rotation[body2])));
+	}
+
+	std::vector<CollisionInfo> contacts;
+	for (int i = 0; i < 4; i++)
+	{
+		CollisionInfo info;
+		if (world.CollidePointPolygon(s1[i], s2.data(), (int)s2.size(), pos1, pos2, info))
+		{
+			info.normal = -info.normal;
+			contacts.push_back(info);
+		}
+		if (world.CollidePointPolygon(s2[i], s1.data(), (int)s1.size(), pos2, pos1, info))
+			contacts.push_back(info);
+	}
+
+	if (contacts.size() > 0)
+	{
+		outInfo = contacts[0];
+		return true;
+	}
+	return false;
+}
+
+static void BuildPile(PhysicsWorld& world, int side)
+{
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> rotDist(0.0f, PI);
+
+	world.Init();
+	world.bodies.Reserve(side * side);
+	for (int y = 0; y < side; y++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			RigidBody2D rb;
+			rb.position = RVector3(x * 0.9f, y * 0.9f, 0);
+			rb.rotation = rotDist(rng);
+			rb.SetCubeSideLength(1.0f);
+			world.bodies.Add(rb);
+		}
+	}
+}
+
+struct Result {
+	double ms;
+	long long allocations;
+	int contacts;
+};
+
+template <typename Collide>
+static Result Run(PhysicsWorld& world, int iterations, Collide collide)
+{
+	Result result = { 1e30, 0, 0 };
+	for (int it = 0; it < iterations; it++)
+	{
+		long long allocationsBefore = allocationCount;
+		auto start = std::chrono::steady_clock::now();
+
+		int contacts = 0;
+		for (const BodyPair& pair : world.pairs)
+		{
+			CollisionInfo info;
+			if (collide(pair.a, pair.b, info))
+				contacts++;
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		result.ms = std::min(result.ms, ms);
+		result.allocations = allocationCount - allocationsBefore;
+		result.contacts = contacts;
+	}
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	int side = argc > 1 ? atoi(argv[1]) : 100;
+	int iterations = argc > 2 ? atoi(argv[2]) : 20;
+
+	PhysicsWorld world;
+	BuildPile(world, side);
+	world.broadphase->FindPairs(world.bodies, world.pairs, world.jobs);
+	int pairCount = (int)world.pairs.size();
+	printf("%d boxes, %d broadphase pairs, best of %d runs\n\n", world.bodies.Size(), pairCount, iterations);
+
+	Result legacy = Run(world, iterations, [&](int a, int b, CollisionInfo& info) {
+		return LegacyCollideSquareSquare(world, a, b, info);
+	});
+
+	// The cached path pays for the vertex transform once per step, count it too
+	long long allocationsBefore = allocationCount;
+	auto start = std::chrono::steady_clock::now();
+	world.TransformAllBodyVertices();
+	double transformMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	long long transformAllocations = allocationCount - allocationsBefore;
+
+	Result cached = Run(world, iterations, [&](int a, int b, CollisionInfo& info) {
+		return world.CollideSquareSquare(a, b, info);
+	});
+
+	world.narrowphaseType = NarrowphaseType::SAT;
+	int satPoints = 0;
+	Result sat = Run(world, iterations, [&](int a, int b, CollisionInfo&) {
+		ContactManifold manifold;
+		bool collided = world.CollideBodies(a, b, manifold);
+		satPoints += manifold.pointCount;
+		return collided;
+	});
+	satPoints /= iterations;
+
+	printf("%-26s %9s %10s %12s %9s\n", "", "ms", "ns/pair", "allocations", "contacts");
+	printf("%-26s %9.3f %10.1f %12lld %9d\n", "std::vector narrowphase", legacy.ms, legacy.ms * 1e6 / pairCount, legacy.allocations, legacy.contacts);
+	printf("%-26s %9.3f %10.1f %12lld %9d\n", "cached narrowphase", cached.ms, cached.ms * 1e6 / pairCount, cached.allocations, cached.contacts);
+	printf("%-26s %9.3f %10.1f %12lld %9d (%d points)\n", "SAT manifold", sat.ms, sat.ms * 1e6 / pairCount, sat.allocations, sat.contacts, satPoints);
+	printf("%-26s %9.3f %10s %12lld\n", "  + vertex transform", transformMs, "", transformAllocations);
+
+	// Full steps, once every buffer has grown to its steady state size
+	for (int i = 0; i < 10; i++)
+		world.Update(1.0f / 60.0f);
+	allocationsBefore = allocationCount;
+	for (int i = 0; i < 10; i++)
+		world.Update(1.0f / 60.0f);
+	printf("\nAllocations per PhysicsWorld::Update: %.1f\n", (allocationCount - allocationsBefore) / 10.0);
+
+	return cached.allocations == 0 && sat.allocations == 0 && legacy.contacts == cached.contacts ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+/*
+	Recorder benchmark: steps a scenario with & without recording every step,
+	and prints how much longer steps took, what Capture cost on the stepping
+	thread & how big the recording came out. Capture's wall time includes the
+	writer's encoding when there's no spare core for it, so its CPU time is
+	printed too: what it costs when the writer has a core of its own. Then plays it back, checking every
+	frame against the bodies it was captured from (positions & rotations to
+	within the quantization), and times stepping through it & seeking around.
+
+	Usage: 3VG3_bench_recorder [scenario] [steps] [threads]
+	(the scenario's index in the app's list, "Drifting boxes" by default)
+*/
+#include "physics/physics_world.h"
+#include "physics/recorder.h"
+#include "physics/scenarios.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#ifndef _WIN32
+	#include <time.h>
+#endif
+
+#ifndef SCENARIO_DIRECTORY
+	#define SCENARIO_DIRECTORY "resources/scenarios"
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// CPU time the calling thread has used, which leaves out time it was waiting for
+// a core. Windows only counts it in scheduler ticks, too coarse for a Capture
+static double ThreadCpuMilliseconds()
+{
+#ifdef _WIN32
+	return 0.0;
+#else
+	timespec time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+	return time.tv_sec * 1e3 + time.tv_nsec * 1e-6;
+#endif
+}
+
+// Positions & rotations after every step
+struct Trace {
+	std::vector<float> x, y, rotation;
+};
+
+static double RunSteps(const ScenarioInfo& scenario, int steps, int threads, Recorder* recorder, Trace* trace,
+	double& outCaptureMs, double& outCaptureCpuMs)
+{
+	PhysicsWorld world;
+	world.Init();
+	world.jobs.SetThreadCount(threads);
+	LoadScenario(world, scenario);
+
+	double stepMs = 0.0;
+	outCaptureMs = 0.0;
+	outCaptureCpuMs = 0.0;
+	for (int step = 0; step < steps; step++)
+	{
+		Clock::time_point start = Clock::now();
+		world.Update(1.0f / 60.0f);
+		stepMs += Milliseconds(start);
+
+		if (recorder != nullptr)
+		{
+			start = Clock::now();
+			double startCpu = ThreadCpuMilliseconds();
+			recorder->Capture(world.bodies, world.stepCount);
+			outCaptureCpuMs += ThreadCpuMilliseconds() - startCpu;
+			outCaptureMs += Milliseconds(start);
+		}
+		if (trace != nullptr)
+		{
+			const BodyStore& bodies = world.bodies;
+			trace->x.insert(trace->x.end(), bodies.position.x.begin(), bodies.position.x.end());
+			trace->y.insert(trace->y.end(), bodies.position.y.begin(), bodies.position.y.end());
+			trace->rotation.insert(trace->rotation.end(), bodies.rotation.begin(), bodies.rotation.end());
+		}
+	}
+	return stepMs;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<ScenarioInfo> scenarios = FindScenarios(SCENARIO_DIRECTORY);
+	int scenario = -1;
+	for (int i = 0; i < (int)scenarios.size(); i++)
+	{
+		if (scenarios[i].name == "Drifting boxes")
+			scenario = i;
+	}
+	if (argc > 1)
+		scenario = atoi(argv[1]);
+	int steps = argc > 2 ? atoi(argv[2]) : 300;
+	int threads = argc > 3 ? atoi(argv[3]) : JobSystem::DefaultThreadCount();
+	if (scenario < 0 || scenario >= (int)scenarios.size() || steps < 1)
+	{
+		printf("Usage: %s [scenario] [steps] [threads]\n", argv[0]);
+		return 1;
+	}
+	const ScenarioInfo& info = scenarios[scenario];
+	const char* path = "bench_recording.rec";
+
+	// Without, then with, keeping the trace out of the timed runs' way
+	double captureMs, captureCpuMs;
+	double plainMs = RunSteps(info, steps, threads, nullptr, nullptr, captureMs, captureCpuMs);
+	Recorder recorder;
+	recorder.Start(path, 1.0f / 60.0f);
+	double recordedMs = RunSteps(info, steps, threads, &recorder, nullptr, captureMs, captureCpuMs);
+	Clock::time_point stopStart = Clock::now();
+	recorder.Stop();
+	double stopMs = Milliseconds(stopStart);
+
+	Trace trace;
+	double unused, unusedCpu;
+	RunSteps(info, steps, threads, nullptr, &trace, unused, unusedCpu);
+	int bodyCount = (int)(trace.x.size() / steps);
+
+	printf("%s: %d bodies, %d steps on %d threads\n\n", info.name.c_str(), bodyCount, steps, threads);
+	printf("Step, not recording    %8.3f ms\n", plainMs / steps);
+	printf("Step, recording        %8.3f ms (%+.1f%%)\n", recordedMs / steps, (recordedMs / plainMs - 1.0) * 100.0);
+	printf("Capture                %8.3f ms (%.1f%% of a step)\n", captureMs / steps, captureMs / recordedMs * 100.0);
+#ifndef _WIN32
+	printf("Capture, CPU time      %8.3f ms (%.1f%% of a step)\n", captureCpuMs / steps, captureCpuMs / recordedMs * 100.0);
+#endif
+	printf("Stop (what's queued)   %8.3f ms\n", stopMs);
+	printf("Dropped frames         %8d\n", recorder.droppedCount);
+	printf("Recording              %8.2f MB, %.2f bytes per body per frame (%.0f as floats)\n\n",
+		recorder.writtenBytes / 1e6, (double)recorder.writtenBytes / ((double)bodyCount * steps), 3.0 * sizeof(float) + 1.0);
+
+	// Play back every frame in order, then seek around
+	Replay replay;
+	if (!replay.Open(path) || replay.FrameCount() != steps)
+	{
+		printf("Couldn't open the recording, or it has the wrong number of frames\n");
+		return 1;
+	}
+
+	BodyStore bodies;
+	float maxPositionError = 0.0f, maxRotationError = 0.0f;
+	double playMs = 0.0;
+	for (int frame = 0; frame < steps; frame++)
+	{
+		Clock::time_point start = Clock::now();
+		bool ok = replay.Seek(frame, bodies);
+		playMs += Milliseconds(start);
+		if (!ok || bodies.Size() != bodyCount)
+		{
+			printf("Frame %d didn't decode\n", frame);
+			return 1;
+		}
+		for (int i = 0; i < bodyCount; i++)
+		{
+			size_t k = (size_t)frame * bodyCount + i;
+			maxPositionError = std::max(maxPositionError, fabsf(bodies.position.x[i] - trace.x[k]));
+			maxPositionError = std::max(maxPositionError, fabsf(bodies.position.y[i] - trace.y[k]));
+			maxRotationError = std::max(maxRotationError, fabsf(bodies.rotation[i] - trace.rotation[k]));
+		}
+	}
+
+	const int seeks = 50;
+	Clock::time_point seekStart = Clock::now();
+	for (int s = 0; s < seeks; s++)
+		replay.Seek((int)((s * 7919LL) % steps), bodies);
+	double seekMs = Milliseconds(seekStart) / seeks;
+
+	printf("Play back              %8.3f ms a frame\n", playMs / steps);
+	printf("Seek                   %8.3f ms\n", seekMs);
+	printf("Max error              %8.5f position, %.5f rotation\n", maxPositionError, maxRotationError);
+
+	// Anything past half a step (& a little for float rounding) is a bug
+	bool accurate = maxPositionError <= Recorder::POSITION_STEP * 0.51f && maxRotationError <= Recorder::ROTATION_STEP * 0.51f;
+	replay.Close();
+	remove(path);
+	return accurate ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+/*
+	Scenario loading benchmark: writes a generated scene of N boxes as a binary
+	and a text scenario file, then loads each back a few times and prints how
+	long it took and how fast that is in MB/s. The first binary load may come
+	from disk, later ones from the OS file cache, so they show the cost of the
+	loader itself. Also checks both files load back exactly what was saved.
+
+	Usage: 3VG3_bench_scenario_io [bodies] [text bodies]
+*/
+#include "physics/body_store.h"
+#include "physics/scenario_file.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static void BuildScene(BodyStore& bodies, int count)
+{
+	int columns = 1000;
+	int square = bodies.shapes.AddBox(0.5f, 0.5f);
+	int first = bodies.AddBodies(count);
+	for (int i = first; i < first + count; i++)
+	{
+		bodies.position.x[i] = (i % columns) * 1.6f;
+		bodies.position.y[i] = (i / columns) * 1.6f;
+		bodies.velocity.x[i] = (i % 7) * 0.1f - 0.3f;
+		bodies.rotation[i] = (i % 11) * 0.05f;
+		bodies.SetShape(i, square);
+		bodies.color[i] = ColorFromHSV(360.0f * (i % columns) / columns, 0.6f, 0.9f);
+	}
+	bodies.oldPos = bodies.position;
+	bodies.oldRotation = bodies.rotation;
+}
+
+static long FileSize(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 0;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+// Loads path a few times, returns false if a load failed or didn't match the scene
+static bool TimeLoads(const char* name, const char* path, const BodyStore& scene)
+{
+	double megabytes = FileSize(path) / (1024.0 * 1024.0);
+	bool ok = true;
+	for (int run = 0; run < 3; run++)
+	{
+		BodyStore bodies;
+		auto start = std::chrono::steady_clock::now();
+		bool loaded = LoadScenarioFile(bodies, path);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		bool matches = loaded && bodies.Size() == scene.Size() && bodies.HashState() == scene.HashState();
+		ok = ok && matches;
+		printf("%-8s %4d %9.1f MB %10.2f ms %10.0f MB/s%s\n", name, run, megabytes, ms, megabytes / (ms / 1000.0),
+			matches ? "" : "  MISMATCH");
+	}
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	int bodyCount = argc > 1 ? atoi(argv[1]) : 1000000;
+	int textBodyCount = argc > 2 ? atoi(argv[2]) : 100000;
+	if (bodyCount <= 0 || textBodyCount <= 0)
+	{
+		fprintf(stderr, "Usage: %s [bodies] [text bodies]\n", argv[0]);
+		return 1;
+	}
+
+	const char* binaryPath = "bench_scene.sceneb";
+	const char* textPath = "bench_scene.scene";
+
+	BodyStore scene;
+	BuildScene(scene, bodyCount);
+	BodyStore textScene;
+	BuildScene(textScene, textBodyCount);
+	if (!SaveScenarioBinary(scene, binaryPath) || !SaveScenarioText(textScene, textPath))
+	{
+		fprintf(stderr, "Couldn't write the scene files\n");
+		return 1;
+	}
+
+	printf("%d bodies binary, %d bodies text\n\n", bodyCount, textBodyCount);
+	printf("%-8s %4s %12s %13s %15s\n", "format", "run", "size", "load", "throughput");
+	bool ok = TimeLoads("binary", binaryPath, scene);
+	ok = TimeLoads("text", textPath, textScene) && ok;
+
+	remove(binaryPath);
+	remove(textPath);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+/*
+	Thread scaling benchmark: steps two scenes with 1, 2, 4, 8 and 16 threads, and
+	checks every run of a scene ends in exactly the same state. Sleeping is off so
+	every step does the full amount of work.
+
+	- Towers: lots of separate stacks, so lots of islands to solve in parallel
+	- Pit: one big pile, a single island the contact solver runs on one thread
+
+	Usage: 3VG3_bench_threads [boxes] [steps]
+*/
+#include "physics/physics_world.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static void BuildTowers(PhysicsWorld& world, int boxCount)
+{
+	const int height = 10;
+	int towers = (boxCount + height - 1) / height;
+
+	RigidBody2D floor;
+	floor.inverseMass = 0.0f;
+	floor.inverseMOI = 0.0f;
+	floor.SetCubeSideLength(towers * 2.0f + 10.0f);
+	floor.position = RVector3(towers - 1.0f, -floor.radius - 0.5f, 0);
+	world.bodies.Add(floor);
+
+	world.bodies.Reserve(boxCount + 1);
+	for (int i = 0; i < boxCount; i++)
+	{
+		RigidBody2D rb;
+		rb.position = RVector3((i / height) * 2.0f, (i % height) * 1.02f, 0);
+		rb.SetCubeSideLength(1.0f);
+		rb.inverseMOI = 6.0f;
+		rb.doGravity = true;
+		world.bodies.Add(rb);
+	}
+}
+
+static void BuildPit(PhysicsWorld& world, int boxCount)
+{
+	// Floor & walls
+	int columns = 100;
+	float width = columns * 1.1f;
+	RigidBody2D wall;
+	wall.inverseMass = 0.0f;
+	wall.inverseMOI = 0.0f;
+	wall.SetCubeSideLength(width);
+	wall.position = RVector3(0, -width * 0.5f, 0);
+	world.bodies.Add(wall);
+	wall.position = RVector3(-width, width * 0.5f, 0);
+	world.bodies.Add(wall);
+	wall.position = RVector3(width, width * 0.5f, 0);
+	world.bodies.Add(wall);
+
+	world.bodies.Reserve(boxCount + 3);
+	for (int i = 0; i < boxCount; i++)
+	{
+		RigidBody2D rb;
+		int x = i % columns, y = i / columns;
+		rb.position = RVector3((x - columns * 0.5f + 0.5f) * 1.05f + (y % 2) * 0.2f, 1.0f + y * 1.1f, 0);
+		rb.rotation = (x * 7 + y * 3) % 11 * 0.05f;
+		rb.SetCubeSideLength(1.0f);
+		rb.inverseMOI = 6.0f;
+		rb.doGravity = true;
+		world.bodies.Add(rb);
+	}
+}
+
+// Runs a scene with every thread count, returns false if they didn't all agree
+static bool RunScene(const char* name, void (*build)(PhysicsWorld&, int), int boxCount, int steps)
+{
+	const int threadCounts[] = { 1, 2, 4, 8, 16 };
+
+	printf("%s\n", name);
+	printf("%8s %12s %10s %18s\n", "threads", "ms/step", "speedup", "state hash");
+
+	double baseMs = 0.0;
+	uint64_t baseHash = 0;
+	bool deterministic = true;
+	for (int threads : threadCounts)
+	{
+		PhysicsWorld world;
+		world.jobs.SetThreadCount(threads);
+		world.Init();
+		world.allowSleeping = false;
+		build(world, boxCount);
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < steps; i++)
+			world.Update(1.0f / 60.0f);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / steps;
+
+		uint64_t hash = world.bodies.HashState();
+		if (threads == 1)
+		{
+			baseMs = ms;
+			baseHash = hash;
+		}
+		deterministic = deterministic && hash == baseHash;
+
+		printf("%8d %12.3f %9.2fx %18llx%s\n", world.jobs.ThreadCount(), ms, baseMs / ms,
+			(unsigned long long)hash, hash == baseHash ? "" : "  MISMATCH");
+	}
+
+	printf("%s\n\n", deterministic ? "All thread counts ended in the same state" : "Thread counts disagree!");
+	return deterministic;
+}
+
+int main(int argc, char** argv)
+{
+	int boxCount = argc > 1 ? atoi(argv[1]) : 10000;
+	int steps = argc > 2 ? atoi(argv[2]) : 300;
+
+	printf("%d boxes, %d steps, %d hardware threads\n\n", boxCount, steps, JobSystem::DefaultThreadCount());
+	bool deterministic = RunScene("Towers", BuildTowers, boxCount, steps);
+	deterministic = RunScene("Pit", BuildPit, boxCount, steps) && deterministic;
+	return deterministic ? 0 : 1;
+}
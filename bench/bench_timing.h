@@ -0,0 +1,29 @@
+#pragma once
+
+// Timing & printing shared by the kernel benchmarks, which run a kernel many
+// times over the same bodies and compare it to a plain reference version
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+// The fastest of iterations runs of func, the least disturbed by everything else
+template <typename Func>
+double BestTimeMs(int iterations, Func func)
+{
+	double best = 1e30;
+	for (int i = 0; i < iterations; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		func();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		best = std::min(best, ms);
+	}
+	return best;
+}
+
+// A line of the results table: time, time per body & speedup over the baseline
+inline void Report(const char* name, double ms, int count, double baselineMs)
+{
+	printf("%-24s %9.3f ms %8.2f ns/body %7.2fx\n", name, ms, ms * 1e6 / count, baselineMs / ms);
+}
@@ -7,6 +7,7 @@
 #endif
 
 #include "scene/scene.h"
+#include "physics/profiler.h"
 
 int screenWidth = 1280;
 int screenHeight = 720;
@@ -39,6 +40,7 @@ int main()
 		UpdateDrawFrame();
 #endif
 
+	scene.Unload();
 	rlImGuiShutdown();
 	CloseWindow();
 	return 0;
@@ -47,10 +49,14 @@ int main()
 
 void UpdateDrawFrame(void)
 { 
+	PROFILE_NEW_FRAME();
 	scene.Update(GetFrameTime());
 
 	BeginDrawing();
 		ClearBackground(BLACK);
 		scene.Render();
-	EndDrawing();
+	{
+		PROFILE_SCOPE("Present");
+		EndDrawing();
+	}
 }
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include "aabb_tree.h"
+
+int AabbTree::AllocateNode()
+{
+	if (freeList == NULL_NODE)
+	{
+		nodes.emplace_back();
+		return (int)nodes.size() - 1;
+	}
+
+	int node = freeList;
+	freeList = nodes[node].parent;
+	nodes[node] = Node();
+	return node;
+}
+
+void AabbTree::FreeNode(int node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+int AabbTree::CreateProxy(const Aabb& aabb, int userData)
+{
+	int proxy = AllocateNode();
+	Node& node = nodes[proxy];
+	node.aabb = { { aabb.min.x - margin, aabb.min.y - margin }, { aabb.max.x + margin, aabb.max.y + margin } };
+	node.userData = userData;
+	node.height = 0;
+
+	InsertLeaf(proxy);
+	proxyCount++;
+	return proxy;
+}
+
+void AabbTree::DestroyProxy(int proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	proxyCount--;
+}
+
+bool AabbTree::MoveProxy(int proxy, const Aabb& aabb, Vector2 displacement)
+{
+	if (nodes[proxy].aabb.Contains(aabb))
+		return false;
+
+	// Fatten, and stretch ahead in the direction it's moving
+	Aabb fat = { { aabb.min.x - margin, aabb.min.y - margin }, { aabb.max.x + margin, aabb.max.y + margin } };
+	float aheadX = displacementMultiplier * displacement.x, aheadY = displacementMultiplier * displacement.y;
+	if (aheadX < 0.0f) fat.min.x += aheadX; else fat.max.x += aheadX;
+	if (aheadY < 0.0f) fat.min.y += aheadY; else fat.max.y += aheadY;
+
+	RemoveLeaf(proxy);
+	nodes[proxy].aabb = fat;
+	InsertLeaf(proxy);
+	return true;
+}
+
+void AabbTree::Clear()
+{
+	nodes.clear();
+	root = NULL_NODE;
+	freeList = NULL_NODE;
+	proxyCount = 0;
+}
+
+/**
+	Walks down from the root, at each node comparing the cost of making the leaf
+	its sibling here with the cheapest the cost could be further down either child
+	(the perimeter every node on the way would have to grow by, plus the new
+	parent's), and stops once going down can't beat stopping.
+*/
+void AabbTree::InsertLeaf(int leaf)
+{
+	if (root == NULL_NODE)
+	{
+		root = leaf;
+		nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	const Aabb leafAabb = nodes[leaf].aabb;
+	int index = root;
+	while (!nodes[index].IsLeaf())
+	{
+		const Node& node = nodes[index];
+		float perimeter = node.aabb.Perimeter();
+		float combined = Aabb::Union(node.aabb, leafAabb).Perimeter();
+
+		// A new parent of this node & the leaf, and what pushing further down costs
+		// every node above
+		float cost = 2.0f * combined;
+		float inheritance = 2.0f * (combined - perimeter);
+
+		auto descendCost = [&](int child) {
+			float grown = Aabb::Union(leafAabb, nodes[child].aabb).Perimeter();
+			if (!nodes[child].IsLeaf())
+				grown -= nodes[child].aabb.Perimeter();
+			return grown + inheritance;
+		};
+		float cost1 = descendCost(node.child1);
+		float cost2 = descendCost(node.child2);
+
+		if (cost < cost1 && cost < cost2)
+			break;
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+
+	// Put a new parent over the sibling & the leaf
+	int sibling = index;
+	int oldParent = nodes[sibling].parent;
+	int newParent = AllocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].aabb = Aabb::Union(leafAabb, nodes[sibling].aabb);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == NULL_NODE)
+		root = newParent;
+	else if (nodes[oldParent].child1 == sibling)
+		nodes[oldParent].child1 = newParent;
+	else
+		nodes[oldParent].child2 = newParent;
+
+	FixUpwards(nodes[leaf].parent);
+}
+
+void AabbTree::RemoveLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = NULL_NODE;
+		return;
+	}
+
+	// The sibling takes the parent's place
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	if (grandParent == NULL_NODE)
+	{
+		root = sibling;
+		nodes[sibling].parent = NULL_NODE;
+		FreeNode(parent);
+		return;
+	}
+
+	if (nodes[grandParent].child1 == parent)
+		nodes[grandParent].child1 = sibling;
+	else
+		nodes[grandParent].child2 = sibling;
+	nodes[sibling].parent = grandParent;
+	FreeNode(parent);
+
+	FixUpwards(grandParent);
+}
+
+// Balances, and refits boxes & heights, from node up to the root
+void AabbTree::FixUpwards(int node)
+{
+	while (node != NULL_NODE)
+	{
+		node = Balance(node);
+
+		Node& n = nodes[node];
+		n.height = 1 + std::max(nodes[n.child1].height, nodes[n.child2].height);
+		n.aabb = Aabb::Union(nodes[n.child1].aabb, nodes[n.child2].aabb);
+		node = n.parent;
+	}
+}
+
+/**
+	If one child of a is more than one level taller than the other, rotates the
+	taller child up into a's place (like an AVL tree), with a keeping the taller
+	child's shorter child. Returns the index of the node now where a was.
+
+	        a               c
+	      /   \           /   \
+	     b     c   ->    a     f
+	          / \       / \
+	         f   g     b   g
+*/
+int AabbTree::Balance(int a)
+{
+	Node& A = nodes[a];
+	if (A.IsLeaf() || A.height < 2)
+		return a;
+
+	int b = A.child1, c = A.child2;
+	int balance = nodes[c].height - nodes[b].height;
+	if (balance >= -1 && balance <= 1)
+		return a;
+
+	// Rotate the taller child up, call it up & the other one down
+	int up = balance > 1 ? c : b;
+	int down = balance > 1 ? b : c;
+	Node& U = nodes[up];
+	int f = U.child1, g = U.child2;
+
+	// up takes a's place
+	U.child1 = a;
+	U.parent = A.parent;
+	A.parent = up;
+	if (U.parent == NULL_NODE)
+		root = up;
+	else if (nodes[U.parent].child1 == a)
+		nodes[U.parent].child1 = up;
+	else
+		nodes[U.parent].child2 = up;
+
+	// The taller of up's children stays with up, the other goes to a
+	int keep = nodes[f].height > nodes[g].height ? f : g;
+	int give = keep == f ? g : f;
+	U.child2 = keep;
+	nodes[keep].parent = up;
+	A.child1 = down;
+	A.child2 = give;
+	nodes[give].parent = a;
+
+	A.aabb = Aabb::Union(nodes[down].aabb, nodes[give].aabb);
+	A.height = 1 + std::max(nodes[down].height, nodes[give].height);
+	U.aabb = Aabb::Union(A.aabb, nodes[keep].aabb);
+	U.height = 1 + std::max(A.height, nodes[keep].height);
+	return up;
+}
+
+void AabbTree::Rebuild()
+{
+	if (root == NULL_NODE)
+		return;
+
+	// Keep the leaves, free every inner node
+	leaves.clear();
+	for (int i = 0; i < (int)nodes.size(); i++)
+	{
+		if (nodes[i].height < 0)
+			continue;
+		if (nodes[i].IsLeaf())
+			leaves.push_back(i);
+		else
+			FreeNode(i);
+	}
+
+	root = BuildTopDown(leaves.data(), (int)leaves.size());
+	nodes[root].parent = NULL_NODE;
+}
+
+/**
+	Splits the leaves in two along the longest axis of their centers, where the
+	surface area heuristic says to: each side costs its leaf count times its
+	perimeter, tried at the edges of a few equal bins. Big & small boxes end up
+	apart this way, where splitting at the median would mix them.
+*/
+int AabbTree::BuildTopDown(int* first, int count)
+{
+	if (count == 1)
+		return first[0];
+
+	Vector2 lo = { INFINITY, INFINITY }, hi = { -INFINITY, -INFINITY };
+	for (int i = 0; i < count; i++)
+	{
+		const Aabb& box = nodes[first[i]].aabb;
+		float cx = box.min.x + box.max.x, cy = box.min.y + box.max.y;
+		lo = { std::min(lo.x, cx), std::min(lo.y, cy) };
+		hi = { std::max(hi.x, cx), std::max(hi.y, cy) };
+	}
+	bool alongX = hi.x - lo.x >= hi.y - lo.y;
+	float axisMin = alongX ? lo.x : lo.y;
+	float axisExtent = alongX ? hi.x - lo.x : hi.y - lo.y;
+	auto center = [&](int leaf) {
+		const Aabb& box = nodes[leaf].aabb;
+		return alongX ? box.min.x + box.max.x : box.min.y + box.max.y;
+	};
+
+	int* middle = first + count / 2;
+	if (axisExtent > 0.0f)
+	{
+		const int BINS = 16;
+		int binCount[BINS] = {};
+		Aabb binBox[BINS];
+		for (Aabb& box : binBox)
+			box = { { INFINITY, INFINITY }, { -INFINITY, -INFINITY } };
+
+		float toBin = BINS * 0.9999f / axisExtent;
+		for (int i = 0; i < count; i++)
+		{
+			int bin = (int)((center(first[i]) - axisMin) * toBin);
+			binCount[bin]++;
+			binBox[bin] = Aabb::Union(binBox[bin], nodes[first[i]].aabb);
+		}
+
+		// Costs of everything left of each bin edge, then sweep back from the right
+		float leftCost[BINS];
+		Aabb box = binBox[0];
+		int leftCount = 0;
+		for (int b = 0; b < BINS - 1; b++)
+		{
+			box = Aabb::Union(box, binBox[b]);
+			leftCount += binCount[b];
+			leftCost[b] = leftCount * (leftCount > 0 ? box.Perimeter() : 0.0f);
+		}
+
+		float bestCost = INFINITY;
+		int bestEdge = -1;
+		box = binBox[BINS - 1];
+		int rightCount = 0;
+		for (int b = BINS - 1; b > 0; b--)
+		{
+			box = Aabb::Union(box, binBox[b]);
+			rightCount += binCount[b];
+			float cost = leftCost[b - 1] + rightCount * (rightCount > 0 ? box.Perimeter() : 0.0f);
+			if (rightCount > 0 && rightCount < count && cost < bestCost)
+			{
+				bestCost = cost;
+				bestEdge = b;
+			}
+		}
+
+		if (bestEdge > 0)
+		{
+			middle = std::partition(first, first + count, [&](int leaf) {
+				return (int)((center(leaf) - axisMin) * toBin) < bestEdge;
+			});
+		}
+	}
+
+	// Every center in the same place, or no edge splits them, fall back to halves
+	if (middle == first || middle == first + count)
+	{
+		middle = first + count / 2;
+		std::nth_element(first, middle, first + count, [&](int a, int b) { return center(a) < center(b); });
+	}
+
+	int half = (int)(middle - first);
+	int child1 = BuildTopDown(first, half);
+	int child2 = BuildTopDown(middle, count - half);
+
+	int parent = AllocateNode();
+	Node& node = nodes[parent];
+	node.child1 = child1;
+	node.child2 = child2;
+	node.aabb = Aabb::Union(nodes[child1].aabb, nodes[child2].aabb);
+	node.height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+	nodes[child1].parent = parent;
+	nodes[child2].parent = parent;
+	return parent;
+}
+
+float AabbTree::PerimeterRatio() const
+{
+	if (root == NULL_NODE)
+		return 0.0f;
+
+	float total = 0.0f;
+	for (const Node& node : nodes)
+	{
+		if (node.height > 0)
+			total += node.aabb.Perimeter();
+	}
+	float rootPerimeter = nodes[root].aabb.Perimeter();
+	return rootPerimeter > 0.0f ? total / rootPerimeter : 0.0f;
+}
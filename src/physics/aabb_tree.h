@@ -0,0 +1,237 @@
+#pragma once
+
+#include "raylib-cpp.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Axis aligned box on the XY plane
+struct Aabb {
+	Vector2 min;
+	Vector2 max;
+
+	bool Overlaps(const Aabb& other) const
+	{
+		return min.x <= other.max.x && other.min.x <= max.x && min.y <= other.max.y && other.min.y <= max.y;
+	}
+
+	bool Contains(const Aabb& other) const
+	{
+		return min.x <= other.min.x && min.y <= other.min.y && other.max.x <= max.x && other.max.y <= max.y;
+	}
+
+	// Cheaper than area & still grows with size, so it's what insertion minimizes
+	float Perimeter() const { return 2.0f * ((max.x - min.x) + (max.y - min.y)); }
+
+	static Aabb Union(const Aabb& a, const Aabb& b)
+	{
+		return { { std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y) },
+				 { std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y) } };
+	}
+};
+
+/**
+	Dynamic AABB tree, a bounding volume hierarchy kept up to date as things move
+	instead of rebuilt every step (the same idea as Box2D's b2DynamicTree).
+
+	Leaves are proxies, each with a box fattened by a margin and stretched along
+	how far it last moved. Moving a proxy only touches the tree when its tight box
+	leaves the fat one, and then it's removed and inserted again. Inserting walks
+	down to the sibling that grows the total perimeter least, and both inserting &
+	removing rotate nodes on the way back up to keep the tree balanced. Lots of
+	moves still slowly make it worse than a fresh build, so Rebuild() builds the
+	whole tree again top-down.
+
+	Nodes are indices into one array with a free list, so proxies stay valid
+	through anything but DestroyProxy. Queries only read the tree, any number can
+	run on different threads at once.
+*/
+class AabbTree {
+
+public:
+	static constexpr int NULL_NODE = -1;
+
+	float margin = 0.1f;					// fattening on every side
+	float displacementMultiplier = 4.0f;	// fat boxes also stretch this many moves ahead
+
+	int CreateProxy(const Aabb& aabb, int userData);
+	void DestroyProxy(int proxy);
+	// Returns true if the proxy had to be reinserted
+	bool MoveProxy(int proxy, const Aabb& aabb, Vector2 displacement);
+	void Clear();
+
+	int GetUserData(int proxy) const { return nodes[proxy].userData; }
+	void SetUserData(int proxy, int userData) { nodes[proxy].userData = userData; }
+	const Aabb& GetFatAabb(int proxy) const { return nodes[proxy].aabb; }
+
+	/**
+		Calls callback(proxy) for every proxy whose fat box overlaps aabb. Return
+		false from it to stop early.
+	*/
+	template <typename Func>
+	void Query(const Aabb& aabb, Func callback) const;
+
+	/**
+		Calls callback(proxy, maxDistance) for every proxy whose fat box the ray
+		from origin along direction (unit length) hits within maxDistance. The
+		callback returns the distance to keep searching up to: maxDistance to go
+		on, a hit's distance to only look for closer ones, 0 to stop.
+	*/
+	template <typename Func>
+	void RayCast(Vector2 origin, Vector2 direction, float maxDistance, Func callback) const;
+
+	// Builds the tree again from its leaves, top-down: each node splits along
+	// its longest axis at the best of 16 bin edges by the surface area heuristic
+	// (see BuildTopDown). Proxies keep their indices
+	void Rebuild();
+
+	int ProxyCount() const { return proxyCount; }
+	// Proxies are all below this
+	int NodeCapacity() const { return (int)nodes.size(); }
+	bool IsProxy(int node) const { return node < (int)nodes.size() && nodes[node].height == 0; }
+	int Height() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+	// Total perimeter of the inner nodes over the root's, lower is a better tree
+	float PerimeterRatio() const;
+
+private:
+	// 32 bytes, two to a cache line
+	struct Node {
+		Aabb aabb;
+		int parent = NULL_NODE;		// next free node while on the free list
+		int child1 = NULL_NODE;
+		union {
+			int child2 = NULL_NODE;
+			int userData;			// leaves have no children
+		};
+		int height = 0;				// leaves are 0, free nodes -1
+
+		bool IsLeaf() const { return child1 == NULL_NODE; }
+	};
+
+	std::vector<Node> nodes;
+	int root = NULL_NODE;
+	int freeList = NULL_NODE;
+	int proxyCount = 0;
+	std::vector<int> leaves;	// for Rebuild
+
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	int Balance(int node);
+	void FixUpwards(int node);
+	int BuildTopDown(int* first, int count);
+
+	/**
+		Stack of nodes still to visit. Balancing keeps the tree shallow, so the
+		fixed part is enough for any realistic tree and queries don't allocate.
+	*/
+	class NodeStack {
+	public:
+		void Push(int node)
+		{
+			if (count < FIXED) fixed[count] = node;
+			else overflow.push_back(node);
+			count++;
+		}
+		int Pop()
+		{
+			count--;
+			if (count < FIXED) return fixed[count];
+			int node = overflow.back();
+			overflow.pop_back();
+			return node;
+		}
+		bool Empty() const { return count == 0; }
+
+	private:
+		static constexpr int FIXED = 128;
+		int fixed[FIXED];
+		int count = 0;
+		std::vector<int> overflow;
+	};
+
+};
+
+template <typename Func>
+void AabbTree::Query(const Aabb& aabb, Func callback) const
+{
+	if (root == NULL_NODE)
+		return;
+
+	NodeStack stack;
+	stack.Push(root);
+	while (!stack.Empty())
+	{
+		int index = stack.Pop();
+		const Node& node = nodes[index];
+		if (!node.aabb.Overlaps(aabb))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			if (!callback(index))
+				return;
+		}
+		else
+		{
+			stack.Push(node.child1);
+			stack.Push(node.child2);
+		}
+	}
+}
+
+template <typename Func>
+void AabbTree::RayCast(Vector2 origin, Vector2 direction, float maxDistance, Func callback) const
+{
+	if (root == NULL_NODE)
+		return;
+
+	// Slab test, clipping [0, maxDistance] to the box on each axis
+	float invX = 1.0f / direction.x, invY = 1.0f / direction.y;
+	auto hitDistance = [&](const Aabb& box) {
+		float enter = 0.0f, exit = maxDistance;
+		if (direction.x != 0.0f)
+		{
+			float t1 = (box.min.x - origin.x) * invX, t2 = (box.max.x - origin.x) * invX;
+			enter = std::max(enter, std::min(t1, t2));
+			exit = std::min(exit, std::max(t1, t2));
+		}
+		else if (origin.x < box.min.x || origin.x > box.max.x)
+			return INFINITY;
+
+		if (direction.y != 0.0f)
+		{
+			float t1 = (box.min.y - origin.y) * invY, t2 = (box.max.y - origin.y) * invY;
+			enter = std::max(enter, std::min(t1, t2));
+			exit = std::min(exit, std::max(t1, t2));
+		}
+		else if (origin.y < box.min.y || origin.y > box.max.y)
+			return INFINITY;
+
+		return enter <= exit ? enter : INFINITY;
+	};
+
+	NodeStack stack;
+	stack.Push(root);
+	while (!stack.Empty())
+	{
+		int index = stack.Pop();
+		const Node& node = nodes[index];
+		if (hitDistance(node.aabb) > maxDistance)
+			continue;
+
+		if (node.IsLeaf())
+		{
+			maxDistance = callback(index, maxDistance);
+			if (maxDistance <= 0.0f)
+				return;
+		}
+		else
+		{
+			stack.Push(node.child1);
+			stack.Push(node.child2);
+		}
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "body_store.h"
+#include <cmath>
+
+// Going between world space & a body's frame, for anchors on joints & springs
+
+// Rotates (x, y) counterclockwise by angle, the way bodies turn
+inline Vector2 Rotate(float x, float y, float angle)
+{
+	float c = cosf(angle), s = sinf(angle);
+	return { x * c - y * s, x * s + y * c };
+}
+
+// A world space point relative to a body's center, in its unrotated frame
+inline Vector2 ToLocal(const BodyStore& bodies, int body, Vector2 point)
+{
+	return Rotate(point.x - bodies.position.x[body], point.y - bodies.position.y[body], -bodies.rotation[body]);
+}
@@ -0,0 +1,290 @@
+#include "body_store.h"
+
+#include <assert.h>
+#include <string.h>
+
+BodyHandle BodyStore::Add(const RigidBody2D& body)
+{
+	uint32_t index = (uint32_t)Size();
+	layoutVersion++;
+
+	position.PushBack(body.position);
+	// A new body hasn't moved yet, so it starts out where it was last step
+	oldPos.PushBack(body.position);
+	velocity.PushBack(body.velocity);
+	force.PushBack(body.force);
+	torque.push_back(body.torque);
+	rotation.push_back(body.rotation);
+	oldRotation.push_back(body.rotation);
+	angularVelocity.push_back(body.angularVelocity);
+	inverseMass.push_back(body.inverseMass);
+	inverseMOI.push_back(body.inverseMOI);
+	shape.push_back(0);
+	radius.push_back(0.0f);
+	boundingRadius.push_back(0.0f);
+	SetShape(index, shapes.IsValid(body.shape) ? body.shape : shapes.AddBox(body.radius, body.radius));
+	sleeping.push_back(body.sleeping);
+	sleepTime.push_back(body.sleepTime);
+	doGravity.push_back(body.doGravity);
+	forceGroups.push_back(body.forceGroups);
+	bullet.push_back(body.bullet);
+	continuous.push_back(body.continuous);
+	kinematic.push_back(body.kinematic);
+	collisionLayer.push_back(body.collisionLayer);
+	collisionMask.push_back(body.collisionMask);
+	collisionGroup.push_back(body.collisionGroup);
+	color.push_back(body.color);
+
+	uint32_t slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		slot = (uint32_t)slotIndex.size();
+		slotIndex.push_back(0);
+		slotGeneration.push_back(0);
+	}
+
+	slotIndex[slot] = index;
+	denseSlot.push_back(slot);
+	return { slot, slotGeneration[slot] };
+}
+
+int BodyStore::AddBodies(int count)
+{
+	int first = Size();
+	int size = first + count;
+	layoutVersion++;
+
+	const RigidBody2D body;
+	position.x.resize(size, body.position.x);
+	position.y.resize(size, body.position.y);
+	position.z.resize(size, body.position.z);
+	oldPos.x.resize(size, body.position.x);
+	oldPos.y.resize(size, body.position.y);
+	oldPos.z.resize(size, body.position.z);
+	velocity.x.resize(size, body.velocity.x);
+	velocity.y.resize(size, body.velocity.y);
+	velocity.z.resize(size, body.velocity.z);
+	force.x.resize(size, body.force.x);
+	force.y.resize(size, body.force.y);
+	force.z.resize(size, body.force.z);
+	torque.resize(size, body.torque);
+	rotation.resize(size, body.rotation);
+	oldRotation.resize(size, body.rotation);
+	angularVelocity.resize(size, body.angularVelocity);
+	inverseMass.resize(size, body.inverseMass);
+	inverseMOI.resize(size, body.inverseMOI);
+	int square = shapes.AddBox(body.radius, body.radius);
+	shape.resize(size, square);
+	radius.resize(size, shapes.Get(square).innerRadius);
+	boundingRadius.resize(size, shapes.Get(square).boundingRadius);
+	sleeping.resize(size, body.sleeping);
+	sleepTime.resize(size, body.sleepTime);
+	doGravity.resize(size, body.doGravity);
+	forceGroups.resize(size, body.forceGroups);
+	bullet.resize(size, body.bullet);
+	continuous.resize(size, body.continuous);
+	kinematic.resize(size, body.kinematic);
+	collisionLayer.resize(size, body.collisionLayer);
+	collisionMask.resize(size, body.collisionMask);
+	collisionGroup.resize(size, body.collisionGroup);
+	color.resize(size, body.color);
+
+	// Reuse freed slots first, like Add
+	denseSlot.reserve(size);
+	for (int index = first; index < size; index++)
+	{
+		uint32_t slot;
+		if (!freeSlots.empty())
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			slot = (uint32_t)slotIndex.size();
+			slotIndex.push_back(0);
+			slotGeneration.push_back(0);
+		}
+		slotIndex[slot] = (uint32_t)index;
+		denseSlot.push_back(slot);
+	}
+	return first;
+}
+
+void BodyStore::SetShape(int index, int shapeId)
+{
+	const Shape& s = shapes.Get(shapeId);
+	layoutVersion++;
+	shape[index] = shapeId;
+	radius[index] = s.innerRadius;
+	boundingRadius[index] = s.boundingRadius;
+}
+
+void BodyStore::Remove(BodyHandle handle)
+{
+	if (!IsValid(handle))
+		return;
+	layoutVersion++;
+
+	// Move the last body into the removed body's place
+	int index = (int)slotIndex[handle.slot];
+	int last = Size() - 1;
+	if (index != last)
+	{
+		ForEachArray([=](auto& array) { array[index] = array[last]; });
+		denseSlot[index] = denseSlot[last];
+		slotIndex[denseSlot[index]] = index;
+	}
+
+	ForEachArray([](auto& array) { array.pop_back(); });
+	denseSlot.pop_back();
+
+	slotGeneration[handle.slot]++;
+	freeSlots.push_back(handle.slot);
+}
+
+void BodyStore::Clear()
+{
+	layoutVersion++;
+	ForEachArray([](auto& array) { array.clear(); });
+	slotIndex.clear();
+	slotGeneration.clear();
+	freeSlots.clear();
+	denseSlot.clear();
+	shapes.Clear();
+}
+
+void BodyStore::Reserve(int count)
+{
+	ForEachArray([=](auto& array) { array.reserve(count); });
+	denseSlot.reserve(count);
+}
+
+bool BodyStore::IsValid(BodyHandle handle) const
+{
+	return handle.slot < slotGeneration.size() && slotGeneration[handle.slot] == handle.generation;
+}
+
+int BodyStore::IndexOf(BodyHandle handle) const
+{
+	assert(IsValid(handle));
+	return (int)slotIndex[handle.slot];
+}
+
+BodyHandle BodyStore::HandleAt(int index) const
+{
+	uint32_t slot = denseSlot[index];
+	return { slot, slotGeneration[slot] };
+}
+
+RigidBody2D BodyStore::GetAt(int i) const
+{
+	RigidBody2D body;
+	body.position = position.Get(i);
+	body.oldPos = oldPos.Get(i);
+	body.velocity = velocity.Get(i);
+	body.force = force.Get(i);
+	body.torque = torque[i];
+	body.rotation = rotation[i];
+	body.oldRotation = oldRotation[i];
+	body.angularVelocity = angularVelocity[i];
+	body.inverseMass = inverseMass[i];
+	body.inverseMOI = inverseMOI[i];
+	body.shape = shape[i];
+	body.radius = radius[i];
+	body.boundingRadius = boundingRadius[i];
+	body.sleeping = sleeping[i];
+	body.sleepTime = sleepTime[i];
+	body.doGravity = doGravity[i];
+	body.forceGroups = forceGroups[i];
+	body.bullet = bullet[i];
+	body.continuous = continuous[i];
+	body.kinematic = kinematic[i];
+	body.collisionLayer = collisionLayer[i];
+	body.collisionMask = collisionMask[i];
+	body.collisionGroup = collisionGroup[i];
+	body.color = color[i];
+	return body;
+}
+
+void BodyStore::SetAt(int i, const RigidBody2D& body)
+{
+	layoutVersion++;
+	position.Set(i, body.position);
+	oldPos.Set(i, body.oldPos);
+	velocity.Set(i, body.velocity);
+	force.Set(i, body.force);
+	torque[i] = body.torque;
+	rotation[i] = body.rotation;
+	oldRotation[i] = body.oldRotation;
+	angularVelocity[i] = body.angularVelocity;
+	inverseMass[i] = body.inverseMass;
+	inverseMOI[i] = body.inverseMOI;
+	SetShape(i, shapes.IsValid(body.shape) ? body.shape : shapes.AddBox(body.radius, body.radius));
+	sleeping[i] = body.sleeping;
+	sleepTime[i] = body.sleepTime;
+	doGravity[i] = body.doGravity;
+	forceGroups[i] = body.forceGroups;
+	bullet[i] = body.bullet;
+	continuous[i] = body.continuous;
+	kinematic[i] = body.kinematic;
+	collisionLayer[i] = body.collisionLayer;
+	collisionMask[i] = body.collisionMask;
+	collisionGroup[i] = body.collisionGroup;
+	color[i] = body.color;
+}
+
+uint64_t BodyStore::HashState() const
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash](const std::vector<float>& values) {
+		for (float v : values)
+		{
+			uint32_t bits;
+			memcpy(&bits, &v, sizeof(bits));
+			for (int i = 0; i < 4; i++)
+			{
+				hash ^= (bits >> (i * 8)) & 0xFF;
+				hash *= 1099511628211ull;
+			}
+		}
+	};
+
+	add(position.x); add(position.y); add(position.z);
+	add(rotation);
+	add(velocity.x); add(velocity.y); add(velocity.z);
+	add(angularVelocity);
+	return hash;
+}
+
+void BodyStore::SaveState(SnapshotWriter& writer) const
+{
+	// ForEachArray only comes non-const, this just reads
+	const_cast<BodyStore*>(this)->ForEachArray([&](const auto& array) { writer.Array(array); });
+	writer.Array(slotIndex);
+	writer.Array(slotGeneration);
+	writer.Array(freeSlots);
+	writer.Array(denseSlot);
+}
+
+bool BodyStore::RestoreState(SnapshotReader& reader)
+{
+	layoutVersion++;
+	ForEachArray([&](auto& array) { reader.Array(array); });
+	reader.Array(slotIndex);
+	reader.Array(slotGeneration);
+	reader.Array(freeSlots);
+	reader.Array(denseSlot);
+
+	bool sizesMatch = denseSlot.size() == (size_t)Size() && slotIndex.size() == slotGeneration.size();
+	ForEachArray([&](const auto& array) { sizesMatch = sizesMatch && array.size() == (size_t)Size(); });
+	bool shapesValid = true;
+	for (int id : shape)
+		shapesValid = shapesValid && shapes.IsValid(id);
+	return !reader.Failed() && sizesMatch && shapesValid;
+}
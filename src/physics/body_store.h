@@ -0,0 +1,178 @@
+#pragma once
+
+#include "raylib-cpp.hpp"
+#include "rigidbody.h"
+#include "shape.h"
+#include "snapshot.h"
+#include <vector>
+#include <cstdint>
+
+/**
+	Refers to a body in a BodyStore. Unlike a dense index it stays valid when other
+	bodies are removed, and goes stale (IsValid returns false) once its own body is.
+*/
+struct BodyHandle {
+	uint32_t slot = UINT32_MAX;
+	uint32_t generation = 0;
+
+	bool operator==(const BodyHandle& other) const { return slot == other.slot && generation == other.generation; }
+	bool operator!=(const BodyHandle& other) const { return !(*this == other); }
+};
+
+/**
+	Three float arrays, one per component, so kernels can stream a single component
+	of every body.
+*/
+struct Vector3Array {
+	std::vector<float> x, y, z;
+
+	RVector3 Get(int i) const { return RVector3(x[i], y[i], z[i]); }
+	void Set(int i, Vector3 v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+	void PushBack(Vector3 v) { x.push_back(v.x); y.push_back(v.y); z.push_back(v.z); }
+};
+
+/**
+	Structure-of-arrays storage for every rigidbody in the world. Each field lives
+	in its own contiguous array indexed by a dense body index, so the integration
+	and collision loops only pull the fields they use through the cache.
+
+	Dense indices change when bodies are removed (the last body is moved into the
+	hole), so anything holding on to a body between steps should use a BodyHandle.
+	RigidBody2D is used to describe a body when adding it or reading it back whole.
+*/
+class BodyStore {
+
+public:
+	// Hot simulation data
+	Vector3Array position;
+	Vector3Array oldPos;
+	Vector3Array velocity;
+	Vector3Array force;		// applied every step until changed, see ForceAccumulator
+	std::vector<float> torque;
+	std::vector<float> rotation;
+	std::vector<float> oldRotation;
+	std::vector<float> angularVelocity;
+	std::vector<float> inverseMass;
+	std::vector<float> inverseMOI;
+	std::vector<int> shape;
+	// The shape's inner & bounding radius, kept next to it so loops over every
+	// body don't have to look the shape up
+	std::vector<float> radius;
+	std::vector<float> boundingRadius;
+
+	// Flags & cold data
+	std::vector<uint8_t> sleeping;
+	std::vector<float> sleepTime;
+	std::vector<uint8_t> doGravity;
+	std::vector<uint32_t> forceGroups;
+	std::vector<uint8_t> bullet;
+	std::vector<uint8_t> continuous;
+	std::vector<uint8_t> kinematic;
+	// Collision filtering, see ShouldCollide
+	std::vector<uint32_t> collisionLayer;
+	std::vector<uint32_t> collisionMask;
+	std::vector<int32_t> collisionGroup;
+	std::vector<Color> color;
+
+	// What the shape ids refer to, cleared with the bodies
+	ShapeRegistry shapes;
+
+	// Goes up whenever bodies are added, removed, restored or reordered, or one
+	// changes shape or gets Set, so anything keeping its own copy of per-body data
+	// (like Recorder) can tell when it's out of date
+	uint32_t layoutVersion = 0;
+
+	int Size() const { return (int)rotation.size(); }
+
+	// Static bodies (no inverse mass or MOI) never move, so only count as awake if dynamic
+	bool IsDynamic(int i) const { return inverseMass[i] > 0.0f || inverseMOI[i] > 0.0f; }
+	bool IsActive(int i) const { return !sleeping[i] && IsDynamic(i); }
+	// Awake dynamic bodies, and kinematic ones with somewhere to go: what can push something else
+	bool IsMoving(int i) const
+	{
+		return IsActive(i) || (kinematic[i] && (velocity.x[i] != 0.0f || velocity.y[i] != 0.0f || angularVelocity[i] != 0.0f));
+	}
+
+	/**
+		Whether two bodies' filters let them collide, like Box2D's: bodies sharing a
+		nonzero group always collide if it's positive and never if it's negative.
+		Otherwise each has to be in a layer the other's mask has.
+	*/
+	bool ShouldCollide(int i, int j) const
+	{
+		if (collisionGroup[i] == collisionGroup[j] && collisionGroup[i] != 0)
+			return collisionGroup[i] > 0;
+		return (collisionLayer[i] & collisionMask[j]) && (collisionLayer[j] & collisionMask[i]);
+	}
+
+	BodyHandle Add(const RigidBody2D& body);
+	// Appends count default bodies in one go and returns the dense index of the
+	// first, so loaders can fill the arrays in place instead of body by body
+	int AddBodies(int count);
+	// Changes a body's shape & the radii that go with it. Mass & MOI are left alone
+	void SetShape(int index, int shapeId);
+	void Remove(BodyHandle handle);
+	void Clear();
+	void Reserve(int count);
+
+	bool IsValid(BodyHandle handle) const;
+	int IndexOf(BodyHandle handle) const;
+	BodyHandle HandleAt(int index) const;
+
+	// Gathers/scatters all of a body's fields, for editing & inspecting
+	RigidBody2D Get(BodyHandle handle) const { return GetAt(IndexOf(handle)); }
+	void Set(BodyHandle handle, const RigidBody2D& body) { SetAt(IndexOf(handle), body); }
+	RigidBody2D GetAt(int index) const;
+	void SetAt(int index, const RigidBody2D& body);
+
+	// FNV-1a over the bits of every body's position, rotation & velocities, for
+	// checking two runs ended in exactly the same state
+	uint64_t HashState() const;
+
+	// Every array & the handle tables, for world snapshots. The shapes aren't
+	// saved, restoring needs the same ones already registered. Restore returns
+	// false if the data runs out, the arrays don't line up or a shape is missing
+	void SaveState(SnapshotWriter& writer) const;
+	bool RestoreState(SnapshotReader& reader);
+
+	/**
+		Calls func on every per-body array (each component of a Vector3Array
+		separately), so operations on whole bodies can't miss a field.
+	*/
+	template <typename Func>
+	void ForEachArray(Func func)
+	{
+		func(position.x); func(position.y); func(position.z);
+		func(oldPos.x); func(oldPos.y); func(oldPos.z);
+		func(velocity.x); func(velocity.y); func(velocity.z);
+		func(force.x); func(force.y); func(force.z);
+		func(torque);
+		func(rotation);
+		func(oldRotation);
+		func(angularVelocity);
+		func(inverseMass);
+		func(inverseMOI);
+		func(shape);
+		func(radius);
+		func(boundingRadius);
+		func(sleeping);
+		func(sleepTime);
+		func(doGravity);
+		func(forceGroups);
+		func(bullet);
+		func(continuous);
+		func(kinematic);
+		func(collisionLayer);
+		func(collisionMask);
+		func(collisionGroup);
+		func(color);
+	}
+
+private:
+	// Handle slot -> dense index & generation, and the reverse mapping
+	std::vector<uint32_t> slotIndex;
+	std::vector<uint32_t> slotGeneration;
+	std::vector<uint32_t> freeSlots;
+	std::vector<uint32_t> denseSlot;
+
+};
@@ -0,0 +1,373 @@
+#include "broadphase.h"
+
+#include <algorithm>
+#include <cmath>
+
+const char* BroadphaseTypeName(BroadphaseType type)
+{
+	switch (type)
+	{
+	case BroadphaseType::BruteForce:	return "Brute force";
+	case BroadphaseType::SpatialHash:	return "Spatial hash";
+	case BroadphaseType::SweepAndPrune:	return "Sweep and prune";
+	case BroadphaseType::AabbTree:		return "AABB tree";
+	default:							return "Unknown";
+	}
+}
+
+std::unique_ptr<Broadphase> CreateBroadphase(BroadphaseType type)
+{
+	switch (type)
+	{
+	case BroadphaseType::SpatialHash:	return std::make_unique<SpatialHashBroadphase>();
+	case BroadphaseType::SweepAndPrune:	return std::make_unique<SweepAndPruneBroadphase>();
+	case BroadphaseType::AabbTree:		return std::make_unique<AabbTreeBroadphase>();
+	default:							return std::make_unique<BruteForceBroadphase>();
+	}
+}
+
+bool Broadphase::BoundingSpheresOverlap(const BodyStore& bodies, int i, int j)
+{
+	float dx = bodies.position.x[j] - bodies.position.x[i];
+	float dy = bodies.position.y[j] - bodies.position.y[i];
+	float dz = bodies.position.z[j] - bodies.position.z[i];
+	float radii = bodies.boundingRadius[i] + bodies.boundingRadius[j];
+	return dx * dx + dy * dy + dz * dz < radii * radii;
+}
+
+void Broadphase::UpdateMotion(const BodyStore& bodies, JobSystem& jobs)
+{
+	motion.resize(bodies.Size());
+	jobs.ParallelFor(bodies.Size(), 4096, [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+			motion[i] = (bodies.IsDynamic(i) ? MOTION_DYNAMIC : 0) | (bodies.IsMoving(i) ? MOTION_MOVING : 0);
+	});
+}
+
+
+void BruteForceBroadphase::FindPairs(const BodyStore& bodies, std::vector<BodyPair>& outPairs, JobSystem& jobs)
+{
+	outPairs.clear();
+	UpdateMotion(bodies, jobs);
+
+	int n = bodies.Size();
+	ParallelFindPairs(jobs, n, 64, outPairs, [&](int begin, int end, std::vector<BodyPair>& pairs) {
+		for (int i = begin; i < end; i++)
+		{
+			for (int j = i + 1; j < n; j++)
+			{
+				if (CanCollide(bodies, i, j) && BoundingSpheresOverlap(bodies, i, j))
+					pairs.push_back({ i, j });
+			}
+		}
+	});
+}
+
+
+static uint32_t HashCell(int32_t x, int32_t y)
+{
+	return ((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u);
+}
+
+void SpatialHashBroadphase::FindPairs(const BodyStore& bodies, std::vector<BodyPair>& outPairs, JobSystem& jobs)
+{
+	outPairs.clear();
+	UpdateMotion(bodies, jobs);
+
+	int n = bodies.Size();
+	if (n == 0) return;
+
+	float cell = cellSize;
+	if (cell <= 0.0f)
+	{
+		float totalRadius = 0.0f;
+		for (float r : bodies.boundingRadius) totalRadius += r;
+		cell = std::max(2.0f * totalRadius / n, 1e-3f);
+	}
+	float invCell = 1.0f / cell;
+
+	// Insert bodies into every cell their bounds overlap
+	entries.clear();
+	largeBodies.clear();
+	minCellX.resize(n);
+	minCellY.resize(n);
+	isLarge.assign(n, 0);
+
+	for (int i = 0; i < n; i++)
+	{
+		float x = bodies.position.x[i], y = bodies.position.y[i], r = bodies.boundingRadius[i];
+		int32_t x0 = (int32_t)std::floor((x - r) * invCell);
+		int32_t y0 = (int32_t)std::floor((y - r) * invCell);
+		int32_t x1 = (int32_t)std::floor((x + r) * invCell);
+		int32_t y1 = (int32_t)std::floor((y + r) * invCell);
+		minCellX[i] = x0;
+		minCellY[i] = y0;
+
+		if ((int64_t)(x1 - x0 + 1) * (y1 - y0 + 1) > maxCellsPerBody)
+		{
+			isLarge[i] = 1;
+			largeBodies.push_back(i);
+			continue;
+		}
+
+		for (int32_t cy = y0; cy <= y1; cy++)
+			for (int32_t cx = x0; cx <= x1; cx++)
+				entries.push_back({ cx, cy, i });
+	}
+
+	// Counting sort the entries into hash buckets
+	uint32_t tableSize = 1;
+	while (tableSize < entries.size() * 2) tableSize <<= 1;
+	uint32_t mask = tableSize - 1;
+
+	bucketStart.assign(tableSize + 1, 0);
+	for (const auto& e : entries)
+		bucketStart[(HashCell(e.x, e.y) & mask) + 1]++;
+	for (uint32_t b = 0; b < tableSize; b++)
+		bucketStart[b + 1] += bucketStart[b];
+
+	sortedEntries.resize(entries.size());
+	for (const auto& e : entries)
+		sortedEntries[bucketStart[HashCell(e.x, e.y) & mask]++] = e;
+	// Filling shifted every start to the next bucket's start, shift them back
+	for (uint32_t b = tableSize; b > 0; b--)
+		bucketStart[b] = bucketStart[b - 1];
+	bucketStart[0] = 0;
+
+	// Test bodies sharing a cell, buckets are independent so split them over threads
+	ParallelFindPairs(jobs, (int)tableSize, 1024, outPairs, [&](int firstBucket, int endBucket, std::vector<BodyPair>& pairs) {
+		for (int b = firstBucket; b < endBucket; b++)
+		{
+			uint32_t start = bucketStart[b], end = bucketStart[b + 1];
+			for (uint32_t p = start; p < end; p++)
+			{
+				const CellEntry& e1 = sortedEntries[p];
+				for (uint32_t q = p + 1; q < end; q++)
+				{
+					const CellEntry& e2 = sortedEntries[q];
+
+					// Different cells that landed in the same bucket
+					if (e1.x != e2.x || e1.y != e2.y)
+						continue;
+
+					// Two bodies can share several cells, only report the pair in the
+					// first cell of their overlap so it isn't reported twice
+					if (e1.x != std::max(minCellX[e1.body], minCellX[e2.body]) ||
+						e1.y != std::max(minCellY[e1.body], minCellY[e2.body]))
+						continue;
+
+					if (CanCollide(bodies, e1.body, e2.body) && BoundingSpheresOverlap(bodies, e1.body, e2.body))
+						pairs.push_back({ std::min(e1.body, e2.body), std::max(e1.body, e2.body) });
+				}
+			}
+		}
+	});
+
+	// Large bodies are tested against everything
+	for (int i : largeBodies)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			if (j == i || (isLarge[j] && j < i))
+				continue; // large-large pairs are only tested once
+
+			if (CanCollide(bodies, i, j) && BoundingSpheresOverlap(bodies, i, j))
+				outPairs.push_back({ std::min(i, j), std::max(i, j) });
+		}
+	}
+}
+
+
+void SweepAndPruneBroadphase::FindPairs(const BodyStore& bodies, std::vector<BodyPair>& outPairs, JobSystem& jobs)
+{
+	outPairs.clear();
+	UpdateMotion(bodies, jobs);
+
+	int n = bodies.Size();
+	minX.resize(n);
+	maxX.resize(n);
+	for (int i = 0; i < n; i++)
+	{
+		minX[i] = bodies.position.x[i] - bodies.boundingRadius[i];
+		maxX[i] = bodies.position.x[i] + bodies.boundingRadius[i];
+	}
+
+	// Body count changed, the old order is meaningless so sort from scratch
+	if ((int)order.size() != n)
+	{
+		order.resize(n);
+		for (int i = 0; i < n; i++) order[i] = i;
+		std::sort(order.begin(), order.end(), [&](int a, int b) { return minX[a] < minX[b]; });
+	}
+	else
+	{
+		// Insertion sort, order is almost sorted from last step
+		for (int i = 1; i < n; i++)
+		{
+			int body = order[i];
+			float key = minX[body];
+			int j = i - 1;
+			while (j >= 0 && minX[order[j]] > key)
+			{
+				order[j + 1] = order[j];
+				j--;
+			}
+			order[j + 1] = body;
+		}
+	}
+
+	// Sweep, each body only looks ahead so the sweep splits over threads
+	ParallelFindPairs(jobs, n, 256, outPairs, [&](int begin, int end, std::vector<BodyPair>& pairs) {
+		for (int i = begin; i < end; i++)
+		{
+			int a = order[i];
+			for (int j = i + 1; j < n; j++)
+			{
+				int b = order[j];
+				if (minX[b] > maxX[a])
+					break; // every following body starts further along X
+
+				if (CanCollide(bodies, a, b) && BoundingSpheresOverlap(bodies, a, b))
+					pairs.push_back({ std::min(a, b), std::max(a, b) });
+			}
+		}
+	});
+}
+
+
+static Aabb BodyAabb(const BodyStore& bodies, int i)
+{
+	float x = bodies.position.x[i], y = bodies.position.y[i], r = bodies.boundingRadius[i];
+	return { { x - r, y - r }, { x + r, y + r } };
+}
+
+void AabbTreeBroadphase::MarkChanged(int proxy)
+{
+	if (proxy >= (int)proxyChanged.size())
+		proxyChanged.resize(tree.NodeCapacity(), 0);
+	if (!proxyChanged[proxy])
+		changedProxies.push_back(proxy);
+	proxyChanged[proxy] = 1;
+}
+
+// Creates, moves & destroys proxies to match the bodies, and points every proxy
+// at its body's current dense index
+void AabbTreeBroadphase::SyncProxies(const BodyStore& bodies)
+{
+	int n = bodies.Size();
+	slotSeen.assign(slotProxy.size(), 0);
+	reinsertCount = 0;
+
+	for (int i = 0; i < n; i++)
+	{
+		BodyHandle handle = bodies.HandleAt(i);
+		if (handle.slot >= slotProxy.size())
+		{
+			slotProxy.resize(handle.slot + 1, (int)AabbTree::NULL_NODE);
+			slotGeneration.resize(handle.slot + 1, 0);
+			slotSeen.resize(handle.slot + 1, 0);
+		}
+
+		// A body removed since last step left its slot to this one
+		int& proxy = slotProxy[handle.slot];
+		if (proxy != AabbTree::NULL_NODE && slotGeneration[handle.slot] != handle.generation)
+		{
+			MarkChanged(proxy);
+			tree.DestroyProxy(proxy);
+			proxy = AabbTree::NULL_NODE;
+		}
+
+		Aabb aabb = BodyAabb(bodies, i);
+		if (proxy == AabbTree::NULL_NODE)
+		{
+			proxy = tree.CreateProxy(aabb, i);
+			slotGeneration[handle.slot] = handle.generation;
+			MarkChanged(proxy);
+			movesSinceRebuild++;
+		}
+		else
+		{
+			Vector2 displacement = { bodies.position.x[i] - bodies.oldPos.x[i], bodies.position.y[i] - bodies.oldPos.y[i] };
+			if (tree.MoveProxy(proxy, aabb, displacement))
+			{
+				reinsertCount++;
+				MarkChanged(proxy);
+			}
+			tree.SetUserData(proxy, i);
+		}
+		slotSeen[handle.slot] = 1;
+	}
+
+	// Bodies that are gone for good
+	for (size_t slot = 0; slot < slotProxy.size(); slot++)
+	{
+		if (slotProxy[slot] != AabbTree::NULL_NODE && !slotSeen[slot])
+		{
+			MarkChanged(slotProxy[slot]);
+			tree.DestroyProxy(slotProxy[slot]);
+			slotProxy[slot] = AabbTree::NULL_NODE;
+		}
+	}
+
+	// Lots of bodies added at once (loading a scenario) build a poor tree too
+	movesSinceRebuild += reinsertCount;
+	rebuilt = rebuildAfterMoves > 0.0f && movesSinceRebuild > 0 && movesSinceRebuild >= rebuildAfterMoves * n;
+	if (rebuilt)
+	{
+		tree.Rebuild();
+		movesSinceRebuild = 0;
+	}
+}
+
+// Changes made here are still marked, so the next FindPairs finds their pairs
+const AabbTree* AabbTreeBroadphase::SyncTree(const BodyStore& bodies)
+{
+	SyncProxies(bodies);
+	return &tree;
+}
+
+void AabbTreeBroadphase::FindPairs(const BodyStore& bodies, std::vector<BodyPair>& outPairs, JobSystem& jobs)
+{
+	outPairs.clear();
+	UpdateMotion(bodies, jobs);
+
+	SyncProxies(bodies);
+
+	// Changed proxies that still exist look for their fat pairs again. Two
+	// changed proxies find each other, the lower one keeps the pair
+	proxyChanged.resize(tree.NodeCapacity(), 0);
+	newFatPairs.clear();
+	ParallelFindPairs(jobs, (int)changedProxies.size(), 64, newFatPairs, [&](int begin, int end, std::vector<BodyPair>& pairs) {
+		for (int k = begin; k < end; k++)
+		{
+			int proxy = changedProxies[k];
+			if (!tree.IsProxy(proxy))
+				continue;
+			tree.Query(tree.GetFatAabb(proxy), [&](int other) {
+				if (other != proxy && (!proxyChanged[other] || proxy < other))
+					pairs.push_back({ std::min(proxy, other), std::max(proxy, other) });
+				return true;
+			});
+		}
+	});
+
+	// Every other pair is as it was
+	fatPairs.erase(std::remove_if(fatPairs.begin(), fatPairs.end(),
+		[&](const BodyPair& pair) { return proxyChanged[pair.a] || proxyChanged[pair.b]; }), fatPairs.end());
+	fatPairs.insert(fatPairs.end(), newFatPairs.begin(), newFatPairs.end());
+	fatPairCount = (int)fatPairs.size();
+
+	for (int proxy : changedProxies)
+		proxyChanged[proxy] = 0;
+	changedProxies.clear();
+
+	ParallelFindPairs(jobs, (int)fatPairs.size(), 1024, outPairs, [&](int begin, int end, std::vector<BodyPair>& pairs) {
+		for (int k = begin; k < end; k++)
+		{
+			int i = tree.GetUserData(fatPairs[k].a);
+			int j = tree.GetUserData(fatPairs[k].b);
+			if (CanCollide(bodies, i, j) && BoundingSpheresOverlap(bodies, i, j))
+				pairs.push_back({ std::min(i, j), std::max(i, j) });
+		}
+	});
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "aabb_tree.h"
+#include "body_store.h"
+#include "job_system.h"
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+struct BodyPair {
+	int a;
+	int b;
+};
+
+enum class BroadphaseType {
+	BruteForce = 0,
+	SpatialHash,
+	SweepAndPrune,
+	AabbTree,
+	Count
+};
+
+const char* BroadphaseTypeName(BroadphaseType type);
+
+/**
+	Finds candidate collision pairs before the narrowphase runs. Every broadphase
+	reports exactly the pairs whose bounding spheres overlap (with a < b), they only
+	differ in how many pairs they have to look at to find them.
+
+	Pairs that can't do anything are left out, before their bounding spheres are
+	even looked at: ones where neither body moves (asleep, static, or kinematic &
+	standing still), ones with no dynamic body (static & kinematic bodies only
+	push dynamic ones), and ones whose collision filters don't match (see
+	BodyStore::ShouldCollide). The first two are a test on a byte per body
+	worked out at the start of FindPairs, the filter a few bitwise tests.
+
+	The pair tests are split over the job system's threads, so the order pairs come
+	out in isn't fixed; sort them if it matters.
+*/
+class Broadphase {
+
+public:
+	virtual ~Broadphase() = default;
+	virtual void FindPairs(const BodyStore& bodies, std::vector<BodyPair>& outPairs, JobSystem& jobs) = 0;
+
+	/**
+		For scene queries between steps: brings the broadphase's tree up to date
+		with the bodies and returns it, or nullptr if it doesn't keep one. Proxies'
+		user data is their body's dense index.
+	*/
+	virtual const AabbTree* SyncTree(const BodyStore&) { return nullptr; }
+
+	static bool BoundingSpheresOverlap(const BodyStore& bodies, int i, int j);
+
+protected:
+	// Per body, from the start of FindPairs
+	enum : uint8_t { MOTION_DYNAMIC = 1, MOTION_MOVING = 2 };
+	std::vector<uint8_t> motion;
+
+	void UpdateMotion(const BodyStore& bodies, JobSystem& jobs);
+
+	bool CanCollide(const BodyStore& bodies, int i, int j) const
+	{
+		uint8_t either = motion[i] | motion[j];
+		return (either & MOTION_DYNAMIC) && (either & MOTION_MOVING) && bodies.ShouldCollide(i, j);
+	}
+
+	std::vector<std::vector<BodyPair>> threadPairs;
+
+	/**
+		Calls findPairs(begin, end, pairs) over [0, count) on the job system, every
+		thread appending to its own list, then appends all the lists to outPairs.
+	*/
+	template <typename Func>
+	void ParallelFindPairs(JobSystem& jobs, int count, int minBatch, std::vector<BodyPair>& outPairs, Func findPairs)
+	{
+		threadPairs.resize(jobs.ThreadCount());
+		for (auto& pairs : threadPairs)
+			pairs.clear();
+
+		jobs.ParallelFor(count, minBatch, [&](int begin, int end, int thread) {
+			findPairs(begin, end, threadPairs[thread]);
+		});
+
+		for (const auto& pairs : threadPairs)
+			outPairs.insert(outPairs.end(), pairs.begin(), pairs.end());
+	}
+
+};
+
+/**
+	Tests every body against every other body, O(n^2).
+*/
+class BruteForceBroadphase : public Broadphase {
+
+public:
+	void FindPairs(const BodyStore& bodies, std::vector<BodyPair>& outPairs, JobSystem& jobs) override;
+
+};
+
+/**
+	Uniform grid over the XY plane. Bodies are inserted into every cell their bounds
+	touch, cells are hashed into a table that is rebuilt every step with a counting
+	sort (no per-cell allocations), and only bodies sharing a cell are tested.
+	Bodies that would cover too many cells are kept in a separate list and tested
+	against everything, so one huge body doesn't flood the grid.
+*/
+class SpatialHashBroadphase : public Broadphase {
+
+public:
+	// Side length of a grid cell, <= 0 picks twice the average bounding radius
+	float cellSize = 0.0f;
+	int maxCellsPerBody = 16;
+
+	void FindPairs(const BodyStore& bodies, std::vector<BodyPair>& outPairs, JobSystem& jobs) override;
+
+private:
+	struct CellEntry {
+		int32_t x, y;
+		int body;
+	};
+
+	std::vector<CellEntry> entries;
+	std::vector<CellEntry> sortedEntries;
+	std::vector<uint32_t> bucketStart;
+	std::vector<int32_t> minCellX, minCellY;
+	std::vector<int> largeBodies;
+	std::vector<uint8_t> isLarge;
+
+};
+
+/**
+	Sweep and prune along the X axis. The sorted order is kept between steps and
+	repaired with an insertion sort, which is close to O(n) since bodies barely
+	move between frames.
+*/
+class SweepAndPruneBroadphase : public Broadphase {
+
+public:
+	void FindPairs(const BodyStore& bodies, std::vector<BodyPair>& outPairs, JobSystem& jobs) override;
+
+private:
+	std::vector<int> order;
+	std::vector<float> minX, maxX;
+
+};
+
+/**
+	Keeps a dynamic AABB tree of the bodies between steps, and the list of pairs
+	whose fat boxes overlap. Each step only bodies that left their fat box get
+	reinserted, and only they query the tree for new fat pairs; every other pair
+	carries over. The fat pairs are then narrowed down to the bounding sphere
+	pairs. Bodies of very different sizes don't bother it the way they do a grid,
+	and the tree can answer other queries too.
+
+	Bodies are tracked by handle, so proxies follow them through removals. The
+	tree is rebuilt from scratch once as many proxies have been created or
+	reinserted as there are bodies, since that many leave it noticeably worse
+	than a top-down build.
+*/
+class AabbTreeBroadphase : public Broadphase {
+
+public:
+	// Creates & reinserts (as a fraction of the body count) before a full rebuild, <= 0 never rebuilds
+	float rebuildAfterMoves = 1.0f;
+
+	void FindPairs(const BodyStore& bodies, std::vector<BodyPair>& outPairs, JobSystem& jobs) override;
+	const AabbTree* SyncTree(const BodyStore& bodies) override;
+
+	// Proxies' user data is their body's dense index as of the last FindPairs or SyncTree
+	const AabbTree& Tree() const { return tree; }
+
+	// From the last FindPairs or SyncTree
+	int reinsertCount = 0;
+	int fatPairCount = 0;
+	bool rebuilt = false;
+
+private:
+	AabbTree tree;
+	int movesSinceRebuild = 0;
+
+	// By handle slot: the body's proxy, and the generation it belongs to
+	std::vector<int> slotProxy;
+	std::vector<uint32_t> slotGeneration;
+	std::vector<uint8_t> slotSeen;
+
+	// Proxy pairs (a < b) whose fat boxes overlap, and the proxies created, moved
+	// or destroyed this step, whose pairs have to be found again
+	std::vector<BodyPair> fatPairs;
+	std::vector<BodyPair> newFatPairs;
+	std::vector<uint8_t> proxyChanged;
+	std::vector<int> changedProxies;
+
+	void SyncProxies(const BodyStore& bodies);
+	void MarkChanged(int proxy);
+
+};
+
+std::unique_ptr<Broadphase> CreateBroadphase(BroadphaseType type);
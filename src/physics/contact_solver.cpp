@@ -0,0 +1,343 @@
+#include "contact_solver.h"
+#include "physics_world.h"
+
+#include <algorithm>
+
+void ContactSolver::Reset()
+{
+	constraints.clear();
+	cache.clear();
+	nextCache.clear();
+}
+
+void ContactSolver::Begin()
+{
+	constraints.clear();
+	islandStart.assign(1, 0);
+}
+
+void ContactSolver::AddManifold(const BodyStore& bodies, int bodyA, int bodyB, const ContactManifold& manifold)
+{
+	ContactConstraint c;
+	c.bodyA = bodyA;
+	c.bodyB = bodyB;
+	c.invMassA = bodies.inverseMass[bodyA];
+	c.invMassB = bodies.inverseMass[bodyB];
+	c.invMOIA = bodies.inverseMOI[bodyA];
+	c.invMOIB = bodies.inverseMOI[bodyB];
+
+	// Two immovable bodies, nothing to solve
+	if (c.invMassA + c.invMassB + c.invMOIA + c.invMOIB == 0.0f)
+		return;
+
+	BodyHandle handleA = bodies.HandleAt(bodyA), handleB = bodies.HandleAt(bodyB);
+	c.key = ((uint64_t)handleA.slot << 32) | handleB.slot;
+	c.generations = ((uint64_t)handleA.generation << 32) | handleB.generation;
+	c.normalX = manifold.normal.x;
+	c.normalY = manifold.normal.y;
+	c.pointCount = manifold.pointCount;
+
+	float ax = bodies.position.x[bodyA], ay = bodies.position.y[bodyA];
+	float bx = bodies.position.x[bodyB], by = bodies.position.y[bodyB];
+	for (int k = 0; k < manifold.pointCount; k++)
+	{
+		const ContactPoint& mp = manifold.points[k];
+		ContactConstraintPoint& p = c.points[k];
+		p.rAx = mp.position.x - ax;
+		p.rAy = mp.position.y - ay;
+		p.rBx = mp.position.x - bx;
+		p.rBy = mp.position.y - by;
+		p.depth = mp.depth;
+		p.normalImpulse = 0.0f;
+		p.tangentImpulse = 0.0f;
+		p.id = mp.id;
+	}
+
+	constraints.push_back(c);
+}
+
+void ContactSolver::GroupByIsland(IslandFinder& islands, int bodyCount)
+{
+	// Number islands in order of their first constraint, so the grouping only
+	// depends on the constraint order
+	rootIsland.assign(bodyCount, -1);
+	constraintIsland.resize(constraints.size());
+	islandStart.assign(1, 0);
+	for (size_t i = 0; i < constraints.size(); i++)
+	{
+		// At least one body is dynamic, static bodies are each in an island of their own
+		const ContactConstraint& c = constraints[i];
+		bool dynamicA = c.invMassA > 0.0f || c.invMOIA > 0.0f;
+		int root = islands.Find(dynamicA ? c.bodyA : c.bodyB);
+
+		if (rootIsland[root] < 0)
+		{
+			rootIsland[root] = (int)islandStart.size() - 1;
+			islandStart.push_back(0);
+		}
+		constraintIsland[i] = rootIsland[root];
+		islandStart[rootIsland[root] + 1]++;
+	}
+
+	// Counting sort, keeping constraint order within each island
+	for (size_t island = 1; island < islandStart.size(); island++)
+		islandStart[island] += islandStart[island - 1];
+
+	islandOrder.resize(constraints.size());
+	for (size_t i = 0; i < constraints.size(); i++)
+		islandOrder[islandStart[constraintIsland[i]]++] = (int)i;
+
+	// Filling shifted every start to the next island's start, shift them back
+	for (size_t island = islandStart.size() - 1; island > 0; island--)
+		islandStart[island] = islandStart[island - 1];
+	islandStart[0] = 0;
+}
+
+template <typename Func>
+void ContactSolver::ForEachIsland(JobSystem& jobs, Func func)
+{
+	jobs.ParallelFor(IslandCount(), 16, [&](int begin, int end, int) {
+		for (int island = begin; island < end; island++)
+		{
+			for (int i = islandStart[island]; i < islandStart[island + 1]; i++)
+				func(constraints[islandOrder[i]]);
+		}
+	});
+}
+
+void ContactSolver::Prepare(const BodyStore& bodies, float dt, IslandFinder& islands, JobSystem& jobs)
+{
+	GroupByIsland(islands, bodies.Size());
+
+	jobs.ParallelFor((int)constraints.size(), 256, [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+			PrepareConstraint(bodies, dt, constraints[i]);
+	});
+}
+
+void ContactSolver::PrepareConstraint(const BodyStore& bodies, float dt, ContactConstraint& c)
+{
+	int a = c.bodyA, b = c.bodyB;
+	float vAx = bodies.velocity.x[a], vAy = bodies.velocity.y[a], wA = bodies.angularVelocity[a];
+	float vBx = bodies.velocity.x[b], vBy = bodies.velocity.y[b], wB = bodies.angularVelocity[b];
+
+	// Impulses this pair ended last step with
+	const CachedManifold* cached = nullptr;
+	auto it = std::lower_bound(cache.begin(), cache.end(), c.key,
+		[](const CachedManifold& m, uint64_t key) { return m.key < key; });
+	if (it != cache.end() && it->key == c.key && it->generations == c.generations)
+		cached = &*it;
+
+	for (int k = 0; k < c.pointCount; k++)
+	{
+		ContactConstraintPoint& p = c.points[k];
+
+		// Effective mass along the normal
+		float rnA = p.rAx * c.normalY - p.rAy * c.normalX;
+		float rnB = p.rBx * c.normalY - p.rBy * c.normalX;
+		float effectiveMass = c.invMassA + c.invMassB + c.invMOIA * rnA * rnA + c.invMOIB * rnB * rnB;
+		p.normalMass = effectiveMass > 0.0f ? 1.0f / effectiveMass : 0.0f;
+
+		// ... and along the tangent (-ny, nx)
+		float rtA = p.rAx * c.normalX + p.rAy * c.normalY;
+		float rtB = p.rBx * c.normalX + p.rBy * c.normalY;
+		effectiveMass = c.invMassA + c.invMassB + c.invMOIA * rtA * rtA + c.invMOIB * rtB * rtB;
+		p.tangentMass = effectiveMass > 0.0f ? 1.0f / effectiveMass : 0.0f;
+
+		// Relative velocity at the contact (lever arm formula)
+		float dvx = vBx - wB * p.rBy - vAx + wA * p.rAy;
+		float dvy = vBy + wB * p.rBx - vAy - wA * p.rAx;
+		float vn = dvx * c.normalX + dvy * c.normalY;
+
+		// Bounce back fast impacts, and push apart anything penetrating too deep.
+		// Speculative contacts let the bodies close the gap this step, but no more
+		if (p.depth < 0.0f)
+			p.velocityBias = p.depth / dt;
+		else
+		{
+			p.velocityBias = 0.0f;
+			if (vn < -restitutionThreshold)
+				p.velocityBias = -restitution * vn;
+			p.velocityBias = std::max(p.velocityBias, baumgarte / dt * std::max(p.depth - linearSlop, 0.0f));
+		}
+
+		if (cached)
+		{
+			for (int j = 0; j < cached->pointCount; j++)
+			{
+				if (cached->ids[j] == p.id)
+				{
+					p.normalImpulse = cached->normalImpulses[j];
+					p.tangentImpulse = cached->tangentImpulses[j];
+				}
+			}
+		}
+	}
+}
+
+void ContactSolver::WarmStart(BodyStore& bodies, JobSystem& jobs)
+{
+	if (!warmStarting)
+	{
+		for (ContactConstraint& c : constraints)
+		{
+			for (int k = 0; k < c.pointCount; k++)
+			{
+				c.points[k].normalImpulse = 0.0f;
+				c.points[k].tangentImpulse = 0.0f;
+			}
+		}
+		return;
+	}
+
+	ForEachIsland(jobs, [&](ContactConstraint& c) { WarmStartConstraint(bodies, c); });
+}
+
+void ContactSolver::WarmStartConstraint(BodyStore& bodies, ContactConstraint& c)
+{
+	int a = c.bodyA, b = c.bodyB;
+	float vAx = bodies.velocity.x[a], vAy = bodies.velocity.y[a], wA = bodies.angularVelocity[a];
+	float vBx = bodies.velocity.x[b], vBy = bodies.velocity.y[b], wB = bodies.angularVelocity[b];
+
+	for (int k = 0; k < c.pointCount; k++)
+	{
+		const ContactConstraintPoint& p = c.points[k];
+		float px = p.normalImpulse * c.normalX - p.tangentImpulse * c.normalY;
+		float py = p.normalImpulse * c.normalY + p.tangentImpulse * c.normalX;
+		vAx -= px * c.invMassA;
+		vAy -= py * c.invMassA;
+		wA -= c.invMOIA * (p.rAx * py - p.rAy * px);
+		vBx += px * c.invMassB;
+		vBy += py * c.invMassB;
+		wB += c.invMOIB * (p.rBx * py - p.rBy * px);
+	}
+
+	StoreVelocities(bodies, c, vAx, vAy, wA, vBx, vBy, wB);
+}
+
+void ContactSolver::SolveConstraint(BodyStore& bodies, ContactConstraint& c)
+{
+	int a = c.bodyA, b = c.bodyB;
+	float vAx = bodies.velocity.x[a], vAy = bodies.velocity.y[a], wA = bodies.angularVelocity[a];
+	float vBx = bodies.velocity.x[b], vBy = bodies.velocity.y[b], wB = bodies.angularVelocity[b];
+
+	float tx = -c.normalY, ty = c.normalX;
+
+	// Friction first, its bound uses the normal impulses of the last iteration
+	for (int k = 0; k < c.pointCount; k++)
+	{
+		ContactConstraintPoint& p = c.points[k];
+
+		float dvx = vBx - wB * p.rBy - vAx + wA * p.rAy;
+		float dvy = vBy + wB * p.rBx - vAy - wA * p.rAx;
+		float vt = dvx * tx + dvy * ty;
+
+		float maxFriction = friction * p.normalImpulse;
+		float lambda = -p.tangentMass * vt;
+		float newImpulse = std::max(-maxFriction, std::min(p.tangentImpulse + lambda, maxFriction));
+		lambda = newImpulse - p.tangentImpulse;
+		p.tangentImpulse = newImpulse;
+
+		float px = lambda * tx;
+		float py = lambda * ty;
+		vAx -= px * c.invMassA;
+		vAy -= py * c.invMassA;
+		wA -= c.invMOIA * (p.rAx * py - p.rAy * px);
+		vBx += px * c.invMassB;
+		vBy += py * c.invMassB;
+		wB += c.invMOIB * (p.rBx * py - p.rBy * px);
+	}
+
+	for (int k = 0; k < c.pointCount; k++)
+	{
+		ContactConstraintPoint& p = c.points[k];
+
+		float dvx = vBx - wB * p.rBy - vAx + wA * p.rAy;
+		float dvy = vBy + wB * p.rBx - vAy - wA * p.rAx;
+		float vn = dvx * c.normalX + dvy * c.normalY;
+
+		// Clamp the accumulated impulse, not this iteration's, so earlier
+		// iterations can be undone but the contact never pulls
+		float lambda = -p.normalMass * (vn - p.velocityBias);
+		float newImpulse = std::max(p.normalImpulse + lambda, 0.0f);
+		lambda = newImpulse - p.normalImpulse;
+		p.normalImpulse = newImpulse;
+
+		float px = lambda * c.normalX;
+		float py = lambda * c.normalY;
+		vAx -= px * c.invMassA;
+		vAy -= py * c.invMassA;
+		wA -= c.invMOIA * (p.rAx * py - p.rAy * px);
+		vBx += px * c.invMassB;
+		vBy += py * c.invMassB;
+		wB += c.invMOIB * (p.rBx * py - p.rBy * px);
+	}
+
+	StoreVelocities(bodies, c, vAx, vAy, wA, vBx, vBy, wB);
+}
+
+void ContactSolver::StoreVelocities(BodyStore& bodies, const ContactConstraint& c,
+	float vAx, float vAy, float wA, float vBx, float vBy, float wB)
+{
+	// Static bodies can be in several constraints being solved at once, leave them be
+	if (c.invMassA > 0.0f || c.invMOIA > 0.0f)
+	{
+		bodies.velocity.x[c.bodyA] = vAx; bodies.velocity.y[c.bodyA] = vAy; bodies.angularVelocity[c.bodyA] = wA;
+	}
+	if (c.invMassB > 0.0f || c.invMOIB > 0.0f)
+	{
+		bodies.velocity.x[c.bodyB] = vBx; bodies.velocity.y[c.bodyB] = vBy; bodies.angularVelocity[c.bodyB] = wB;
+	}
+}
+
+void ContactSolver::SolveVelocities(BodyStore& bodies, JobSystem& jobs)
+{
+	// Every iteration of an island before moving on to the next, islands don't
+	// affect each other so it's the same as iterating over all constraints
+	jobs.ParallelFor(IslandCount(), 16, [&](int begin, int end, int) {
+		for (int island = begin; island < end; island++)
+		{
+			for (int it = 0; it < velocityIterations; it++)
+			{
+				for (int i = islandStart[island]; i < islandStart[island + 1]; i++)
+					SolveConstraint(bodies, constraints[islandOrder[i]]);
+			}
+		}
+	});
+}
+
+void ContactSolver::SolveIteration(BodyStore& bodies, JobSystem& jobs)
+{
+	ForEachIsland(jobs, [&](ContactConstraint& c) { SolveConstraint(bodies, c); });
+}
+
+void ContactSolver::StoreImpulses()
+{
+	nextCache.clear();
+	for (const ContactConstraint& c : constraints)
+	{
+		CachedManifold m;
+		m.key = c.key;
+		m.generations = c.generations;
+		m.pointCount = c.pointCount;
+		for (int k = 0; k < c.pointCount; k++)
+		{
+			m.ids[k] = c.points[k].id;
+			m.normalImpulses[k] = c.points[k].normalImpulse;
+			m.tangentImpulses[k] = c.points[k].tangentImpulse;
+		}
+		nextCache.push_back(m);
+	}
+
+	std::sort(nextCache.begin(), nextCache.end(),
+		[](const CachedManifold& m1, const CachedManifold& m2) { return m1.key < m2.key; });
+	std::swap(cache, nextCache);
+}
+
+int ContactSolver::ContactPointCount() const
+{
+	int count = 0;
+	for (const ContactConstraint& c : constraints)
+		count += c.pointCount;
+	return count;
+}
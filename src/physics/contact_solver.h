@@ -0,0 +1,125 @@
+#pragma once
+
+#include "body_store.h"
+#include "islands.h"
+#include "job_system.h"
+#include "snapshot.h"
+#include <vector>
+#include <cstdint>
+
+struct ContactManifold;
+
+struct ContactConstraintPoint {
+	float rAx, rAy;			// contact point relative to body A's center
+	float rBx, rBy;			// ... and to body B's center
+	float depth;
+	float normalMass;		// 1 / effective mass along the normal
+	float tangentMass;		// ... and along the contact surface
+	float velocityBias;		// target separating velocity (restitution & penetration recovery)
+	float normalImpulse;	// accumulated over iterations, and over steps through the cache
+	float tangentImpulse;
+	uint32_t id;
+};
+
+struct ContactConstraint {
+	int bodyA, bodyB;
+	uint64_t key;			// body pair, from the bodies' handle slots
+	uint64_t generations;	// ... & their generations, so a reused slot doesn't get the old body's impulses
+	float normalX, normalY;	// from A to B
+	float invMassA, invMassB;
+	float invMOIA, invMOIB;
+	int pointCount;
+	ContactConstraintPoint points[2];
+};
+
+/**
+	Sequential impulse solver for contacts. Every step, manifolds are turned into
+	constraints, warm started with the impulses the same contact points ended the
+	last step with, and then relaxed a fixed number of times, clamping the
+	accumulated impulse of each point so contacts can only push. Coulomb friction
+	is solved the same way, its impulse bounded by friction * normal impulse.
+
+	Penetration is recovered by biasing the target velocity (Baumgarte
+	stabilization) rather than moving bodies, so positions only ever change in
+	IntegratePositions.
+
+	To solve on several threads, constraints are grouped by island: islands share
+	no dynamic bodies, so each one is solved start to finish on one thread, in the
+	same order a single thread would go through its constraints. The results are
+	the same for any number of threads.
+*/
+class ContactSolver {
+
+public:
+	int velocityIterations = 4;
+	bool warmStarting = true;
+	float restitution = 0.2f;
+	float friction = 0.5f;
+	float baumgarte = 0.2f;					// fraction of the penetration fixed per step
+	float linearSlop = 0.005f;				// penetration allowed without correction
+	float restitutionThreshold = 1.0f;		// slower impacts don't bounce
+
+	std::vector<ContactConstraint> constraints;
+
+	// Removes all contacts, including the ones remembered for warm starting
+	void Reset();
+
+	void Begin();
+	void AddManifold(const BodyStore& bodies, int bodyA, int bodyB, const ContactManifold& manifold);
+
+	/**
+		Computes effective masses & biases for this step's constraints, fetches the
+		impulses to warm start them with from the cache, and groups them by island.
+
+		\param islands Islands built from this step's constraints.
+	*/
+	void Prepare(const BodyStore& bodies, float dt, IslandFinder& islands, JobSystem& jobs);
+	void WarmStart(BodyStore& bodies, JobSystem& jobs);
+	void SolveVelocities(BodyStore& bodies, JobSystem& jobs);
+	// A single one of SolveVelocities' iterations, for taking turns with joints
+	void SolveIteration(BodyStore& bodies, JobSystem& jobs);
+
+	// Remembers the final impulses for the next step, forgetting contacts that ended
+	void StoreImpulses();
+
+	// The impulses remembered for warm starting, for world snapshots
+	void SaveCache(SnapshotWriter& writer) const { writer.Array(cache); }
+	bool RestoreCache(SnapshotReader& reader) { return reader.Array(cache); }
+
+	int ContactPointCount() const;
+	int IslandCount() const { return (int)islandStart.size() - 1; }
+
+private:
+	struct CachedManifold {
+		uint64_t key;
+		uint64_t generations;
+		int pointCount;
+		uint32_t ids[2];
+		float normalImpulses[2];
+		float tangentImpulses[2];
+	};
+
+	// Sorted by key so lookups are a binary search and refreshing it doesn't allocate
+	std::vector<CachedManifold> cache;
+	std::vector<CachedManifold> nextCache;
+
+	// Constraint indices grouped by island, island i being
+	// islandOrder[islandStart[i]] up to islandStart[i + 1]
+	std::vector<int> islandOrder;
+	std::vector<int> islandStart;
+	std::vector<int> rootIsland;		// island root body -> island index
+	std::vector<int> constraintIsland;
+
+	void GroupByIsland(IslandFinder& islands, int bodyCount);
+
+	// Calls func(constraint) for every constraint, island by island on the job system
+	template <typename Func>
+	void ForEachIsland(JobSystem& jobs, Func func);
+
+	void PrepareConstraint(const BodyStore& bodies, float dt, ContactConstraint& c);
+	void WarmStartConstraint(BodyStore& bodies, ContactConstraint& c);
+	void SolveConstraint(BodyStore& bodies, ContactConstraint& c);
+	void StoreVelocities(BodyStore& bodies, const ContactConstraint& c,
+		float vAx, float vAy, float wA, float vBx, float vBy, float wB);
+
+};
@@ -0,0 +1,81 @@
+#include "debug_draw.h"
+
+#ifdef ENABLE_DEBUG_DRAW
+
+#include <algorithm>
+#include <cmath>
+
+void DebugDraw::Step(float dt)
+{
+	step++;
+	stepDt = dt;
+}
+
+void DebugDraw::Clear()
+{
+	// Only the first markersAdded/arrowsAdded slots are ever looked at
+	markersAdded = 0;
+	arrowsAdded = 0;
+}
+
+uint32_t DebugDraw::ExpiryStep(float lifetime) const
+{
+	// Shown for at least the step it was added on
+	return step + (uint32_t)std::max(1.0f, ceilf(lifetime / stepDt));
+}
+
+void DebugDraw::AddMarker(Vector3 position, Color color, float lifetime)
+{
+	markers[markersAdded++ % CAPACITY] = { position, color, ExpiryStep(lifetime) };
+}
+
+void DebugDraw::AddArrow(Vector3 position, Vector3 direction, Color color, float lifetime)
+{
+	arrows[arrowsAdded++ % CAPACITY] = { position, direction, color, ExpiryStep(lifetime) };
+}
+
+int DebugDraw::Draw(InstancedRenderer* renderer) const
+{
+	const float markerRadius = 0.05f;
+	int draws = 0;
+
+	int markerCount = (int)std::min<uint32_t>(markersAdded, CAPACITY);
+	for (int i = 0; i < markerCount; i++)
+	{
+		const Marker& marker = markers[i];
+		if (marker.expiresAt <= step)
+			continue;
+
+		if (renderer)
+			renderer->Add(InstancedRenderer::Mesh::Sphere, { marker.position.x, marker.position.y, marker.position.z, 0.0f, markerRadius, marker.color });
+		else
+		{
+			DrawSphere(marker.position, markerRadius, marker.color);
+			draws++;
+		}
+	}
+
+	int arrowCount = (int)std::min<uint32_t>(arrowsAdded, CAPACITY);
+	for (int i = 0; i < arrowCount; i++)
+	{
+		const Arrow& arrow = arrows[i];
+		if (arrow.expiresAt <= step)
+			continue;
+
+		Vector3 end = Vector3Add(arrow.position, arrow.direction);
+		DrawLine3D(arrow.position, end, arrow.color);
+		draws++;
+
+		if (renderer)
+			renderer->Add(InstancedRenderer::Mesh::Sphere, { end.x, end.y, end.z, 0.0f, markerRadius, arrow.color });
+		else
+		{
+			DrawSphere(end, markerRadius, arrow.color);
+			draws++;
+		}
+	}
+
+	return draws;
+}
+
+#endif
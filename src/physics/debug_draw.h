@@ -0,0 +1,73 @@
+#pragma once
+
+#include "raylib-cpp.hpp"
+#include "instanced_renderer.h"
+#include <cstdint>
+#include <vector>
+
+/**
+	Markers & arrows showing what the physics is doing, e.g. where contacts are.
+
+	They're kept in fixed-size rings: adding one writes over the oldest, and each
+	one remembers the step it expires on, so nothing is ever aged, removed or
+	moved. Expired ones are skipped when drawing.
+
+	Without ENABLE_DEBUG_DRAW (release builds) every function is empty and the
+	rings don't exist, so the calls compile away.
+*/
+class DebugDraw {
+
+public:
+	static constexpr int CAPACITY = 4096;	// of each, markers & arrows
+
+#ifdef ENABLE_DEBUG_DRAW
+	DebugDraw() : markers(CAPACITY), arrows(CAPACITY) {}
+
+	// Starts the next physics step, lifetimes are counted in steps of dt
+	void Step(float dt);
+	void Clear();
+
+	void AddMarker(Vector3 position, Color color, float lifetime = 1.0f);
+	void AddArrow(Vector3 position, Vector3 direction, Color color, float lifetime = 1.0f);
+
+	/**
+		Queues the markers (and arrow tips) into renderer, or draws them right away
+		if there's no renderer. Arrow lines go through raylib's line batch.
+		Returns the number of draws made outside the renderer.
+	*/
+	int Draw(InstancedRenderer* renderer) const;
+#else
+	void Step(float) {}
+	void Clear() {}
+	void AddMarker(Vector3, Color, float = 1.0f) {}
+	void AddArrow(Vector3, Vector3, Color, float = 1.0f) {}
+	int Draw(InstancedRenderer*) const { return 0; }
+#endif
+
+private:
+#ifdef ENABLE_DEBUG_DRAW
+	struct Marker {
+		Vector3 position;
+		Color color;
+		uint32_t expiresAt;		// first step it isn't drawn on
+	};
+
+	struct Arrow {
+		Vector3 position;
+		Vector3 direction;
+		Color color;
+		uint32_t expiresAt;
+	};
+
+	std::vector<Marker> markers;
+	std::vector<Arrow> arrows;
+	uint32_t markersAdded = 0;		// the next one goes in markers[markersAdded % CAPACITY]
+	uint32_t arrowsAdded = 0;
+
+	uint32_t step = 0;
+	float stepDt = 1.0f / 60.0f;
+
+	uint32_t ExpiryStep(float lifetime) const;
+#endif
+
+};
@@ -0,0 +1,399 @@
+#include "force_accumulator.h"
+#include "body_math.h"
+#include "simd.h"
+
+#include <atomic>
+#include <cmath>
+
+const char* ForceTypeName(ForceType type)
+{
+	switch (type)
+	{
+	case ForceType::Gravity:	return "Gravity";
+	case ForceType::Drag:		return "Drag";
+	case ForceType::Wind:		return "Wind";
+	case ForceType::Attractor:	return "Attractor";
+	case ForceType::Spring:		return "Spring";
+	default:					return "Unknown";
+	}
+}
+
+namespace {
+
+// Bodies per batch, small enough that a batch's arrays stay in cache through every generator
+const int FORCE_BATCH = 4096;
+
+/*
+	Attractor kernels add the pull of one attractor to bodies [begin, end):
+		d = center - position
+		accel += inGroup && dynamic && |d|^2 <= radius^2 ? d * strength / (|d|^2 + softening^2)^1.5 : 0
+	Masked out lanes keep their old value rather than adding zero, so the sign of a
+	zero comes out the same as the scalar path's.
+*/
+struct AttractorArgs {
+	const float* x;
+	const float* y;
+	const float* inverseMass;
+	const uint32_t* groups;
+	float* accelX;
+	float* accelY;
+};
+
+typedef void (*AttractorKernel)(const ForceGenerator& g, float reach2, const AttractorArgs& args, int begin, int end);
+
+void AttractScalar(const ForceGenerator& g, float reach2, const AttractorArgs& args, int begin, int end)
+{
+	float soft2 = g.softening * g.softening;
+	for (int i = begin; i < end; i++)
+	{
+		float dx = g.x - args.x[i];
+		float dy = g.y - args.y[i];
+		float d2 = dx * dx + dy * dy;
+		if (!(args.groups[i] & g.mask) || !(args.inverseMass[i] > 0.0f) || !(d2 <= reach2))
+			continue;
+
+		float s2 = d2 + soft2;
+		float pull = g.strength / (s2 * sqrtf(s2));
+		args.accelX[i] += dx * pull;
+		args.accelY[i] += dy * pull;
+	}
+}
+
+#ifdef SIMD_X86
+// No FMA in either, like the integrator's kernels
+void AttractSSE2(const ForceGenerator& g, float reach2, const AttractorArgs& args, int begin, int end)
+{
+	const __m128 cx = _mm_set1_ps(g.x), cy = _mm_set1_ps(g.y);
+	const __m128 strength = _mm_set1_ps(g.strength);
+	const __m128 soft2 = _mm_set1_ps(g.softening * g.softening);
+	const __m128 reach = _mm_set1_ps(reach2);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128i mask = _mm_set1_epi32((int)g.mask);
+	const __m128i zeroi = _mm_setzero_si128();
+
+	int i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 dx = _mm_sub_ps(cx, _mm_loadu_ps(args.x + i));
+		__m128 dy = _mm_sub_ps(cy, _mm_loadu_ps(args.y + i));
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		__m128 s2 = _mm_add_ps(d2, soft2);
+		__m128 pull = _mm_div_ps(strength, _mm_mul_ps(s2, _mm_sqrt_ps(s2)));
+
+		__m128i outside = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*)(args.groups + i)), mask), zeroi);
+		__m128 on = _mm_and_ps(_mm_cmpgt_ps(_mm_loadu_ps(args.inverseMass + i), zero), _mm_cmple_ps(d2, reach));
+		on = _mm_andnot_ps(_mm_castsi128_ps(outside), on);
+
+		__m128 ax = _mm_loadu_ps(args.accelX + i), ay = _mm_loadu_ps(args.accelY + i);
+		__m128 newX = _mm_add_ps(ax, _mm_mul_ps(dx, pull));
+		__m128 newY = _mm_add_ps(ay, _mm_mul_ps(dy, pull));
+		_mm_storeu_ps(args.accelX + i, _mm_or_ps(_mm_and_ps(on, newX), _mm_andnot_ps(on, ax)));
+		_mm_storeu_ps(args.accelY + i, _mm_or_ps(_mm_and_ps(on, newY), _mm_andnot_ps(on, ay)));
+	}
+
+	AttractScalar(g, reach2, args, i, end);
+}
+
+TARGET_AVX2 void AttractAVX2(const ForceGenerator& g, float reach2, const AttractorArgs& args, int begin, int end)
+{
+	const __m256 cx = _mm256_set1_ps(g.x), cy = _mm256_set1_ps(g.y);
+	const __m256 strength = _mm256_set1_ps(g.strength);
+	const __m256 soft2 = _mm256_set1_ps(g.softening * g.softening);
+	const __m256 reach = _mm256_set1_ps(reach2);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256i mask = _mm256_set1_epi32((int)g.mask);
+	const __m256i zeroi = _mm256_setzero_si256();
+
+	int i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 dx = _mm256_sub_ps(cx, _mm256_loadu_ps(args.x + i));
+		__m256 dy = _mm256_sub_ps(cy, _mm256_loadu_ps(args.y + i));
+		__m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		__m256 s2 = _mm256_add_ps(d2, soft2);
+		__m256 pull = _mm256_div_ps(strength, _mm256_mul_ps(s2, _mm256_sqrt_ps(s2)));
+
+		__m256i outside = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(args.groups + i)), mask), zeroi);
+		__m256 on = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(args.inverseMass + i), zero, _CMP_GT_OQ),
+			_mm256_cmp_ps(d2, reach, _CMP_LE_OQ));
+		on = _mm256_andnot_ps(_mm256_castsi256_ps(outside), on);
+
+		__m256 ax = _mm256_loadu_ps(args.accelX + i), ay = _mm256_loadu_ps(args.accelY + i);
+		_mm256_storeu_ps(args.accelX + i, _mm256_blendv_ps(ax, _mm256_add_ps(ax, _mm256_mul_ps(dx, pull)), on));
+		_mm256_storeu_ps(args.accelY + i, _mm256_blendv_ps(ay, _mm256_add_ps(ay, _mm256_mul_ps(dy, pull)), on));
+	}
+
+	AttractScalar(g, reach2, args, i, end);
+}
+#endif
+
+AttractorKernel GetAttractorKernel(SimdLevel level)
+{
+#ifdef SIMD_X86
+	switch (ClampSimdLevel(level))
+	{
+	case SimdLevel::AVX2:	return AttractAVX2;
+	case SimdLevel::SSE2:	return AttractSSE2;
+	default:				break;
+	}
+#endif
+	return AttractScalar;
+}
+
+}
+
+int ForceAccumulator::Add(const ForceGenerator& generator)
+{
+	generators.push_back(generator);
+	return Count() - 1;
+}
+
+int ForceAccumulator::AddGravity(uint32_t mask, Vector2 acceleration)
+{
+	ForceGenerator g;
+	g.type = ForceType::Gravity;
+	g.mask = mask;
+	g.x = acceleration.x; g.y = acceleration.y;
+	return Add(g);
+}
+
+int ForceAccumulator::AddDrag(uint32_t mask, float linear, float quadratic, float angular)
+{
+	ForceGenerator g;
+	g.type = ForceType::Drag;
+	g.mask = mask;
+	g.strength = linear;
+	g.quadratic = quadratic;
+	g.angular = angular;
+	return Add(g);
+}
+
+int ForceAccumulator::AddWind(uint32_t mask, Vector2 velocity, float strength)
+{
+	ForceGenerator g;
+	g.type = ForceType::Wind;
+	g.mask = mask;
+	g.x = velocity.x; g.y = velocity.y;
+	g.strength = strength;
+	return Add(g);
+}
+
+int ForceAccumulator::AddAttractor(uint32_t mask, Vector2 center, float strength, float softening, float radius)
+{
+	ForceGenerator g;
+	g.type = ForceType::Attractor;
+	g.mask = mask;
+	g.x = center.x; g.y = center.y;
+	g.strength = strength;
+	// Some softening has to stay, a body right on the center would divide by zero
+	g.softening = fmaxf(softening, 1e-3f);
+	g.radius = radius;
+	return Add(g);
+}
+
+int ForceAccumulator::AddSpring(const BodyStore& bodies, BodyHandle bodyA, BodyHandle bodyB, Vector2 anchorA, Vector2 anchorB,
+	float stiffness, float damping)
+{
+	ForceGenerator g;
+	g.type = ForceType::Spring;
+	g.bodyA = bodyA;
+	g.bodyB = bodyB;
+	Vector2 localA = ToLocal(bodies, bodies.IndexOf(bodyA), anchorA);
+	Vector2 localB = ToLocal(bodies, bodies.IndexOf(bodyB), anchorB);
+	g.localAnchorAx = localA.x; g.localAnchorAy = localA.y;
+	g.localAnchorBx = localB.x; g.localAnchorBy = localB.y;
+	float dx = anchorB.x - anchorA.x, dy = anchorB.y - anchorA.y;
+	g.restLength = sqrtf(dx * dx + dy * dy);
+	g.strength = stiffness;
+	g.damping = damping;
+	return Add(g);
+}
+
+void ForceAccumulator::Remove(int generator)
+{
+	generators[generator] = generators.back();
+	generators.pop_back();
+}
+
+void ForceAccumulator::Reset()
+{
+	generators.clear();
+	fields.clear();
+}
+
+void ForceAccumulator::RemoveStale(const BodyStore& bodies)
+{
+	for (int i = 0; i < Count();)
+	{
+		const ForceGenerator& g = generators[i];
+		if (g.type != ForceType::Spring || (bodies.IsValid(g.bodyA) && bodies.IsValid(g.bodyB)))
+			i++;
+		else
+			Remove(i);
+	}
+}
+
+void ForceAccumulator::GetSpringAnchors(const BodyStore& bodies, int generator, RVector3& outAnchorA, RVector3& outAnchorB) const
+{
+	const ForceGenerator& g = generators[generator];
+	int a = bodies.IndexOf(g.bodyA), b = bodies.IndexOf(g.bodyB);
+	Vector2 rA = Rotate(g.localAnchorAx, g.localAnchorAy, bodies.rotation[a]);
+	Vector2 rB = Rotate(g.localAnchorBx, g.localAnchorBy, bodies.rotation[b]);
+	outAnchorA = RVector3(bodies.position.x[a] + rA.x, bodies.position.y[a] + rA.y, bodies.position.z[a]);
+	outAnchorB = RVector3(bodies.position.x[b] + rB.x, bodies.position.y[b] + rB.y, bodies.position.z[b]);
+}
+
+bool ForceAccumulator::Accumulate(const BodyStore& bodies, SimdLevel level, JobSystem& jobs)
+{
+	int count = bodies.Size();
+	accelX.resize(count);
+	accelY.resize(count);
+	angularAccel.resize(count);
+
+	fields.clear();
+	bool springs = false;
+	for (int i = 0; i < Count(); i++)
+	{
+		if (!generators[i].enabled)
+			continue;
+		if (generators[i].type == ForceType::Spring)
+			springs = true;
+		else
+			fields.push_back(i);
+	}
+
+	AttractorKernel attract = GetAttractorKernel(level);
+	AttractorArgs args = { bodies.position.x.data(), bodies.position.y.data(), bodies.inverseMass.data(),
+		bodies.forceGroups.data(), accelX.data(), accelY.data() };
+
+	// Only ever set, so which batch sets it doesn't matter
+	std::atomic<bool> anyForce(false);
+
+	jobs.ParallelFor(count, FORCE_BATCH, [&](int begin, int end, int) {
+		const float* fx = bodies.force.x.data();
+		const float* fy = bodies.force.y.data();
+		const float* torque = bodies.torque.data();
+		const float* invMass = bodies.inverseMass.data();
+		const float* invMOI = bodies.inverseMOI.data();
+		const float* vx = bodies.velocity.x.data();
+		const float* vy = bodies.velocity.y.data();
+		const float* w = bodies.angularVelocity.data();
+		const uint32_t* groups = bodies.forceGroups.data();
+		float* ax = accelX.data();
+		float* ay = accelY.data();
+		float* aw = angularAccel.data();
+
+		// The bodies' own forces
+		bool found = false;
+		for (int i = begin; i < end; i++)
+		{
+			ax[i] = fx[i] * invMass[i];
+			ay[i] = fy[i] * invMass[i];
+			aw[i] = torque[i] * invMOI[i];
+			found |= (fx[i] != 0.0f) | (fy[i] != 0.0f) | (torque[i] != 0.0f);
+		}
+		if (found)
+			anyForce.store(true, std::memory_order_relaxed);
+
+		for (int index : fields)
+		{
+			const ForceGenerator& g = generators[index];
+			switch (g.type)
+			{
+			case ForceType::Gravity:
+				for (int i = begin; i < end; i++)
+				{
+					if ((groups[i] & g.mask) && invMass[i] > 0.0f)
+					{
+						ax[i] += g.x;
+						ay[i] += g.y;
+					}
+				}
+				break;
+
+			case ForceType::Drag:
+				for (int i = begin; i < end; i++)
+				{
+					if (!(groups[i] & g.mask))
+						continue;
+					float k = g.strength + g.quadratic * sqrtf(vx[i] * vx[i] + vy[i] * vy[i]);
+					ax[i] -= k * vx[i] * invMass[i];
+					ay[i] -= k * vy[i] * invMass[i];
+					aw[i] -= g.angular * w[i] * invMOI[i];
+				}
+				break;
+
+			case ForceType::Wind:
+				for (int i = begin; i < end; i++)
+				{
+					if (!(groups[i] & g.mask))
+						continue;
+					ax[i] += g.strength * (g.x - vx[i]) * invMass[i];
+					ay[i] += g.strength * (g.y - vy[i]) * invMass[i];
+				}
+				break;
+
+			case ForceType::Attractor:
+				attract(g, g.radius > 0.0f ? g.radius * g.radius : INFINITY, args, begin, end);
+				break;
+
+			default:
+				break;
+			}
+		}
+	});
+
+	if (springs)
+	{
+		for (const ForceGenerator& g : generators)
+		{
+			if (g.enabled && g.type == ForceType::Spring)
+				AccumulateSpring(bodies, g);
+		}
+	}
+
+	return anyForce.load() || !fields.empty() || springs;
+}
+
+void ForceAccumulator::AccumulateSpring(const BodyStore& bodies, const ForceGenerator& g)
+{
+	int a = bodies.IndexOf(g.bodyA), b = bodies.IndexOf(g.bodyB);
+	Vector2 rA = Rotate(g.localAnchorAx, g.localAnchorAy, bodies.rotation[a]);
+	Vector2 rB = Rotate(g.localAnchorBx, g.localAnchorBy, bodies.rotation[b]);
+	float dx = bodies.position.x[b] + rB.x - bodies.position.x[a] - rA.x;
+	float dy = bodies.position.y[b] + rB.y - bodies.position.y[a] - rA.y;
+	float length = sqrtf(dx * dx + dy * dy);
+	if (length < 1e-6f)
+		return;
+	float ux = dx / length, uy = dy / length;
+
+	// How fast the anchors are moving apart
+	float wA = bodies.angularVelocity[a], wB = bodies.angularVelocity[b];
+	float dvx = bodies.velocity.x[b] - wB * rB.y - bodies.velocity.x[a] + wA * rA.y;
+	float dvy = bodies.velocity.y[b] + wB * rB.x - bodies.velocity.y[a] - wA * rA.x;
+
+	// Pulls A towards B and B towards A when stretched
+	float magnitude = g.strength * (length - g.restLength) + g.damping * (dvx * ux + dvy * uy);
+	float fx = magnitude * ux, fy = magnitude * uy;
+
+	accelX[a] += fx * bodies.inverseMass[a];
+	accelY[a] += fy * bodies.inverseMass[a];
+	angularAccel[a] += (rA.x * fy - rA.y * fx) * bodies.inverseMOI[a];
+	accelX[b] -= fx * bodies.inverseMass[b];
+	accelY[b] -= fy * bodies.inverseMass[b];
+	angularAccel[b] -= (rB.x * fy - rB.y * fx) * bodies.inverseMOI[b];
+}
+
+void ForceAccumulator::Apply(BodyStore& bodies, float dt, JobSystem& jobs) const
+{
+	jobs.ParallelFor(bodies.Size(), FORCE_BATCH, [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+		{
+			if (bodies.sleeping[i])
+				continue;
+			bodies.velocity.x[i] += accelX[i] * dt;
+			bodies.velocity.y[i] += accelY[i] * dt;
+			bodies.angularVelocity[i] += angularAccel[i] * dt;
+		}
+	});
+}
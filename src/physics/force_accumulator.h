@@ -0,0 +1,118 @@
+#pragma once
+
+#include "raylib-cpp.hpp"
+#include "body_store.h"
+#include "integrator.h"
+#include "job_system.h"
+#include "snapshot.h"
+#include <vector>
+#include <cstdint>
+
+enum class ForceType {
+	Gravity = 0,	// the same acceleration for every body, whatever its mass
+	Drag,			// slows bodies down, in proportion to their speed & its square
+	Wind,			// drags bodies towards the wind's velocity
+	Attractor,		// pulls bodies towards a point, falling off with distance squared
+	Spring,			// pulls or pushes two bodies' anchors to a rest length
+	Count
+};
+
+const char* ForceTypeName(ForceType type);
+
+/**
+	Something that pushes bodies around every step. Plain data, one struct for every
+	type like Joint, so a whole array of bodies can go through one generator in a
+	tight loop.
+
+	Every type but springs is a field over the whole world: it applies to the bodies
+	whose forceGroups share a bit with its mask, and leaves the rest alone. Gravity
+	& attractors are accelerations, so they also skip static bodies. Springs are
+	between two bodies and ignore the mask.
+*/
+struct ForceGenerator {
+	ForceType type = ForceType::Gravity;
+	uint32_t mask = 0xFFFFFFFF;
+	bool enabled = true;
+
+	float x = 0.0f, y = 0.0f;	// gravity's acceleration, the wind's velocity or the attractor's center
+	float strength = 0.0f;		// drag & wind per unit speed, the attractor's pull (negative pushes), spring stiffness
+	float quadratic = 0.0f;		// drag per speed squared
+	float angular = 0.0f;		// drag on angular velocity
+	float softening = 1.0f;		// attractors, keeps the pull finite at the center
+	float radius = 0.0f;		// attractors, no pull past it (0 for everywhere)
+
+	// Springs, anchors are relative to each body's center, unrotated
+	BodyHandle bodyA, bodyB;
+	float localAnchorAx = 0.0f, localAnchorAy = 0.0f;
+	float localAnchorBx = 0.0f, localAnchorBy = 0.0f;
+	float restLength = 0.0f;
+	float damping = 0.0f;
+};
+
+/**
+	Works out every body's acceleration for the step from its own force & torque
+	(BodyStore::force, which stays until changed) and the generators, before the
+	integrator adds the world's gravity. Forces are 2D, Z is left alone.
+
+	Bodies are split into batches on the job system, and each batch goes through
+	the field generators one after the other while it's still in cache. Attractors
+	have SSE2/AVX2 kernels like the integrator's, so a field over a lot of bodies is
+	a single pass of 4 or 8 at a time, and give the same results at every level.
+	Springs scatter to two bodies each, so they're added after on one thread, in
+	order.
+
+	Like joints, generators live in one compact array (removing one moves the last
+	into its place), and springs to removed bodies are dropped at the next step.
+*/
+class ForceAccumulator {
+
+public:
+	static constexpr uint32_t ALL_GROUPS = 0xFFFFFFFF;
+
+	std::vector<ForceGenerator> generators;
+
+	// Per body, this step's accelerations from Accumulate
+	std::vector<float> accelX, accelY, angularAccel;
+
+	// Each returns the generator's index
+	int AddGravity(uint32_t mask, Vector2 acceleration);
+	int AddDrag(uint32_t mask, float linear, float quadratic, float angular);
+	int AddWind(uint32_t mask, Vector2 velocity, float strength);
+	int AddAttractor(uint32_t mask, Vector2 center, float strength, float softening = 1.0f, float radius = 0.0f);
+	// Anchors are in world space, where the bodies are now, and the rest length is
+	// how far apart they are. Stiffness & damping are forces, so heavier bodies
+	// stretch it further. Too stiff for the step & it'll blow up, keep
+	// sqrt(stiffness / mass) well under 1 / dt
+	int AddSpring(const BodyStore& bodies, BodyHandle bodyA, BodyHandle bodyB, Vector2 anchorA, Vector2 anchorB,
+		float stiffness, float damping);
+	void Remove(int generator);
+	void Reset();
+
+	int Count() const { return (int)generators.size(); }
+	void GetSpringAnchors(const BodyStore& bodies, int generator, RVector3& outAnchorA, RVector3& outAnchorB) const;
+
+	/**
+		Fills accelX, accelY & angularAccel for every body. Returns false if there
+		was nothing to apply (no forces, torques or generators), so the step can
+		skip Apply.
+
+		\param level Instruction set for the attractors, clamped to what the CPU supports.
+	*/
+	bool Accumulate(const BodyStore& bodies, SimdLevel level, JobSystem& jobs);
+	// Adds the accelerations to awake bodies' velocities
+	void Apply(BodyStore& bodies, float dt, JobSystem& jobs) const;
+
+	// Drops springs to removed bodies
+	void RemoveStale(const BodyStore& bodies);
+
+	// The generators, for world snapshots
+	void SaveState(SnapshotWriter& writer) const { writer.Array(generators); }
+	bool RestoreState(SnapshotReader& reader) { return reader.Array(generators); }
+
+private:
+	std::vector<int> fields;	// this step's enabled generators that aren't springs
+
+	int Add(const ForceGenerator& generator);
+	void AccumulateSpring(const BodyStore& bodies, const ForceGenerator& spring);
+
+};
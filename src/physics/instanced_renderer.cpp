@@ -0,0 +1,316 @@
+#include "instanced_renderer.h"
+
+#include "rlgl.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace {
+
+/**
+	A corner of one of a line's two triangles. The shader pushes it sideways
+	(side = +-1) from the line towards other, or leaves it where it is for
+	solid triangles (side = 0).
+*/
+struct LineVertex {
+	float point[3];
+	float other[3];
+	float side;
+};
+
+const char* VERTEX_SHADER = R"(#version 330
+in vec3 linePoint;
+in vec4 lineOther;
+in vec4 instancePosRot;
+in float instanceScale;
+in vec4 instanceColor;
+
+uniform mat4 mvp;
+uniform vec2 viewport;
+uniform float lineWidth;
+
+out vec4 fragColor;
+
+vec4 ToClip(vec3 p)
+{
+	float s = sin(instancePosRot.w);
+	float c = cos(instancePosRot.w);
+	p *= instanceScale;
+	return mvp * vec4(c * p.x - s * p.y + instancePosRot.x, s * p.x + c * p.y + instancePosRot.y, p.z + instancePosRot.z, 1.0);
+}
+
+void main()
+{
+	vec4 clip = ToClip(linePoint);
+	vec4 otherClip = ToClip(lineOther.xyz);
+
+	// Line direction in pixels, lines pointing straight at the camera have none
+	vec2 dir = (otherClip.xy / otherClip.w - clip.xy / clip.w) * viewport;
+	float len = length(dir);
+	dir = len > 1e-6 ? dir / len : vec2(1.0, 0.0);
+
+	// Half the width to each side, NDC is 2 units across the viewport
+	vec2 offset = vec2(-dir.y, dir.x) * lineWidth / viewport;
+	gl_Position = clip + vec4(offset * clip.w * lineOther.w, 0.0, 0.0);
+	fragColor = instanceColor;
+}
+)";
+
+const char* FRAGMENT_SHADER = R"(#version 330
+in vec4 fragColor;
+out vec4 finalColor;
+
+void main()
+{
+	finalColor = fragColor;
+}
+)";
+
+void AddLine(std::vector<LineVertex>& vertices, Vector3 a, Vector3 b)
+{
+	// Going from b to a flips the side, so b's sides are swapped to match a's
+	LineVertex aLeft = { { a.x, a.y, a.z }, { b.x, b.y, b.z }, 1.0f };
+	LineVertex aRight = { { a.x, a.y, a.z }, { b.x, b.y, b.z }, -1.0f };
+	LineVertex bLeft = { { b.x, b.y, b.z }, { a.x, a.y, a.z }, -1.0f };
+	LineVertex bRight = { { b.x, b.y, b.z }, { a.x, a.y, a.z }, 1.0f };
+
+	vertices.insert(vertices.end(), { aLeft, aRight, bRight, aLeft, bRight, bLeft });
+}
+
+void AddTriangle(std::vector<LineVertex>& vertices, Vector3 a, Vector3 b, Vector3 c)
+{
+	for (Vector3 p : { a, b, c })
+		vertices.push_back({ { p.x, p.y, p.z }, { p.x, p.y, p.z }, 0.0f });
+}
+
+// Point on the unit sphere, ring 0 is the bottom pole
+Vector3 SpherePoint(int ring, int rings, int slice, int slices)
+{
+	float lat = -PI / 2 + PI * ring / rings;
+	float lon = 2 * PI * slice / slices;
+	return { cosf(lat) * cosf(lon), sinf(lat), cosf(lat) * sinf(lon) };
+}
+
+std::vector<LineVertex> BuildMesh(InstancedRenderer::Mesh mesh)
+{
+	std::vector<LineVertex> vertices;
+	const int rings = 8, slices = 8;
+
+	switch (mesh)
+	{
+	case InstancedRenderer::Mesh::WireCube:
+	{
+		// Corner i has bit d set if it's on the positive side along axis d,
+		// edges join corners one bit apart
+		Vector3 corners[8];
+		for (int i = 0; i < 8; i++)
+			corners[i] = { (i & 1) - 0.5f, ((i >> 1) & 1) - 0.5f, ((i >> 2) & 1) - 0.5f };
+
+		for (int i = 0; i < 8; i++)
+		{
+			for (int d = 0; d < 3; d++)
+			{
+				if (!(i & (1 << d)))
+					AddLine(vertices, corners[i], corners[i | (1 << d)]);
+			}
+		}
+		break;
+	}
+
+	case InstancedRenderer::Mesh::WireSphere:
+		// Parallels, twice as smooth as the meridians since they're longer
+		for (int r = 1; r < rings; r++)
+		{
+			for (int s = 0; s < slices * 2; s++)
+				AddLine(vertices, SpherePoint(r, rings, s, slices * 2), SpherePoint(r, rings, s + 1, slices * 2));
+		}
+		// Meridians
+		for (int s = 0; s < slices; s++)
+		{
+			for (int r = 0; r < rings; r++)
+				AddLine(vertices, SpherePoint(r, rings, s, slices), SpherePoint(r + 1, rings, s, slices));
+		}
+		break;
+
+	case InstancedRenderer::Mesh::Sphere:
+		for (int r = 0; r < rings; r++)
+		{
+			for (int s = 0; s < slices; s++)
+			{
+				Vector3 p00 = SpherePoint(r, rings, s, slices), p01 = SpherePoint(r, rings, s + 1, slices);
+				Vector3 p10 = SpherePoint(r + 1, rings, s, slices), p11 = SpherePoint(r + 1, rings, s + 1, slices);
+				AddTriangle(vertices, p00, p10, p11);
+				AddTriangle(vertices, p00, p11, p01);
+			}
+		}
+		break;
+
+	case InstancedRenderer::Mesh::Disc:
+		// Few sides, there can be millions of these
+		for (int s = 0; s < slices; s++)
+		{
+			float a0 = 2 * PI * s / slices, a1 = 2 * PI * (s + 1) / slices;
+			AddTriangle(vertices, { 0, 0, 0 }, { cosf(a1), sinf(a1), 0 }, { cosf(a0), sinf(a0), 0 });
+		}
+		break;
+
+	case InstancedRenderer::Mesh::WireCircle:
+		// With a spoke, so it can be seen turning
+		for (int s = 0; s < slices * 4; s++)
+		{
+			float a0 = 2 * PI * s / (slices * 4), a1 = 2 * PI * (s + 1) / (slices * 4);
+			AddLine(vertices, { cosf(a0), sinf(a0), 0 }, { cosf(a1), sinf(a1), 0 });
+		}
+		AddLine(vertices, { 0, 0, 0 }, { 1, 0, 0 });
+		break;
+
+	default:
+		break;
+	}
+
+	return vertices;
+}
+
+}
+
+bool InstancedRenderer::Load()
+{
+	if (loaded) return true;
+	if (failed) return false;
+
+	// The shader is GLSL 330, and rlgl only has instancing on desktop GL 3.3+
+	int version = rlGetVersion();
+	if (version != RL_OPENGL_33 && version != RL_OPENGL_43)
+	{
+		failed = true;
+		return false;
+	}
+
+	// rlgl falls back to its default shader if ours doesn't compile
+	shader = rlLoadShaderCode(VERTEX_SHADER, FRAGMENT_SHADER);
+	if (shader == 0 || shader == rlGetShaderIdDefault())
+	{
+		TraceLog(LOG_WARNING, "InstancedRenderer: shader failed to load, drawing without instancing");
+		shader = 0;
+		failed = true;
+		return false;
+	}
+
+	mvpLoc = rlGetLocationUniform(shader, "mvp");
+	viewportLoc = rlGetLocationUniform(shader, "viewport");
+	lineWidthLoc = rlGetLocationUniform(shader, "lineWidth");
+	vertexAttribs[0] = rlGetLocationAttrib(shader, "linePoint");
+	vertexAttribs[1] = rlGetLocationAttrib(shader, "lineOther");
+	instanceAttribs[0] = rlGetLocationAttrib(shader, "instancePosRot");
+	instanceAttribs[1] = rlGetLocationAttrib(shader, "instanceScale");
+	instanceAttribs[2] = rlGetLocationAttrib(shader, "instanceColor");
+
+	for (int i = 0; i < (int)Mesh::Count; i++)
+		LoadMesh((Mesh)i);
+
+	loaded = true;
+	return true;
+}
+
+void InstancedRenderer::Unload()
+{
+	if (!loaded)
+		return;
+
+	for (MeshBuffers& buffers : meshes)
+	{
+		rlUnloadVertexBuffer(buffers.instanceBuffer);
+		rlUnloadVertexBuffer(buffers.vertexBuffer);
+		rlUnloadVertexArray(buffers.vao);
+		buffers = MeshBuffers();
+	}
+	rlUnloadShaderProgram(shader);
+	shader = 0;
+	loaded = false;
+}
+
+void InstancedRenderer::LoadMesh(Mesh mesh)
+{
+	std::vector<LineVertex> vertices = BuildMesh(mesh);
+	MeshBuffers& buffers = meshes[(int)mesh];
+	buffers.vertexCount = (int)vertices.size();
+
+	buffers.vao = rlLoadVertexArray();
+	rlEnableVertexArray(buffers.vao);
+
+	buffers.vertexBuffer = rlLoadVertexBuffer(vertices.data(), (int)(vertices.size() * sizeof(LineVertex)), false);
+	rlEnableVertexBuffer(buffers.vertexBuffer);
+	rlSetVertexAttribute(vertexAttribs[0], 3, RL_FLOAT, false, sizeof(LineVertex), (void*)offsetof(LineVertex, point));
+	rlEnableVertexAttribute(vertexAttribs[0]);
+	rlSetVertexAttribute(vertexAttribs[1], 4, RL_FLOAT, false, sizeof(LineVertex), (void*)offsetof(LineVertex, other));
+	rlEnableVertexAttribute(vertexAttribs[1]);
+
+	ReserveInstances(buffers, 256);
+	rlDisableVertexArray();
+}
+
+// Grows the instance buffer to fit count instances, with the mesh's VAO bound
+void InstancedRenderer::ReserveInstances(MeshBuffers& buffers, int count)
+{
+	if (count <= buffers.instanceCapacity)
+		return;
+
+	int capacity = std::max(count, buffers.instanceCapacity * 2);
+	if (buffers.instanceBuffer != 0)
+		rlUnloadVertexBuffer(buffers.instanceBuffer);
+	buffers.instanceBuffer = rlLoadVertexBuffer(nullptr, capacity * (int)sizeof(MeshInstance), true);
+	buffers.instanceCapacity = capacity;
+
+	// The new buffer has to be pointed at again, the VAO remembers the old one
+	const int stride = sizeof(MeshInstance);
+	rlEnableVertexBuffer(buffers.instanceBuffer);
+	rlSetVertexAttribute(instanceAttribs[0], 4, RL_FLOAT, false, stride, (void*)offsetof(MeshInstance, x));
+	rlSetVertexAttribute(instanceAttribs[1], 1, RL_FLOAT, false, stride, (void*)offsetof(MeshInstance, scale));
+	rlSetVertexAttribute(instanceAttribs[2], 4, RL_UNSIGNED_BYTE, true, stride, (void*)offsetof(MeshInstance, color));
+	for (int attrib : instanceAttribs)
+	{
+		rlSetVertexAttributeDivisor(attrib, 1);
+		rlEnableVertexAttribute(attrib);
+	}
+}
+
+void InstancedRenderer::Begin()
+{
+	for (auto& queue : queues)
+		queue.clear();
+}
+
+int InstancedRenderer::End()
+{
+	// Anything raylib has batched up goes first, so it's under what we draw
+	rlDrawRenderBatchActive();
+
+	Matrix mvp = MatrixMultiply(MatrixMultiply(rlGetMatrixTransform(), rlGetMatrixModelview()), rlGetMatrixProjection());
+	Vector2 viewport = { (float)GetRenderWidth(), (float)GetRenderHeight() };
+
+	rlEnableShader(shader);
+	rlSetUniformMatrix(mvpLoc, mvp);
+	rlSetUniform(viewportLoc, &viewport, RL_SHADER_UNIFORM_VEC2, 1);
+	rlSetUniform(lineWidthLoc, &lineWidth, RL_SHADER_UNIFORM_FLOAT, 1);
+	rlDisableBackfaceCulling(); // lines face whichever way they were built
+
+	int drawCalls = 0;
+	for (int i = 0; i < (int)Mesh::Count; i++)
+	{
+		const std::vector<MeshInstance>& queue = queues[i];
+		if (queue.empty())
+			continue;
+
+		MeshBuffers& buffers = meshes[i];
+		rlEnableVertexArray(buffers.vao);
+		ReserveInstances(buffers, (int)queue.size());
+		rlUpdateVertexBuffer(buffers.instanceBuffer, queue.data(), (int)(queue.size() * sizeof(MeshInstance)), 0);
+		rlDrawVertexArrayInstanced(0, buffers.vertexCount, (int)queue.size());
+		drawCalls++;
+	}
+
+	rlDisableVertexArray();
+	rlEnableBackfaceCulling();
+	rlDisableShader();
+	return drawCalls;
+}
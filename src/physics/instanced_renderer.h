@@ -0,0 +1,76 @@
+#pragma once
+
+#include "raylib-cpp.hpp"
+#include <vector>
+
+/**
+	One copy of a mesh: where it goes, how big it is & what color it is.
+	Uploaded straight into the instance buffer, so keep it small.
+*/
+struct MeshInstance {
+	float x, y, z;
+	float rotation;		// around z, in radians
+	float scale;
+	Color color;
+};
+
+/**
+	Draws many copies of a few debug meshes (wire cubes, wire spheres, solid
+	spheres, discs, wire circles) with one instanced draw call per mesh, instead of one
+	immediate-mode draw per copy.
+
+	Lines are drawn as thin triangle strips widened in screen space by the vertex
+	shader, since rlgl's vertex arrays only draw triangles.
+
+	Needs desktop OpenGL 3.3 or newer. Load returns false anywhere else (e.g. the
+	OpenGL ES 2 web build), and the caller should draw the old way.
+*/
+class InstancedRenderer {
+
+public:
+	enum class Mesh {
+		WireCube = 0,	// unit side length, centered on the origin
+		WireSphere,		// unit radius
+		Sphere,			// unit radius
+		Disc,			// unit radius, flat on the XY plane, for particles
+		WireCircle,		// unit radius, on the XY plane
+		Count
+	};
+
+	// Creates the shader & meshes the first time it's called, needs a window
+	bool Load();
+	void Unload();
+
+	// Queues instances for End, which draws each mesh's queue with one draw call
+	void Begin();
+	void Add(Mesh mesh, const MeshInstance& instance) { queues[(int)mesh].push_back(instance); }
+	int End();
+
+	float lineWidth = 1.5f;	// pixels
+
+private:
+	struct MeshBuffers {
+		unsigned int vao = 0;
+		unsigned int vertexBuffer = 0;
+		unsigned int instanceBuffer = 0;
+		int vertexCount = 0;
+		int instanceCapacity = 0;
+	};
+
+	bool loaded = false;
+	bool failed = false;
+
+	unsigned int shader = 0;
+	int mvpLoc = -1;
+	int viewportLoc = -1;
+	int lineWidthLoc = -1;
+	int vertexAttribs[2] = { -1, -1 };		// point, other end of the line & side
+	int instanceAttribs[3] = { -1, -1, -1 };	// position & rotation, scale, color
+
+	MeshBuffers meshes[(int)Mesh::Count];
+	std::vector<MeshInstance> queues[(int)Mesh::Count];
+
+	void LoadMesh(Mesh mesh);
+	void ReserveInstances(MeshBuffers& buffers, int count);
+
+};
@@ -0,0 +1,234 @@
+#include "integrator.h"
+#include "simd.h"
+
+#include <string.h>
+
+const char* SimdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::Scalar:	return "Scalar";
+	case SimdLevel::SSE2:	return "SSE2";
+	case SimdLevel::AVX2:	return "AVX2";
+	default:				return "Unknown";
+	}
+}
+
+SimdLevel DetectSimdLevel()
+{
+#ifndef SIMD_X86
+	return SimdLevel::Scalar;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool osxsave = info[2] & (1 << 27);
+	bool avx = info[2] & (1 << 28);
+	bool sse2 = info[3] & (1 << 26);
+
+	bool avx2 = false;
+	if (maxLeaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = info[1] & (1 << 5);
+	}
+
+	// The OS also has to save the YMM registers on context switches
+	if (osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6)
+		return SimdLevel::AVX2;
+	return sse2 ? SimdLevel::SSE2 : SimdLevel::Scalar;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return SimdLevel::AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SimdLevel::SSE2;
+	return SimdLevel::Scalar;
+#endif
+}
+
+
+/*
+	Kernels work on one component for bodies [begin, end). Velocity kernels do
+		vel += accelMask && !sleepMask ? accel * dt : 0
+	and position kernels do
+		oldPos = pos (if oldPos isn't null)
+		pos += vel * dt
+*/
+typedef void (*VelocityKernel)(float* vel, const uint8_t* accelMask, const uint8_t* sleepMask, float accelDt, int begin, int end);
+typedef void (*PositionKernel)(float* pos, float* oldPos, const float* vel, float dt, int begin, int end);
+
+static void IntegrateVelocityScalar(float* vel, const uint8_t* accelMask, const uint8_t* sleepMask, float accelDt, int begin, int end)
+{
+	for (int i = begin; i < end; i++)
+		vel[i] += accelMask[i] && !sleepMask[i] ? accelDt : 0.0f;
+}
+
+static void IntegratePositionScalar(float* pos, float* oldPos, const float* vel, float dt, int begin, int end)
+{
+	if (oldPos)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			oldPos[i] = pos[i];
+			pos[i] += vel[i] * dt;
+		}
+	}
+	else
+	{
+		for (int i = begin; i < end; i++)
+			pos[i] += vel[i] * dt;
+	}
+}
+
+#ifdef SIMD_X86
+static void IntegrateVelocitySSE2(float* vel, const uint8_t* accelMask, const uint8_t* sleepMask, float accelDt, int begin, int end)
+{
+	const __m128 accel = _mm_set1_ps(accelDt);
+	const __m128i zero = _mm_setzero_si128();
+
+	int i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		// Widen 4 flag bytes to 4 lane masks
+		int32_t flags, sleepFlags;
+		memcpy(&flags, accelMask + i, sizeof(flags));
+		memcpy(&sleepFlags, sleepMask + i, sizeof(sleepFlags));
+		__m128i wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(flags), zero), zero);
+		__m128i sleepWide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(sleepFlags), zero), zero);
+		__m128 mask = _mm_castsi128_ps(_mm_andnot_si128(_mm_cmpgt_epi32(sleepWide, zero), _mm_cmpgt_epi32(wide, zero)));
+		_mm_storeu_ps(vel + i, _mm_add_ps(_mm_loadu_ps(vel + i), _mm_and_ps(accel, mask)));
+	}
+
+	IntegrateVelocityScalar(vel, accelMask, sleepMask, accelDt, i, end);
+}
+
+static void IntegratePositionSSE2(float* pos, float* oldPos, const float* vel, float dt, int begin, int end)
+{
+	const __m128 dtv = _mm_set1_ps(dt);
+
+	int i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 p = _mm_loadu_ps(pos + i);
+		if (oldPos) _mm_storeu_ps(oldPos + i, p);
+		_mm_storeu_ps(pos + i, _mm_add_ps(p, _mm_mul_ps(_mm_loadu_ps(vel + i), dtv)));
+	}
+
+	IntegratePositionScalar(pos, oldPos, vel, dt, i, end);
+}
+
+TARGET_AVX2 static void IntegrateVelocityAVX2(float* vel, const uint8_t* accelMask, const uint8_t* sleepMask, float accelDt, int begin, int end)
+{
+	const __m256 accel = _mm256_set1_ps(accelDt);
+	const __m256i zero = _mm256_setzero_si256();
+
+	int i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		// Widen 8 flag bytes to 8 lane masks
+		__m256i wide = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(accelMask + i)));
+		__m256i sleepWide = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(sleepMask + i)));
+		__m256 mask = _mm256_castsi256_ps(_mm256_andnot_si256(_mm256_cmpgt_epi32(sleepWide, zero), _mm256_cmpgt_epi32(wide, zero)));
+		_mm256_storeu_ps(vel + i, _mm256_add_ps(_mm256_loadu_ps(vel + i), _mm256_and_ps(accel, mask)));
+	}
+
+	IntegrateVelocityScalar(vel, accelMask, sleepMask, accelDt, i, end);
+}
+
+// No FMA on purpose, contracting the multiply-add would round differently from
+// the other paths.
+TARGET_AVX2 static void IntegratePositionAVX2(float* pos, float* oldPos, const float* vel, float dt, int begin, int end)
+{
+	const __m256 dtv = _mm256_set1_ps(dt);
+
+	int i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 p = _mm256_loadu_ps(pos + i);
+		if (oldPos) _mm256_storeu_ps(oldPos + i, p);
+		_mm256_storeu_ps(pos + i, _mm256_add_ps(p, _mm256_mul_ps(_mm256_loadu_ps(vel + i), dtv)));
+	}
+
+	IntegratePositionScalar(pos, oldPos, vel, dt, i, end);
+}
+#endif
+
+SimdLevel ClampSimdLevel(SimdLevel level)
+{
+	static const SimdLevel supported = DetectSimdLevel();
+	return level > supported ? supported : level;
+}
+
+static VelocityKernel GetVelocityKernel(SimdLevel level)
+{
+#ifdef SIMD_X86
+	switch (ClampSimdLevel(level))
+	{
+	case SimdLevel::AVX2:	return IntegrateVelocityAVX2;
+	case SimdLevel::SSE2:	return IntegrateVelocitySSE2;
+	default:				break;
+	}
+#endif
+	return IntegrateVelocityScalar;
+}
+
+static PositionKernel GetPositionKernel(SimdLevel level)
+{
+#ifdef SIMD_X86
+	switch (ClampSimdLevel(level))
+	{
+	case SimdLevel::AVX2:	return IntegratePositionAVX2;
+	case SimdLevel::SSE2:	return IntegratePositionSSE2;
+	default:				break;
+	}
+#endif
+	return IntegratePositionScalar;
+}
+
+// Bodies per batch when integrating on several threads
+static const int INTEGRATE_BATCH = 4096;
+
+void IntegrateVelocities(BodyStore& bodies, RVector3 gravity, float dt, SimdLevel level, JobSystem* jobs)
+{
+	VelocityKernel kernel = GetVelocityKernel(level);
+	const uint8_t* gravityMask = bodies.doGravity.data();
+	const uint8_t* sleepMask = bodies.sleeping.data();
+
+	auto integrate = [&](int begin, int end, int) {
+		kernel(bodies.velocity.x.data(), gravityMask, sleepMask, gravity.x * dt, begin, end);
+		kernel(bodies.velocity.y.data(), gravityMask, sleepMask, gravity.y * dt, begin, end);
+		kernel(bodies.velocity.z.data(), gravityMask, sleepMask, gravity.z * dt, begin, end);
+		// Gravity doesn't turn anything, torques go through ForceAccumulator::Apply
+	};
+
+	if (jobs)
+		jobs->ParallelFor(bodies.Size(), INTEGRATE_BATCH, integrate);
+	else
+		integrate(0, bodies.Size(), 0);
+}
+
+void IntegratePositions(BodyStore& bodies, float dt, SimdLevel level, JobSystem* jobs)
+{
+	PositionKernel kernel = GetPositionKernel(level);
+
+	auto integrate = [&](int begin, int end, int) {
+		kernel(bodies.position.x.data(), bodies.oldPos.x.data(), bodies.velocity.x.data(), dt, begin, end);
+		kernel(bodies.position.y.data(), bodies.oldPos.y.data(), bodies.velocity.y.data(), dt, begin, end);
+		kernel(bodies.position.z.data(), bodies.oldPos.z.data(), bodies.velocity.z.data(), dt, begin, end);
+		kernel(bodies.rotation.data(), bodies.oldRotation.data(), bodies.angularVelocity.data(), dt, begin, end);
+	};
+
+	if (jobs)
+		jobs->ParallelFor(bodies.Size(), INTEGRATE_BATCH, integrate);
+	else
+		integrate(0, bodies.Size(), 0);
+}
+
+void IntegrateBodies(BodyStore& bodies, RVector3 gravity, float dt, SimdLevel level, JobSystem* jobs)
+{
+	IntegrateVelocities(bodies, gravity, dt, level, jobs);
+	IntegratePositions(bodies, dt, level, jobs);
+}
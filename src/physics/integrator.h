@@ -0,0 +1,38 @@
+#pragma once
+
+#include "body_store.h"
+#include "job_system.h"
+
+enum class SimdLevel {
+	Scalar = 0,
+	SSE2,
+	AVX2,
+	Count
+};
+
+const char* SimdLevelName(SimdLevel level);
+
+/**
+	The best instruction set the integrator can use on this CPU, checked once at
+	runtime. Always Scalar on non-x86 platforms (e.g. web).
+*/
+SimdLevel DetectSimdLevel();
+// Lowers a level to what this CPU supports, so kernels can pick from it safely
+SimdLevel ClampSimdLevel(SimdLevel level);
+
+/**
+	Semi-implicit Euler step over every body in the store, split in two so
+	constraints can be solved in between:
+	IntegrateVelocities applies gravity to awake bodies with doGravity set, and
+	IntegratePositions moves positions & rotations by the velocities, saving the
+	previous positions & rotations into oldPos & oldRotation. IntegrateBodies does both.
+
+	Works on one component array at a time, so the SSE2/AVX2 paths process 4/8
+	bodies per instruction. All levels give bit-identical results.
+
+	\param level Instruction set to use, clamped to what the CPU supports.
+	\param jobs If set, ranges of bodies are integrated on its threads.
+*/
+void IntegrateVelocities(BodyStore& bodies, RVector3 gravity, float dt, SimdLevel level, JobSystem* jobs = nullptr);
+void IntegratePositions(BodyStore& bodies, float dt, SimdLevel level, JobSystem* jobs = nullptr);
+void IntegrateBodies(BodyStore& bodies, RVector3 gravity, float dt, SimdLevel level, JobSystem* jobs = nullptr);
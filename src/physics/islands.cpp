@@ -0,0 +1,35 @@
+#include "islands.h"
+
+#include <utility>
+
+void IslandFinder::Reset(int bodyCount)
+{
+	parent.resize(bodyCount);
+	size.assign(bodyCount, 1);
+	for (int i = 0; i < bodyCount; i++)
+		parent[i] = i;
+}
+
+void IslandFinder::Union(int a, int b)
+{
+	a = Find(a);
+	b = Find(b);
+	if (a == b)
+		return;
+
+	// Hang the smaller tree under the bigger one to keep paths short
+	if (size[a] < size[b])
+		std::swap(a, b);
+	parent[b] = a;
+	size[a] += size[b];
+}
+
+int IslandFinder::Find(int body)
+{
+	while (parent[body] != body)
+	{
+		parent[body] = parent[parent[body]];
+		body = parent[body];
+	}
+	return body;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+/**
+	Union-find over body indices, used to group bodies that touch each other
+	(directly or through other bodies) into islands that fall asleep & wake up
+	together. Union by size with path halving, so building the islands for a step
+	is close to linear in the number of contacts.
+*/
+class IslandFinder {
+
+public:
+	// Starts over with every body in an island of its own
+	void Reset(int bodyCount);
+
+	void Union(int a, int b);
+
+	// The island's representative body, the same for every body in the island
+	int Find(int body);
+
+private:
+	std::vector<int> parent;
+	std::vector<int> size;
+
+};
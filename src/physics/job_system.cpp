@@ -0,0 +1,164 @@
+#include "job_system.h"
+
+#include <algorithm>
+
+JobSystem::JobSystem()
+{
+	remainingBatches = 0;
+	SetThreadCount(DefaultThreadCount());
+}
+
+JobSystem::~JobSystem()
+{
+	StopWorkers();
+}
+
+int JobSystem::DefaultThreadCount()
+{
+#ifdef PLATFORM_WEB
+	return 1;
+#else
+	return std::max(1, (int)std::thread::hardware_concurrency());
+#endif
+}
+
+void JobSystem::SetThreadCount(int count)
+{
+#ifdef PLATFORM_WEB
+	count = 1;
+#endif
+	if (count > MAX_THREADS) count = MAX_THREADS;
+	if (count < 1) count = 1;
+	if (count == ThreadCount())
+		return;
+
+	StopWorkers();
+
+	queues.clear();
+	for (int i = 0; i < count; i++)
+		queues.push_back(std::make_unique<Queue>());
+
+	// The calling thread is thread 0
+	quit = false;
+	for (int i = 1; i < count; i++)
+		workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+void JobSystem::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		quit = true;
+	}
+	wakeCondition.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+void JobSystem::Run(int count, int minBatch, const RangeFunc& func)
+{
+	if (count <= 0)
+		return;
+
+	// A few batches per thread, so there's something left to steal
+	int threads = ThreadCount();
+	int batchSize = std::max(std::max(minBatch, 1), (count + threads * 4 - 1) / (threads * 4));
+	if (threads == 1 || count <= batchSize)
+	{
+		func(0, count, 0);
+		return;
+	}
+
+	int batchCount = (count + batchSize - 1) / batchSize;
+	remainingBatches = batchCount;
+	currentFunc = &func;
+
+	// Contiguous runs of batches per thread, neighbouring elements tend to touch
+	// the same memory
+	for (int t = 0; t < threads; t++)
+	{
+		Queue& queue = *queues[t];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.batches.clear();
+		for (int b = (int)((int64_t)t * batchCount / threads); b < (int)((int64_t)(t + 1) * batchCount / threads); b++)
+			queue.batches.push_back({ b * batchSize, std::min(count, (b + 1) * batchSize) });
+		queue.head = 0;
+		queue.tail = (int)queue.batches.size();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		generation++;
+	}
+	wakeCondition.notify_all();
+
+	RunBatches(0);
+
+	// Wait for the batches other threads are still running
+	std::unique_lock<std::mutex> lock(wakeMutex);
+	doneCondition.wait(lock, [this] { return remainingBatches == 0; });
+	currentFunc = nullptr;
+}
+
+void JobSystem::WorkerLoop(int thread)
+{
+	uint64_t seenGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wakeCondition.wait(lock, [&] { return quit || generation != seenGeneration; });
+			if (quit)
+				return;
+			seenGeneration = generation;
+		}
+
+		RunBatches(thread);
+	}
+}
+
+void JobSystem::RunBatches(int thread)
+{
+	Batch batch;
+	while (PopBatch(thread, batch))
+	{
+		(*currentFunc)(batch.begin, batch.end, thread);
+
+		if (--remainingBatches == 0)
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			doneCondition.notify_all();
+		}
+	}
+}
+
+bool JobSystem::PopBatch(int thread, Batch& outBatch)
+{
+	// Own queue first, in order
+	{
+		Queue& queue = *queues[thread];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.head < queue.tail)
+		{
+			outBatch = queue.batches[queue.head++];
+			return true;
+		}
+	}
+
+	// Then steal from the far end of someone else's
+	int threads = ThreadCount();
+	for (int i = 1; i < threads; i++)
+	{
+		Queue& queue = *queues[(thread + i) % threads];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.head < queue.tail)
+		{
+			outBatch = queue.batches[--queue.tail];
+			return true;
+		}
+	}
+
+	return false;
+}
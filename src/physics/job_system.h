@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+	Work-stealing thread pool for splitting the physics step over cores.
+
+	ParallelFor cuts a range into batches and deals contiguous runs of them out to
+	per-thread queues. Every thread, the calling one included, works through its
+	own queue front to back and then steals from the back of the others' queues,
+	so a thread that got cheap batches helps out the ones that didn't.
+
+	Which thread runs which batch changes from run to run, so work has to either
+	write only its own elements, or collect per-thread results that get merged in
+	an order that doesn't depend on the threads (e.g. by sorting). Done that way
+	the results are the same for every thread count.
+
+	The web build has no threads, everything runs on the calling thread there.
+*/
+class JobSystem {
+
+public:
+	static constexpr int MAX_THREADS = 64;
+
+	typedef std::function<void(int begin, int end, int thread)> RangeFunc;
+
+	JobSystem();
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Threads to run on, including the calling one
+	void SetThreadCount(int count);
+	int ThreadCount() const { return (int)queues.size(); }
+
+	// One thread per hardware thread
+	static int DefaultThreadCount();
+
+	/**
+		Calls func(begin, end, thread) on batches covering [0, count) and returns
+		once all of them are done. thread is in [0, ThreadCount()), for indexing
+		per-thread scratch data. Not reentrant, func can't call ParallelFor.
+
+		\param minBatch Smallest batch worth handing to another thread.
+	*/
+	template <typename Func>
+	void ParallelFor(int count, int minBatch, const Func& func)
+	{
+		// Only a reference to func goes in the std::function, so it fits in its
+		// small buffer and doesn't allocate
+		Run(count, minBatch, RangeFunc([&func](int begin, int end, int thread) { func(begin, end, thread); }));
+	}
+
+private:
+	struct Batch {
+		int begin, end;
+	};
+
+	// Filled before the threads start, then only ever popped from, so it's an
+	// array with two cursors: the owner pops at head, thieves at tail
+	struct Queue {
+		std::mutex mutex;
+		std::vector<Batch> batches;
+		int head = 0, tail = 0;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+
+	// Workers sleep on wakeCondition until the generation changes
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+	uint64_t generation = 0;
+	bool quit = false;
+
+	const RangeFunc* currentFunc = nullptr;
+	std::atomic<int> remainingBatches;
+
+	void Run(int count, int minBatch, const RangeFunc& func);
+	void WorkerLoop(int thread);
+	void RunBatches(int thread);
+	bool PopBatch(int thread, Batch& outBatch);
+	void StopWorkers();
+
+};
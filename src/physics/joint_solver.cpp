@@ -0,0 +1,457 @@
+#include "joint_solver.h"
+
+#include "body_math.h"
+#include <algorithm>
+#include <cmath>
+
+const char* JointTypeName(JointType type)
+{
+	switch (type)
+	{
+	case JointType::Distance:	return "Distance";
+	case JointType::Revolute:	return "Revolute";
+	case JointType::Weld:		return "Weld";
+	default:					return "Unknown";
+	}
+}
+
+namespace {
+
+uint64_t PairKey(int bodyA, int bodyB)
+{
+	return ((uint64_t)std::min(bodyA, bodyB) << 32) | (uint32_t)std::max(bodyA, bodyB);
+}
+
+}
+
+int JointSolver::AddDistance(const BodyStore& bodies, BodyHandle bodyA, BodyHandle bodyB, Vector2 anchorA, Vector2 anchorB)
+{
+	Joint joint;
+	joint.type = JointType::Distance;
+	joint.bodyA = bodyA;
+	joint.bodyB = bodyB;
+	Vector2 localA = ToLocal(bodies, bodies.IndexOf(bodyA), anchorA);
+	Vector2 localB = ToLocal(bodies, bodies.IndexOf(bodyB), anchorB);
+	joint.localAnchorAx = localA.x; joint.localAnchorAy = localA.y;
+	joint.localAnchorBx = localB.x; joint.localAnchorBy = localB.y;
+	float dx = anchorB.x - anchorA.x, dy = anchorB.y - anchorA.y;
+	joint.length = sqrtf(dx * dx + dy * dy);
+
+	joints.push_back(joint);
+	return Count() - 1;
+}
+
+int JointSolver::AddRevolute(const BodyStore& bodies, BodyHandle bodyA, BodyHandle bodyB, Vector2 anchor)
+{
+	Joint joint;
+	joint.type = JointType::Revolute;
+	joint.bodyA = bodyA;
+	joint.bodyB = bodyB;
+	Vector2 localA = ToLocal(bodies, bodies.IndexOf(bodyA), anchor);
+	Vector2 localB = ToLocal(bodies, bodies.IndexOf(bodyB), anchor);
+	joint.localAnchorAx = localA.x; joint.localAnchorAy = localA.y;
+	joint.localAnchorBx = localB.x; joint.localAnchorBy = localB.y;
+
+	joints.push_back(joint);
+	return Count() - 1;
+}
+
+int JointSolver::AddWeld(const BodyStore& bodies, BodyHandle bodyA, BodyHandle bodyB, Vector2 anchor)
+{
+	int index = AddRevolute(bodies, bodyA, bodyB, anchor);
+	Joint& joint = joints[index];
+	joint.type = JointType::Weld;
+	joint.referenceAngle = bodies.rotation[bodies.IndexOf(bodyB)] - bodies.rotation[bodies.IndexOf(bodyA)];
+	return index;
+}
+
+void JointSolver::Remove(int joint)
+{
+	joints[joint] = joints.back();
+	joints.pop_back();
+}
+
+void JointSolver::Reset()
+{
+	joints.clear();
+	constraints.clear();
+	connected.clear();
+	colorStart.assign(1, 0);
+}
+
+void JointSolver::GetWorldAnchors(const BodyStore& bodies, int joint, RVector3& outAnchorA, RVector3& outAnchorB) const
+{
+	const Joint& j = joints[joint];
+	int a = bodies.IndexOf(j.bodyA), b = bodies.IndexOf(j.bodyB);
+	Vector2 rA = Rotate(j.localAnchorAx, j.localAnchorAy, bodies.rotation[a]);
+	Vector2 rB = Rotate(j.localAnchorBx, j.localAnchorBy, bodies.rotation[b]);
+	outAnchorA = RVector3(bodies.position.x[a] + rA.x, bodies.position.y[a] + rA.y, bodies.position.z[a]);
+	outAnchorB = RVector3(bodies.position.x[b] + rB.x, bodies.position.y[b] + rB.y, bodies.position.z[b]);
+}
+
+float JointSolver::PositionError(const BodyStore& bodies, int joint) const
+{
+	RVector3 anchorA, anchorB;
+	GetWorldAnchors(bodies, joint, anchorA, anchorB);
+	float dx = anchorB.x - anchorA.x, dy = anchorB.y - anchorA.y;
+	float distance = sqrtf(dx * dx + dy * dy);
+	return joints[joint].type == JointType::Distance ? fabsf(distance - joints[joint].length) : distance;
+}
+
+void JointSolver::Begin(const BodyStore& bodies)
+{
+	for (int i = 0; i < Count();)
+	{
+		if (bodies.IsValid(joints[i].bodyA) && bodies.IsValid(joints[i].bodyB))
+			i++;
+		else
+			Remove(i);
+	}
+
+	constraints.clear();
+	connected.clear();
+	for (int i = 0; i < Count(); i++)
+	{
+		const Joint& joint = joints[i];
+		int a = bodies.IndexOf(joint.bodyA), b = bodies.IndexOf(joint.bodyB);
+		if (!joint.collideConnected)
+			connected.push_back(PairKey(a, b));
+		if (!bodies.IsDynamic(a) && !bodies.IsDynamic(b))
+			continue;
+
+		JointConstraint c = {};
+		c.joint = i;
+		c.type = joint.type;
+		c.bodyA = a;
+		c.bodyB = b;
+		constraints.push_back(c);
+	}
+	std::sort(connected.begin(), connected.end());
+}
+
+bool JointSolver::IsConnected(int bodyA, int bodyB) const
+{
+	return !connected.empty() && std::binary_search(connected.begin(), connected.end(), PairKey(bodyA, bodyB));
+}
+
+void JointSolver::Prepare(const BodyStore& bodies)
+{
+	// Joints between sleeping or static bodies have nothing to do
+	constraints.erase(std::remove_if(constraints.begin(), constraints.end(), [&](const JointConstraint& c) {
+		return !bodies.IsActive(c.bodyA) && !bodies.IsActive(c.bodyB);
+	}), constraints.end());
+
+	for (JointConstraint& c : constraints)
+		PrepareConstraint(bodies, c);
+	Color(bodies.Size());
+}
+
+void JointSolver::PrepareConstraint(const BodyStore& bodies, JointConstraint& c)
+{
+	const Joint& joint = joints[c.joint];
+	int a = c.bodyA, b = c.bodyB;
+	bool activeA = bodies.IsActive(a), activeB = bodies.IsActive(b);
+	c.invMassA = activeA ? bodies.inverseMass[a] : 0.0f;
+	c.invMOIA = activeA ? bodies.inverseMOI[a] : 0.0f;
+	c.invMassB = activeB ? bodies.inverseMass[b] : 0.0f;
+	c.invMOIB = activeB ? bodies.inverseMOI[b] : 0.0f;
+
+	Vector2 rA = Rotate(joint.localAnchorAx, joint.localAnchorAy, bodies.rotation[a]);
+	Vector2 rB = Rotate(joint.localAnchorBx, joint.localAnchorBy, bodies.rotation[b]);
+	c.rAx = rA.x; c.rAy = rA.y;
+	c.rBx = rB.x; c.rBy = rB.y;
+
+	// How far B's anchor is from A's
+	float dx = bodies.position.x[b] + rB.x - bodies.position.x[a] - rA.x;
+	float dy = bodies.position.y[b] + rB.y - bodies.position.y[a] - rA.y;
+	float mA = c.invMassA, mB = c.invMassB, iA = c.invMOIA, iB = c.invMOIB;
+
+	if (c.type == JointType::Distance)
+	{
+		float distance = sqrtf(dx * dx + dy * dy);
+		c.axisX = distance > 1e-6f ? dx / distance : 1.0f;
+		c.axisY = distance > 1e-6f ? dy / distance : 0.0f;
+		float crA = c.rAx * c.axisY - c.rAy * c.axisX;
+		float crB = c.rBx * c.axisY - c.rBy * c.axisX;
+		float k = mA + mB + iA * crA * crA + iB * crB * crB;
+		c.mass = k > 0.0f ? 1.0f / k : 0.0f;
+	}
+	else
+	{
+		// Effective mass matrix of the anchors' relative velocity, inverted once here
+		float k11 = mA + mB + iA * c.rAy * c.rAy + iB * c.rBy * c.rBy;
+		float k12 = -iA * c.rAx * c.rAy - iB * c.rBx * c.rBy;
+		float k22 = mA + mB + iA * c.rAx * c.rAx + iB * c.rBx * c.rBx;
+		float det = k11 * k22 - k12 * k12;
+		det = det != 0.0f ? 1.0f / det : 0.0f;
+		c.pointMass11 = det * k22;
+		c.pointMass12 = -det * k12;
+		c.pointMass22 = det * k11;
+
+		if (c.type == JointType::Weld)
+		{
+			float k = iA + iB;
+			c.mass = k > 0.0f ? 1.0f / k : 0.0f;
+		}
+	}
+
+	c.impulseX = warmStarting ? joint.impulseX : 0.0f;
+	c.impulseY = warmStarting ? joint.impulseY : 0.0f;
+	c.impulse = warmStarting ? joint.impulse : 0.0f;
+}
+
+/**
+	Greedy graph coloring: each constraint gets the first color neither of its
+	dynamic bodies is in yet. Static & sleeping bodies are only read, so they can
+	be in any number of constraints of the same color. The constraints are then
+	moved so each color is contiguous, keeping their order within it.
+*/
+void JointSolver::Color(int bodyCount)
+{
+	int count = (int)constraints.size();
+	bodyColors.assign(bodyCount, 0);
+	constraintColor.resize(count);
+
+	int colorCounts[MAX_COLORS + 1] = {};
+	int colorsUsed = 0;
+	for (int i = 0; i < count; i++)
+	{
+		const JointConstraint& c = constraints[i];
+		bool dynamicA = c.invMassA > 0.0f || c.invMOIA > 0.0f;
+		bool dynamicB = c.invMassB > 0.0f || c.invMOIB > 0.0f;
+		uint32_t used = (dynamicA ? bodyColors[c.bodyA] : 0) | (dynamicB ? bodyColors[c.bodyB] : 0);
+
+		int color = 0;
+		while (color < MAX_COLORS && (used >> color) & 1)
+			color++;
+		if (color < MAX_COLORS)
+		{
+			if (dynamicA) bodyColors[c.bodyA] |= 1u << color;
+			if (dynamicB) bodyColors[c.bodyB] |= 1u << color;
+			colorsUsed = std::max(colorsUsed, color + 1);
+		}
+		constraintColor[i] = (uint8_t)color;
+		colorCounts[color]++;
+	}
+
+	// Counting sort, the ones that didn't fit go last
+	colorStart.assign(colorsUsed + 1, 0);
+	int offsets[MAX_COLORS + 1];
+	int offset = 0;
+	for (int color = 0; color <= MAX_COLORS; color++)
+	{
+		if (color < colorsUsed)
+			colorStart[color] = offset;
+		offsets[color] = offset;
+		offset += colorCounts[color];
+	}
+	colorStart[colorsUsed] = count - colorCounts[MAX_COLORS];
+
+	sorted.resize(count);
+	for (int i = 0; i < count; i++)
+		sorted[offsets[constraintColor[i]]++] = constraints[i];
+	std::swap(constraints, sorted);
+}
+
+template <typename Func>
+void JointSolver::ForEachColor(JobSystem& jobs, Func func)
+{
+	for (int color = 0; color < ColorCount(); color++)
+	{
+		int begin = colorStart[color];
+		jobs.ParallelFor(colorStart[color + 1] - begin, 64, [&](int first, int end, int) {
+			for (int i = begin + first; i < begin + end; i++)
+				func(constraints[i]);
+		});
+	}
+
+	for (int i = colorStart.back(); i < (int)constraints.size(); i++)
+		func(constraints[i]);
+}
+
+void JointSolver::WarmStart(BodyStore& bodies, JobSystem& jobs)
+{
+	if (warmStarting)
+		ForEachColor(jobs, [&](JointConstraint& c) { WarmStartConstraint(bodies, c); });
+}
+
+void JointSolver::WarmStartConstraint(BodyStore& bodies, JointConstraint& c)
+{
+	int a = c.bodyA, b = c.bodyB;
+	float vAx = bodies.velocity.x[a], vAy = bodies.velocity.y[a], wA = bodies.angularVelocity[a];
+	float vBx = bodies.velocity.x[b], vBy = bodies.velocity.y[b], wB = bodies.angularVelocity[b];
+
+	float px = c.impulseX, py = c.impulseY, angular = 0.0f;
+	if (c.type == JointType::Distance)
+	{
+		px = c.impulse * c.axisX;
+		py = c.impulse * c.axisY;
+	}
+	else if (c.type == JointType::Weld)
+		angular = c.impulse;
+
+	vAx -= px * c.invMassA;
+	vAy -= py * c.invMassA;
+	wA -= c.invMOIA * (c.rAx * py - c.rAy * px + angular);
+	vBx += px * c.invMassB;
+	vBy += py * c.invMassB;
+	wB += c.invMOIB * (c.rBx * py - c.rBy * px + angular);
+
+	StoreVelocities(bodies, c, vAx, vAy, wA, vBx, vBy, wB);
+}
+
+void JointSolver::SolveConstraint(BodyStore& bodies, JointConstraint& c)
+{
+	int a = c.bodyA, b = c.bodyB;
+	float vAx = bodies.velocity.x[a], vAy = bodies.velocity.y[a], wA = bodies.angularVelocity[a];
+	float vBx = bodies.velocity.x[b], vBy = bodies.velocity.y[b], wB = bodies.angularVelocity[b];
+
+	// The angle first, so the anchors are solved with the bodies' final spin
+	if (c.type == JointType::Weld)
+	{
+		float lambda = -c.mass * (wB - wA);
+		c.impulse += lambda;
+		wA -= c.invMOIA * lambda;
+		wB += c.invMOIB * lambda;
+	}
+
+	// Relative velocity of the anchors (lever arm formula)
+	float dvx = vBx - wB * c.rBy - vAx + wA * c.rAy;
+	float dvy = vBy + wB * c.rBx - vAy - wA * c.rAx;
+
+	float px, py;
+	if (c.type == JointType::Distance)
+	{
+		float lambda = -c.mass * (dvx * c.axisX + dvy * c.axisY);
+		c.impulse += lambda;
+		px = lambda * c.axisX;
+		py = lambda * c.axisY;
+	}
+	else
+	{
+		px = -(c.pointMass11 * dvx + c.pointMass12 * dvy);
+		py = -(c.pointMass12 * dvx + c.pointMass22 * dvy);
+		c.impulseX += px;
+		c.impulseY += py;
+	}
+
+	vAx -= px * c.invMassA;
+	vAy -= py * c.invMassA;
+	wA -= c.invMOIA * (c.rAx * py - c.rAy * px);
+	vBx += px * c.invMassB;
+	vBy += py * c.invMassB;
+	wB += c.invMOIB * (c.rBx * py - c.rBy * px);
+
+	StoreVelocities(bodies, c, vAx, vAy, wA, vBx, vBy, wB);
+}
+
+void JointSolver::StoreVelocities(BodyStore& bodies, const JointConstraint& c,
+	float vAx, float vAy, float wA, float vBx, float vBy, float wB)
+{
+	// Static & sleeping bodies can be in several constraints of a color, leave them be
+	if (c.invMassA > 0.0f || c.invMOIA > 0.0f)
+	{
+		bodies.velocity.x[c.bodyA] = vAx; bodies.velocity.y[c.bodyA] = vAy; bodies.angularVelocity[c.bodyA] = wA;
+	}
+	if (c.invMassB > 0.0f || c.invMOIB > 0.0f)
+	{
+		bodies.velocity.x[c.bodyB] = vBx; bodies.velocity.y[c.bodyB] = vBy; bodies.angularVelocity[c.bodyB] = wB;
+	}
+}
+
+void JointSolver::SolveVelocities(BodyStore& bodies, JobSystem& jobs)
+{
+	ForEachColor(jobs, [&](JointConstraint& c) { SolveConstraint(bodies, c); });
+}
+
+void JointSolver::SolvePositions(BodyStore& bodies, JobSystem& jobs)
+{
+	for (int it = 0; it < positionIterations; it++)
+		ForEachColor(jobs, [&](JointConstraint& c) { SolvePosition(bodies, c); });
+}
+
+/**
+	Moves the two bodies straight to where the joint is satisfied, as far as one
+	linearized step gets them, with the anchors & effective mass worked out again
+	from where the bodies are now.
+*/
+void JointSolver::SolvePosition(BodyStore& bodies, const JointConstraint& c)
+{
+	const Joint& joint = joints[c.joint];
+	int a = c.bodyA, b = c.bodyB;
+	float xA = bodies.position.x[a], yA = bodies.position.y[a], angleA = bodies.rotation[a];
+	float xB = bodies.position.x[b], yB = bodies.position.y[b], angleB = bodies.rotation[b];
+	float mA = c.invMassA, mB = c.invMassB, iA = c.invMOIA, iB = c.invMOIB;
+
+	if (c.type == JointType::Weld)
+	{
+		float error = angleB - angleA - joint.referenceAngle;
+		float correction = std::max(-maxAngularCorrection, std::min(error, maxAngularCorrection));
+		float lambda = iA + iB > 0.0f ? -correction / (iA + iB) : 0.0f;
+		angleA -= iA * lambda;
+		angleB += iB * lambda;
+	}
+
+	Vector2 rA = Rotate(joint.localAnchorAx, joint.localAnchorAy, angleA);
+	Vector2 rB = Rotate(joint.localAnchorBx, joint.localAnchorBy, angleB);
+	float dx = xB + rB.x - xA - rA.x;
+	float dy = yB + rB.y - yA - rA.y;
+
+	float px, py;
+	if (c.type == JointType::Distance)
+	{
+		float distance = sqrtf(dx * dx + dy * dy);
+		float ux = distance > 1e-6f ? dx / distance : 1.0f;
+		float uy = distance > 1e-6f ? dy / distance : 0.0f;
+		float crA = rA.x * uy - rA.y * ux;
+		float crB = rB.x * uy - rB.y * ux;
+		float k = mA + mB + iA * crA * crA + iB * crB * crB;
+		float error = std::max(-maxLinearCorrection, std::min(distance - joint.length, maxLinearCorrection));
+		float lambda = k > 0.0f ? -error / k : 0.0f;
+		px = lambda * ux;
+		py = lambda * uy;
+	}
+	else
+	{
+		float length = sqrtf(dx * dx + dy * dy);
+		if (length > maxLinearCorrection)
+		{
+			dx *= maxLinearCorrection / length;
+			dy *= maxLinearCorrection / length;
+		}
+		float k11 = mA + mB + iA * rA.y * rA.y + iB * rB.y * rB.y;
+		float k12 = -iA * rA.x * rA.y - iB * rB.x * rB.y;
+		float k22 = mA + mB + iA * rA.x * rA.x + iB * rB.x * rB.x;
+		float det = k11 * k22 - k12 * k12;
+		det = det != 0.0f ? 1.0f / det : 0.0f;
+		px = -det * (k22 * dx - k12 * dy);
+		py = -det * (k11 * dy - k12 * dx);
+	}
+
+	xA -= px * mA;
+	yA -= py * mA;
+	angleA -= iA * (rA.x * py - rA.y * px);
+	xB += px * mB;
+	yB += py * mB;
+	angleB += iB * (rB.x * py - rB.y * px);
+
+	if (mA > 0.0f || iA > 0.0f)
+	{
+		bodies.position.x[a] = xA; bodies.position.y[a] = yA; bodies.rotation[a] = angleA;
+	}
+	if (mB > 0.0f || iB > 0.0f)
+	{
+		bodies.position.x[b] = xB; bodies.position.y[b] = yB; bodies.rotation[b] = angleB;
+	}
+}
+
+void JointSolver::StoreImpulses()
+{
+	for (const JointConstraint& c : constraints)
+	{
+		Joint& joint = joints[c.joint];
+		joint.impulseX = c.impulseX;
+		joint.impulseY = c.impulseY;
+		joint.impulse = c.impulse;
+	}
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "raylib-cpp.hpp"
+#include "body_store.h"
+#include "job_system.h"
+#include "snapshot.h"
+#include <vector>
+#include <cstdint>
+
+enum class JointType {
+	Distance = 0,	// keeps the two anchors the same distance apart, like a rod
+	Revolute,		// pins the anchors together, the bodies turn freely about them
+	Weld,			// pins the anchors together & keeps the bodies' relative angle
+	Count
+};
+
+const char* JointTypeName(JointType type);
+
+/**
+	A joint between two bodies, kept from step to step. Anchors are relative to
+	each body's center, unrotated, so they move & turn with the body.
+
+	The impulses it ended the last step with are kept here too, for warm starting.
+	The point impulse is in world space, the other one along the distance axis or
+	about Z for welds.
+*/
+struct Joint {
+	JointType type = JointType::Revolute;
+	BodyHandle bodyA, bodyB;
+	float localAnchorAx = 0.0f, localAnchorAy = 0.0f;
+	float localAnchorBx = 0.0f, localAnchorBy = 0.0f;
+	float length = 0.0f;			// distance joints
+	float referenceAngle = 0.0f;	// weld joints, B's rotation minus A's
+	bool collideConnected = false;	// whether the two bodies still collide
+
+	float impulseX = 0.0f, impulseY = 0.0f;
+	float impulse = 0.0f;
+};
+
+/**
+	A joint prepared for this step's solve: dense body indices, anchors in world
+	space & effective masses, worked out once in Prepare and reused every iteration.
+
+	Revolute & weld joints solve the anchors' relative velocity with the inverse of
+	its 2x2 effective mass matrix (pointMass), weld joints solve the angle first on
+	its own. Distance joints only have the one axis.
+*/
+struct JointConstraint {
+	int joint;				// index into JointSolver::joints
+	JointType type;
+	int bodyA, bodyB;
+	float invMassA, invMassB;	// zero for sleeping bodies, the solver leaves them alone
+	float invMOIA, invMOIB;
+	float rAx, rAy, rBx, rBy;	// anchors relative to the bodies' centers
+
+	float pointMass11, pointMass12, pointMass22;
+
+	float axisX, axisY;		// distance joints, unit from A's anchor to B's
+	float mass;				// along the axis, or for the angle
+
+	float impulseX, impulseY;
+	float impulse;
+};
+
+/**
+	Distance, revolute & weld joints, solved with sequential impulses in the same
+	velocity iterations as the contacts (see ContactSolver), each iteration going
+	over the joints and then the contacts. Unlike contacts there's no Baumgarte
+	bias: pushing a long chain back together through its velocities whips it
+	apart at 60Hz, so drift is corrected after positions are integrated instead,
+	by moving the bodies directly a few times (SolvePositions).
+
+	Joints are stored in one compact array, removing one moves the last into its
+	place like BodyStore does. Joints whose bodies have been removed are dropped
+	at the start of the next step.
+
+	To solve on several threads, each step's constraints are sorted into colors:
+	batches in which no two constraints share a dynamic body, so every constraint
+	in a batch can be solved at the same time. A chain takes two colors, however
+	long it is, where grouping by island (as contacts are) would solve it on one
+	thread. Colors are assigned greedily in joint order and solved one after the
+	other, so the results don't depend on the number of threads.
+*/
+class JointSolver {
+
+public:
+	static constexpr int MAX_COLORS = 32;	// joints that don't fit in any are solved on one thread
+
+	bool warmStarting = true;
+	int positionIterations = 3;
+	float maxLinearCorrection = 0.2f;		// most a position iteration moves a body
+	float maxAngularCorrection = 0.14f;		// ... or turns it, in radians
+
+	std::vector<Joint> joints;
+	std::vector<JointConstraint> constraints;	// this step's, sorted by color
+
+	// Anchors are in world space, where the bodies are now. Returns the joint's index
+	int AddDistance(const BodyStore& bodies, BodyHandle bodyA, BodyHandle bodyB, Vector2 anchorA, Vector2 anchorB);
+	int AddRevolute(const BodyStore& bodies, BodyHandle bodyA, BodyHandle bodyB, Vector2 anchor);
+	int AddWeld(const BodyStore& bodies, BodyHandle bodyA, BodyHandle bodyB, Vector2 anchor);
+	void Remove(int joint);
+	void Reset();
+
+	int Count() const { return (int)joints.size(); }
+	int ColorCount() const { return (int)colorStart.size() - 1; }
+
+	// How far a joint is from being satisfied: the gap between the anchors, or
+	// for distance joints how far off the length they are. Welds' angles aren't counted
+	float PositionError(const BodyStore& bodies, int joint) const;
+	void GetWorldAnchors(const BodyStore& bodies, int joint, RVector3& outAnchorA, RVector3& outAnchorB) const;
+
+	/**
+		Drops joints to removed bodies and makes a constraint per joint with at
+		least one dynamic body, with its bodies' dense indices. Also lists the body
+		pairs that mustn't collide, for IsConnected.
+	*/
+	void Begin(const BodyStore& bodies);
+
+	// Whether two bodies (dense indices) have a joint between them that keeps them from colliding
+	bool IsConnected(int bodyA, int bodyB) const;
+
+	// Computes effective masses, fetches the joints' impulses & sorts the
+	// constraints into colors. Bodies that aren't active count as static
+	void Prepare(const BodyStore& bodies);
+	void WarmStart(BodyStore& bodies, JobSystem& jobs);
+	// One iteration over every constraint, color by color
+	void SolveVelocities(BodyStore& bodies, JobSystem& jobs);
+	// Moves bodies back together after they've been moved, see SolvePosition
+	void SolvePositions(BodyStore& bodies, JobSystem& jobs);
+	// Keeps the final impulses in the joints for the next step
+	void StoreImpulses();
+
+	// The joints, with their impulses, for world snapshots
+	void SaveState(SnapshotWriter& writer) const { writer.Array(joints); }
+	bool RestoreState(SnapshotReader& reader) { return reader.Array(joints); }
+
+private:
+	// Constraints of color i are constraints[colorStart[i]] up to colorStart[i + 1],
+	// the ones that didn't fit in MAX_COLORS come after colorStart.back()
+	std::vector<int> colorStart = { 0 };
+	std::vector<uint32_t> bodyColors;		// per body, bit i set if it's in color i
+	std::vector<uint8_t> constraintColor;
+	std::vector<JointConstraint> sorted;
+
+	// Body pairs (lower index in the high bits) of joints that don't collide, sorted
+	std::vector<uint64_t> connected;
+
+	void Color(int bodyCount);
+
+	// Calls func(constraint) for every constraint, a color at a time on the job system
+	template <typename Func>
+	void ForEachColor(JobSystem& jobs, Func func);
+
+	void PrepareConstraint(const BodyStore& bodies, JointConstraint& c);
+	void WarmStartConstraint(BodyStore& bodies, JointConstraint& c);
+	void SolveConstraint(BodyStore& bodies, JointConstraint& c);
+	void SolvePosition(BodyStore& bodies, const JointConstraint& c);
+	void StoreVelocities(BodyStore& bodies, const JointConstraint& c,
+		float vAx, float vAy, float wA, float vBx, float vBy, float wB);
+
+};
@@ -0,0 +1,390 @@
+#include "physics_world.h"
+
+#include <float.h>
+#include <algorithm>
+#include <cmath>
+
+/*
+	Contacts between every pair of shape types. Every shape is a convex core
+	rounded by a radius (see Shape), which leaves three tests: two circles,
+	a core against a circle, and two cores with at least an edge each (capsules
+	& polygons). CollideShapes picks one from a table by the two types.
+*/
+
+static inline float Dot2(Vector3 a, Vector3 b)
+{
+	return a.x * b.x + a.y * b.y;
+}
+
+/**
+	Finds the edge normal of polygon 1 along which polygon 2 is furthest out.
+	Returns as soon as an axis separating them by more than maxDistance is found.
+*/
+static float FindMaxSeparation(
+	const RVector3* vertices1, const RVector3* normals1, int nVerts1,
+	const RVector3* vertices2, int nVerts2,
+	float maxDistance, int& outEdge)
+{
+	float maxSeparation = -FLT_MAX;
+	outEdge = 0;
+	for (int i = 0; i < nVerts1; i++)
+	{
+		// Deepest vertex of polygon 2 along this normal
+		float separation = FLT_MAX;
+		for (int j = 0; j < nVerts2; j++)
+			separation = std::min(separation, Dot2(normals1[i], vertices2[j] - vertices1[i]));
+
+		if (separation > maxSeparation)
+		{
+			maxSeparation = separation;
+			outEdge = i;
+			if (separation > maxDistance)
+				break; // separating axis, no collision
+		}
+	}
+	return maxSeparation;
+}
+
+/**
+	Clips a segment to the half plane dot(normal, p) <= offset. Returns the number of
+	points left, which is 2 unless the whole segment was outside.
+*/
+static int ClipSegmentToLine(RVector3 out[2], const RVector3 in[2], RVector3 normal, float offset)
+{
+	int count = 0;
+	float d0 = Dot2(normal, in[0]) - offset;
+	float d1 = Dot2(normal, in[1]) - offset;
+
+	if (d0 <= 0) out[count++] = in[0];
+	if (d1 <= 0) out[count++] = in[1];
+
+	// Points are on opposite sides, add the intersection
+	if (d0 * d1 < 0)
+		out[count++] = in[0] + (in[1] - in[0]) * (d0 / (d0 - d1));
+
+	return count;
+}
+
+// Closest point to p on the segment from a to b, at outT along it
+static RVector3 ClosestOnSegment(RVector3 p, RVector3 a, RVector3 b, float& outT)
+{
+	RVector3 ab = b - a;
+	float lengthSqr = Dot2(ab, ab);
+	float t = lengthSqr > 0.0f ? Dot2(p - a, ab) / lengthSqr : 0.0f;
+	outT = std::max(0.0f, std::min(t, 1.0f));
+	return a + ab * outT;
+}
+
+// Closest points between two cores that don't overlap, and the vertices they're
+// at (-1 for the middle of an edge)
+struct ClosestFeatures {
+	RVector3 point1, point2;
+	int vertex1 = -1, vertex2 = -1;
+};
+
+/**
+	Checks every vertex of each core against every edge of the other, which
+	finds the closest points of two convex cores as long as they don't overlap.
+	Returns the distance between them.
+*/
+static float FindClosestFeatures(const WorldShape& shape1, const WorldShape& shape2, ClosestFeatures& out)
+{
+	float bestSqr = FLT_MAX;
+	auto search = [&](const WorldShape& from, const WorldShape& to, bool swapped) {
+		// A segment's two edges are the same one, a point's only edge has no length
+		int edges = to.count <= 2 ? 1 : to.count;
+		for (int i = 0; i < from.count; i++)
+		{
+			for (int j = 0; j < edges; j++)
+			{
+				int next = (j + 1) % to.count;
+				float t;
+				RVector3 closest = ClosestOnSegment(from.vertices[i], to.vertices[j], to.vertices[next], t);
+				RVector3 offset = closest - from.vertices[i];
+				float distanceSqr = Dot2(offset, offset);
+				if (distanceSqr >= bestSqr)
+					continue;
+
+				bestSqr = distanceSqr;
+				int corner = t <= 0.0f ? j : t >= 1.0f ? next : -1;
+				out.point1 = swapped ? closest : from.vertices[i];
+				out.point2 = swapped ? from.vertices[i] : closest;
+				out.vertex1 = swapped ? corner : i;
+				out.vertex2 = swapped ? i : corner;
+			}
+		}
+	};
+	search(shape1, shape2, false);
+	search(shape2, shape1, true);
+	return sqrtf(bestSqr);
+}
+
+bool PhysicsWorld::CollideCircles(const WorldShape& circle1, const WorldShape& circle2, ContactManifold& outManifold) const
+{
+	outManifold.pointCount = 0;
+	RVector3 center1 = circle1.vertices[0], center2 = circle2.vertices[0];
+	RVector3 offset = center2 - center1;
+	float distance = sqrtf(Dot2(offset, offset));
+	float separation = distance - circle1.radius - circle2.radius;
+	if (separation > SPECULATIVE_DISTANCE)
+		return false;
+
+	// Right on top of each other, any direction will do
+	RVector3 normal = distance > FLT_EPSILON ? RVector3(offset.x / distance, offset.y / distance, 0) : RVector3(0, 1, 0);
+
+	// Halfway between the two surfaces
+	RVector3 surface1 = center1 + normal * circle1.radius;
+	RVector3 surface2 = center2 - normal * circle2.radius;
+	outManifold.normal = normal;
+	outManifold.pointCount = 1;
+	outManifold.points[0] = { (surface1 + surface2) * 0.5f, -separation, 0 };
+	return true;
+}
+
+/**
+	A core (polygon or capsule) against a circle: the circle's center against
+	the edge it's furthest out from, or one of that edge's ends if it's past
+	them (like Box2D's b2CollidePolygonAndCircle).
+
+	\param outManifold One contact, with the normal pointing from the polygon to the circle.
+*/
+bool PhysicsWorld::CollidePolygonCircle(const WorldShape& polygon, const WorldShape& circle, ContactManifold& outManifold) const
+{
+	outManifold.pointCount = 0;
+	RVector3 center = circle.vertices[0];
+	float totalRadius = polygon.radius + circle.radius;
+
+	int edge = 0;
+	float maxSeparation = -FLT_MAX;
+	for (int i = 0; i < polygon.count; i++)
+	{
+		float separation = Dot2(polygon.normals[i], center - polygon.vertices[i]);
+		if (separation > maxSeparation)
+		{
+			maxSeparation = separation;
+			edge = i;
+		}
+	}
+	if (maxSeparation > totalRadius + SPECULATIVE_DISTANCE)
+		return false;
+
+	int next = (edge + 1) % polygon.count;
+	float t;
+	RVector3 closest = ClosestOnSegment(center, polygon.vertices[edge], polygon.vertices[next], t);
+
+	// Inside a polygon or beside the edge, straight out of the edge. A segment
+	// has no inside, a center in line with it is off one end
+	RVector3 normal;
+	float distance;
+	uint32_t id;
+	bool inside = polygon.count >= 3 && maxSeparation <= 0.0f;
+	if (inside || (t > 0.0f && t < 1.0f))
+	{
+		normal = polygon.normals[edge];
+		distance = maxSeparation;
+		id = (uint32_t)edge << 8;
+	}
+	else
+	{
+		RVector3 offset = center - closest;
+		distance = sqrtf(Dot2(offset, offset));
+		normal = distance > FLT_EPSILON ? RVector3(offset.x / distance, offset.y / distance, 0) : polygon.normals[edge];
+		id = (1u << 17) | ((uint32_t)(t <= 0.0f ? edge : next) << 8);
+	}
+
+	float separation = distance - totalRadius;
+	if (separation > SPECULATIVE_DISTANCE)
+		return false;
+
+	RVector3 core = center - normal * distance;
+	RVector3 surface1 = core + normal * polygon.radius;
+	RVector3 surface2 = center - normal * circle.radius;
+	outManifold.normal = normal;
+	outManifold.pointCount = 1;
+	outManifold.points[0] = { (surface1 + surface2) * 0.5f, -separation, id };
+	return true;
+}
+
+// The same, the other way around
+bool PhysicsWorld::CollideCirclePolygon(const WorldShape& circle, const WorldShape& polygon, ContactManifold& outManifold) const
+{
+	if (!CollidePolygonCircle(polygon, circle, outManifold))
+		return false;
+
+	outManifold.normal = -outManifold.normal;
+	outManifold.points[0].id |= 1u << 16;
+	return true;
+}
+
+/**
+	Separating axis test between two convex cores with edges (polygons, or
+	capsules' segments). If they're close enough, the reference face is the
+	edge with the least penetration, the most anti-parallel edge of the other
+	core is clipped against its side planes, and the clipped points behind the
+	reference face become the contact points, moved out by the radii.
+
+	Rounded cores that are apart can be closest corner to corner, where no edge
+	normal points the right way and SAT underestimates the gap. Those get a
+	single contact along the line between the corners instead.
+
+	Both cores must be wound clockwise with outward edge normals, normal i
+	belonging to the edge from vertex i to vertex i + 1.
+
+	\param outManifold The contacts, with the normal pointing from polygon 1 to polygon 2.
+*/
+bool PhysicsWorld::CollidePolygons(const WorldShape& polygon1, const WorldShape& polygon2, ContactManifold& outManifold) const
+{
+	outManifold.pointCount = 0;
+	const RVector3 *vertices1 = polygon1.vertices, *normals1 = polygon1.normals;
+	const RVector3 *vertices2 = polygon2.vertices, *normals2 = polygon2.normals;
+	int nVerts1 = polygon1.count, nVerts2 = polygon2.count;
+	float totalRadius = polygon1.radius + polygon2.radius;
+	float maxDistance = SPECULATIVE_DISTANCE + totalRadius;
+
+	int edge1, edge2;
+	float separation1 = FindMaxSeparation(vertices1, normals1, nVerts1, vertices2, nVerts2, maxDistance, edge1);
+	if (separation1 > maxDistance) return false;
+	float separation2 = FindMaxSeparation(vertices2, normals2, nVerts2, vertices1, nVerts1, maxDistance, edge2);
+	if (separation2 > maxDistance) return false;
+
+	float satSeparation = std::max(separation1, separation2);
+	if (totalRadius > 0.0f && satSeparation > 0.1f * LINEAR_SLOP)
+	{
+		ClosestFeatures closest;
+		float distance = FindClosestFeatures(polygon1, polygon2, closest);
+		if (closest.vertex1 >= 0 && closest.vertex2 >= 0 && distance > satSeparation + 0.1f * LINEAR_SLOP)
+		{
+			float separation = distance - totalRadius;
+			if (separation > SPECULATIVE_DISTANCE)
+				return false;
+
+			RVector3 offset = closest.point2 - closest.point1;
+			RVector3 normal = RVector3(offset.x / distance, offset.y / distance, 0);
+			RVector3 surface1 = closest.point1 + normal * polygon1.radius;
+			RVector3 surface2 = closest.point2 - normal * polygon2.radius;
+			outManifold.normal = normal;
+			outManifold.pointCount = 1;
+			outManifold.points[0] = { (surface1 + surface2) * 0.5f, -separation,
+				(1u << 17) | ((uint32_t)closest.vertex1 << 8) | ((uint32_t)closest.vertex2 << 4) };
+			return true;
+		}
+	}
+
+	// Prefer polygon 1 as the reference so the choice doesn't flicker between frames
+	const RVector3 *refVerts = vertices1, *refNormals = normals1, *incVerts = vertices2, *incNormals = normals2;
+	int refCount = nVerts1, incCount = nVerts2, refEdge = edge1;
+	float refRadius = polygon1.radius, incRadius = polygon2.radius;
+	bool flip = false;
+	if (separation2 > separation1 + 0.1f * LINEAR_SLOP)
+	{
+		refVerts = vertices2; refNormals = normals2; refCount = nVerts2; refEdge = edge2;
+		incVerts = vertices1; incNormals = normals1; incCount = nVerts1;
+		refRadius = polygon2.radius; incRadius = polygon1.radius;
+		flip = true;
+	}
+
+	RVector3 refNormal = refNormals[refEdge];
+
+	// Incident edge, the one facing the reference face the most
+	int incEdge = 0;
+	float minDot = FLT_MAX;
+	for (int i = 0; i < incCount; i++)
+	{
+		float d = Dot2(refNormal, incNormals[i]);
+		if (d < minDot)
+		{
+			minDot = d;
+			incEdge = i;
+		}
+	}
+
+	int incNext = (incEdge + 1) % incCount;
+	RVector3 incident[2] = { incVerts[incEdge], incVerts[incNext] };
+
+	RVector3 refStart = refVerts[refEdge];
+	RVector3 refEnd = refVerts[(refEdge + 1) % refCount];
+	RVector3 tangent = RVector3(refEnd.x - refStart.x, refEnd.y - refStart.y, 0).Normalize();
+
+	// Clip to the side planes of the reference edge
+	RVector3 clip1[2], clip2[2];
+	if (ClipSegmentToLine(clip1, incident, -tangent, -Dot2(tangent, refStart)) < 2)
+		return false;
+	if (ClipSegmentToLine(clip2, clip1, tangent, Dot2(tangent, refEnd)) < 2)
+		return false;
+
+	/*
+		Feature ids: flip, reference edge, incident edge and the end of the reference
+		edge the point is closest to. Unlike incident vertex ids, these don't change
+		when a nearly aligned box drifts across the end of the reference edge, so warm
+		starting keeps working for stacks.
+	*/
+	uint32_t baseId = ((uint32_t)flip << 16) | ((uint32_t)refEdge << 8) | ((uint32_t)incEdge << 4);
+	float refMid = 0.5f * (Dot2(tangent, refStart) + Dot2(tangent, refEnd));
+
+	// Keep points behind or just in front of the reference face, placed halfway
+	// between the two surfaces
+	float frontOffset = Dot2(refNormal, refStart);
+	for (int i = 0; i < 2; i++)
+	{
+		float coreSeparation = Dot2(refNormal, clip2[i]) - frontOffset;
+		float separation = coreSeparation - totalRadius;
+		if (separation > SPECULATIVE_DISTANCE)
+			continue;
+
+		ContactPoint& point = outManifold.points[outManifold.pointCount++];
+		point.position = clip2[i] - refNormal * ((coreSeparation - refRadius + incRadius) * 0.5f);
+		point.depth = -separation;
+		point.id = baseId | (Dot2(tangent, clip2[i]) > refMid ? 1u : 0u);
+	}
+
+	// Both points on the same half of the edge, tell them apart by their order along it
+	if (outManifold.pointCount == 2 && outManifold.points[0].id == outManifold.points[1].id)
+	{
+		bool firstIsLower = Dot2(tangent, outManifold.points[0].position) < Dot2(tangent, outManifold.points[1].position);
+		outManifold.points[0].id = baseId | (firstIsLower ? 0u : 1u);
+		outManifold.points[1].id = baseId | (firstIsLower ? 1u : 0u);
+	}
+
+	outManifold.normal = flip ? -refNormal : refNormal;
+	return outManifold.pointCount > 0;
+}
+
+typedef bool (PhysicsWorld::*CollideFunction)(const WorldShape&, const WorldShape&, ContactManifold&) const;
+
+// By the first shape's type, then the second's
+static const CollideFunction COLLIDE_FUNCTIONS[(int)ShapeType::Count][(int)ShapeType::Count] = {
+	{ &PhysicsWorld::CollideCircles,		&PhysicsWorld::CollideCirclePolygon,	&PhysicsWorld::CollideCirclePolygon },
+	{ &PhysicsWorld::CollidePolygonCircle,	&PhysicsWorld::CollidePolygons,			&PhysicsWorld::CollidePolygons },
+	{ &PhysicsWorld::CollidePolygonCircle,	&PhysicsWorld::CollidePolygons,			&PhysicsWorld::CollidePolygons },
+};
+
+bool PhysicsWorld::CollideShapes(const WorldShape& shape1, const WorldShape& shape2, ContactManifold& outManifold) const
+{
+	CollideFunction collide = COLLIDE_FUNCTIONS[(int)shape1.type][(int)shape2.type];
+	return (this->*collide)(shape1, shape2, outManifold);
+}
+
+/**
+	SAT over both cores' edge normals, which is exact about whether polygons
+	overlap and never more than the gap between them. Points & segments don't
+	have the normals to cover the axes through their ends, so when one is apart
+	from anything the gap is measured exactly instead.
+*/
+float PhysicsWorld::ShapeSeparation(const WorldShape& shape1, const WorldShape& shape2)
+{
+	int edge;
+	float separation = -FLT_MAX;
+	if (shape1.count >= 2)
+		separation = FindMaxSeparation(shape1.vertices, shape1.normals, shape1.count, shape2.vertices, shape2.count, FLT_MAX, edge);
+	if (shape2.count >= 2)
+		separation = std::max(separation, FindMaxSeparation(shape2.vertices, shape2.normals, shape2.count, shape1.vertices, shape1.count, FLT_MAX, edge));
+
+	bool polygons = shape1.count >= 3 && shape2.count >= 3;
+	bool points = shape1.count < 2 && shape2.count < 2;
+	if (points || (!polygons && separation >= 0.0f))
+	{
+		ClosestFeatures closest;
+		separation = FindClosestFeatures(shape1, shape2, closest);
+	}
+	return separation - shape1.radius - shape2.radius;
+}
@@ -14,6 +14,7 @@ public:
 	float boundingRadius = 1.8f;
 
 	bool sleeping = false;
+	float sleepTime = 0.0f;		// how long the body has been (almost) still
 	bool doGravity = false;
 
 	Color color = WHITE;
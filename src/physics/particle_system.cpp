@@ -0,0 +1,348 @@
+#include "particle_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Spreads the low 16 bits of v out to the even bits
+static inline uint32_t SpreadBits(uint32_t v)
+{
+	v &= 0xFFFF;
+	v = (v | (v << 8)) & 0x00FF00FF;
+	v = (v | (v << 4)) & 0x0F0F0F0F;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+// Inverse of SpreadBits, gathers the even bits into the low 16
+static inline uint32_t CompactBits(uint32_t v)
+{
+	v &= 0x55555555;
+	v = (v | (v >> 1)) & 0x33333333;
+	v = (v | (v >> 2)) & 0x0F0F0F0F;
+	v = (v | (v >> 4)) & 0x00FF00FF;
+	v = (v | (v >> 8)) & 0x0000FFFF;
+	return v;
+}
+
+// Z-order curve index of a cell, x & y bits interleaved
+static inline uint32_t MortonCode(int x, int y)
+{
+	return SpreadBits((uint32_t)x) | (SpreadBits((uint32_t)y) << 1);
+}
+
+void ParticleSystem::Add(const Particle& particle)
+{
+	x.push_back(particle.position.x);
+	y.push_back(particle.position.y);
+	oldX.push_back(particle.position.x);
+	oldY.push_back(particle.position.y);
+	velocityX.push_back(particle.velocity.x);
+	velocityY.push_back(particle.velocity.y);
+	inverseMass.push_back(particle.inverseMass);
+	radius.push_back(particle.radius);
+	doGravity.push_back(particle.doGravity);
+	color.push_back(particle.color);
+	maxRadius = std::max(maxRadius, particle.radius);
+}
+
+void ParticleSystem::Clear()
+{
+	x.clear(); y.clear();
+	oldX.clear(); oldY.clear();
+	velocityX.clear(); velocityY.clear();
+	inverseMass.clear();
+	radius.clear();
+	doGravity.clear();
+	color.clear();
+	maxRadius = 0.0f;
+	cellCount = 0;
+	contactCount = 0;
+}
+
+void ParticleSystem::Reserve(int count)
+{
+	for (std::vector<float>* array : { &x, &y, &oldX, &oldY, &velocityX, &velocityY, &inverseMass, &radius })
+		array->reserve(count);
+	doGravity.reserve(count);
+	color.reserve(count);
+}
+
+/**
+	Sizes the cells to fit the biggest particle, and the grid to cover the bounds
+	with a power of two cells on each side so every cell has a Morton code. Cells
+	are made bigger if there'd be many more of them than particles, so the
+	counting sort stays linear in the particle count.
+*/
+void ParticleSystem::FitGrid()
+{
+	float extent = std::max(std::max(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y), 1e-3f);
+	float minCellSize = std::max(2.0f * maxRadius, 1e-3f);
+
+	int bits = 0;
+	while (bits < 16 && extent / (1 << bits) > minCellSize)
+		bits++;
+
+	uint64_t maxCells = std::max<uint64_t>(4 * (uint64_t)Size(), 4096);
+	while (bits > 0 && (1ull << (2 * bits)) > maxCells)
+		bits--;
+
+	gridBits = bits;
+	cellSize = std::max(extent / (1 << bits), minCellSize);
+}
+
+void ParticleSystem::CellCoords(float px, float py, int& outX, int& outY) const
+{
+	int last = (1 << gridBits) - 1;
+	outX = std::min(std::max((int)((px - boundsMin.x) / cellSize), 0), last);
+	outY = std::min(std::max((int)((py - boundsMin.y) / cellSize), 0), last);
+}
+
+void ParticleSystem::SortIntoCells(JobSystem& jobs)
+{
+	int n = Size();
+	FitGrid();
+	int cells = 1 << (2 * gridBits);
+
+	cellOf.resize(n);
+	jobs.ParallelFor(n, 8192, [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+		{
+			int cellX, cellY;
+			CellCoords(x[i], y[i], cellX, cellY);
+			cellOf[i] = MortonCode(cellX, cellY);
+		}
+	});
+
+	// Counting sort, stable so particles keep their order within a cell
+	cellStart.assign(cells + 1, 0);
+	for (int i = 0; i < n; i++)
+		cellStart[cellOf[i] + 1]++;
+	cellCount = 0;
+	for (int c = 0; c < cells; c++)
+	{
+		cellCount += cellStart[c + 1] > 0;
+		cellStart[c + 1] += cellStart[c];
+	}
+
+	// Scattering moves each cell's start to the next cell's, shift them back after
+	order.resize(n);
+	for (int i = 0; i < n; i++)
+		order[cellStart[cellOf[i]]++] = i;
+	for (int c = cells; c > 0; c--)
+		cellStart[c] = cellStart[c - 1];
+	cellStart[0] = 0;
+
+	// Reorder every array to match
+	auto gather = [&](auto& array, auto& scratch) {
+		scratch.resize(n);
+		jobs.ParallelFor(n, 16384, [&](int begin, int end, int) {
+			for (int i = begin; i < end; i++)
+				scratch[i] = array[order[i]];
+		});
+		array.swap(scratch);
+	};
+	gather(x, scratchFloats);
+	gather(y, scratchFloats);
+	gather(oldX, scratchFloats);
+	gather(oldY, scratchFloats);
+	gather(startX, scratchFloats);
+	gather(startY, scratchFloats);
+	gather(velocityX, scratchFloats);
+	gather(velocityY, scratchFloats);
+	gather(inverseMass, scratchFloats);
+	gather(radius, scratchFloats);
+	gather(doGravity, scratchBytes);
+	gather(color, scratchColors);
+}
+
+/**
+	One round of pushing overlapping particles apart, each overlap split between
+	the two by inverse mass and applied straight away (Gauss-Seidel), which
+	settles deep piles far faster than averaging pushes.
+
+	Cells are done in 9 passes, one per (x % 3, y % 3). Cells in a pass are at
+	least 3 apart, so the particles one cell touches (its own & its neighbours')
+	are never touched by another cell in the same pass, and they can go to any
+	thread in any order with the same result. Each pair is handled once, from
+	the cell of the lower index.
+*/
+void ParticleSystem::PushApart(JobSystem& jobs)
+{
+	int side = 1 << gridBits;
+	int perRow = (side + 2) / 3;
+	threadContacts.assign(jobs.ThreadCount(), 0);
+
+	for (int pass = 0; pass < 9; pass++)
+	{
+		int offsetX = pass % 3, offsetY = pass / 3;
+		int rows = (side - offsetY + 2) / 3;
+		int columns = (side - offsetX + 2) / 3;
+		jobs.ParallelFor(rows * perRow, 1024, [&](int begin, int end, int thread) {
+			int contacts = 0;
+			for (int index = begin; index < end; index++)
+			{
+				int column = index % perRow;
+				if (column >= columns)
+					continue;
+				int cellX = offsetX + 3 * column, cellY = offsetY + 3 * (index / perRow);
+				uint32_t cell = MortonCode(cellX, cellY);
+				uint32_t first = cellStart[cell], last = cellStart[cell + 1];
+				if (first == last)
+					continue;
+
+				// Neighbouring cells that could hold a higher index
+				uint32_t rangeStart[9], rangeEnd[9];
+				int ranges = 0;
+				for (int ny = std::max(cellY - 1, 0); ny <= std::min(cellY + 1, side - 1); ny++)
+				{
+					for (int nx = std::max(cellX - 1, 0); nx <= std::min(cellX + 1, side - 1); nx++)
+					{
+						uint32_t neighbour = MortonCode(nx, ny);
+						if (cellStart[neighbour + 1] <= first)
+							continue;
+						rangeStart[ranges] = cellStart[neighbour];
+						rangeEnd[ranges] = cellStart[neighbour + 1];
+						ranges++;
+					}
+				}
+
+				for (uint32_t i = first; i < last; i++)
+				{
+					float wi = inverseMass[i], ri = radius[i];
+					for (int k = 0; k < ranges; k++)
+					{
+						for (uint32_t j = std::max(rangeStart[k], i + 1); j < rangeEnd[k]; j++)
+						{
+							float dx = x[i] - x[j], dy = y[i] - y[j];
+							float r = ri + radius[j];
+							float distanceSqr = dx * dx + dy * dy;
+							float wSum = wi + inverseMass[j];
+							if (distanceSqr >= r * r || wSum <= 0.0f)
+								continue;
+
+							// Exactly on top of each other, split them along x
+							float distance = sqrtf(distanceSqr);
+							float normalX = -1.0f, normalY = 0.0f;
+							if (distance > 1e-6f)
+							{
+								normalX = dx / distance;
+								normalY = dy / distance;
+							}
+
+							float push = (r - distance) / wSum;
+							x[i] += normalX * push * wi;
+							y[i] += normalY * push * wi;
+							x[j] -= normalX * push * inverseMass[j];
+							y[j] -= normalY * push * inverseMass[j];
+							contacts++;
+						}
+					}
+				}
+			}
+			threadContacts[thread] += contacts;
+		});
+	}
+
+	int n = Size();
+	jobs.ParallelFor(n, 16384, [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+		{
+			float r = radius[i];
+			x[i] = Clamp(x[i], boundsMin.x + r, boundsMax.x - r);
+			y[i] = Clamp(y[i], boundsMin.y + r, boundsMax.y - r);
+		}
+	});
+
+	contactCount = 0;
+	for (int contacts : threadContacts)
+		contactCount += contacts;
+}
+
+void ParticleSystem::Step(float dt, Vector3 gravity, JobSystem& jobs)
+{
+	if (Size() == 0 || dt <= 0.0f)
+		return;
+
+	// Substeps reorder these along with everything else
+	oldX = x;
+	oldY = y;
+
+	int count = std::max(substeps, 1);
+	for (int i = 0; i < count; i++)
+		Substep(dt / count, gravity, jobs);
+}
+
+void ParticleSystem::Substep(float dt, Vector3 gravity, JobSystem& jobs)
+{
+	int n = Size();
+
+	// Move freely first, remembering where they started
+	startX.resize(n);
+	startY.resize(n);
+	float gravityX = gravity.x * dt, gravityY = gravity.y * dt;
+	jobs.ParallelFor(n, 16384, [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+		{
+			startX[i] = x[i];
+			startY[i] = y[i];
+			if (inverseMass[i] <= 0.0f)
+				continue;
+			if (doGravity[i])
+			{
+				velocityX[i] += gravityX;
+				velocityY[i] += gravityY;
+			}
+
+			// No further than their radius, so they can't pass through each other
+			float moveX = velocityX[i] * dt, moveY = velocityY[i] * dt;
+			float maxMove = radius[i];
+			float moveSqr = moveX * moveX + moveY * moveY;
+			if (moveSqr > maxMove * maxMove)
+			{
+				float scale = maxMove / sqrtf(moveSqr);
+				moveX *= scale;
+				moveY *= scale;
+			}
+			x[i] += moveX;
+			y[i] += moveY;
+		}
+	});
+
+	// Sorted where they're headed, where the overlaps are
+	SortIntoCells(jobs);
+	for (int i = 0; i < iterations; i++)
+		PushApart(jobs);
+
+	// Velocity is however far they actually moved
+	float invDt = 1.0f / dt;
+	jobs.ParallelFor(n, 16384, [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+		{
+			if (inverseMass[i] <= 0.0f)
+				continue;
+			velocityX[i] = (x[i] - startX[i]) * invDt;
+			velocityY[i] = (y[i] - startY[i]) * invDt;
+		}
+	});
+}
+
+uint64_t ParticleSystem::HashState() const
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (const std::vector<float>* values : { &x, &y, &velocityX, &velocityY })
+	{
+		for (float v : *values)
+		{
+			uint32_t bits;
+			memcpy(&bits, &v, sizeof(bits));
+			for (int i = 0; i < 4; i++)
+			{
+				hash ^= (bits >> (i * 8)) & 0xFF;
+				hash *= 1099511628211ull;
+			}
+		}
+	}
+	return hash;
+}
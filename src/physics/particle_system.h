@@ -0,0 +1,88 @@
+#pragma once
+
+#include "raylib-cpp.hpp"
+#include "job_system.h"
+#include "particle.h"
+#include <cstdint>
+#include <vector>
+
+/**
+	Lots of sphere particles (millions), simulated separately from the rigid
+	bodies. They only collide with each other and with the walls of a box, and
+	have no rotation, so they can take a much cheaper path than bodies do.
+
+	Every step the particles are counting sorted into a grid of cells at least a
+	particle across. Cells are numbered along a Z-order (Morton) curve and every
+	array is reordered to match, so each cell's particles are contiguous and
+	cells close together in space are close together in memory too. A particle
+	then only has to look at the particles in its own & the 8 cells around it,
+	all of them in a few nearby runs of memory.
+
+	Collisions are position based: particles move, overlaps are pushed apart a
+	few times, and velocities come from how far they ended up moving. A step is
+	split into a few substeps, which keeps deep piles from squashing far better
+	than more pushes would. The pushes are split over threads by cell in a way
+	that gives the same result for any thread count.
+
+	All particles move in the plane z = z, the z of added particles is ignored.
+*/
+class ParticleSystem {
+
+public:
+	// Per particle, in cell order (which changes every step)
+	std::vector<float> x, y;
+	std::vector<float> oldX, oldY;		// before the last step, for interpolating
+	std::vector<float> velocityX, velocityY;
+	std::vector<float> inverseMass;
+	std::vector<float> radius;
+	std::vector<uint8_t> doGravity;
+	std::vector<Color> color;
+
+	float z = 0.0f;
+
+	// The box particles are kept in, on the XY plane
+	Vector2 boundsMin = { -50.0f, -50.0f };
+	Vector2 boundsMax = { 50.0f, 50.0f };
+
+	int substeps = 3;				// per step, each sorts into cells again
+	int iterations = 2;				// overlap pushes per substep
+
+	int Size() const { return (int)x.size(); }
+
+	void Add(const Particle& particle);
+	void Clear();
+	void Reserve(int count);
+
+	void Step(float dt, Vector3 gravity, JobSystem& jobs);
+
+	// FNV-1a over positions & velocities, like BodyStore::HashState
+	uint64_t HashState() const;
+
+	// From the last step
+	int cellCount = 0;				// occupied cells
+	int contactCount = 0;
+
+private:
+	float maxRadius = 0.0f;
+	float cellSize = 1.0f;
+	int gridBits = 0;				// the grid is 2^gridBits cells on each side
+
+	std::vector<uint32_t> cellOf;		// Morton code of each particle's cell
+	std::vector<uint32_t> cellStart;	// first particle of each cell, by Morton code
+	std::vector<int> order;				// sorted position -> old index
+	std::vector<float> startX, startY;	// before the current substep
+	std::vector<int> threadContacts;
+
+	// Reorder buffers, swapped with the arrays above
+	std::vector<float> scratchFloats;
+	std::vector<uint8_t> scratchBytes;
+	std::vector<Color> scratchColors;
+
+	void FitGrid();
+	void SortIntoCells(JobSystem& jobs);
+	void PushApart(JobSystem& jobs);
+	void Substep(float dt, Vector3 gravity, JobSystem& jobs);
+
+	void CellCoords(float px, float py, int& outX, int& outY) const;
+
+};
@@ -1,16 +1,42 @@
 #include "physics_world.h"
 
+#include "profiler.h"
 #include "rlgl.h"
 #include <float.h>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
+const char* NarrowphaseTypeName(NarrowphaseType type)
+{
+	switch (type)
+	{
+	case NarrowphaseType::SAT:			return "SAT manifold";
+	case NarrowphaseType::CornerTest:	return "Corner test";
+	default:							return "Unknown";
+	}
+}
+
 void PhysicsWorld::Init()
 {
 	camera = RCamera3D(RVector3(0, 0, 10));
 	camera.fovy = 45.0f;						// Camera field-of-view Y
 	camera.projection = CAMERA_PERSPECTIVE;		// Camera mode type
 
-	rigidbodies.clear();
+	bodies.Clear();
+	particles.Clear();
+	contactSolver.Reset();
+	jointSolver.Reset();
+	forces.Reset();
+	worldVertices.clear();
+	worldNormals.clear();
+	vertexStart.clear();
+	sleepingCount = 0;
+	stepCount = 0;
+	random.Seed(0);
+	if (debugDraw)
+		debugDraw->Clear();
+	SetBroadphase(broadphaseType);
 
 #ifdef TEST_POINT_LINE
 	RVector3 closest;
@@ -21,93 +47,259 @@ void PhysicsWorld::Init()
 #endif
 }
 
-void PhysicsWorld::Update(float dt)
+void PhysicsWorld::SetBroadphase(BroadphaseType type)
 {
-	dt = 1.0f / 60.0f;
-
-	// Update markers
-	for (auto& m : markers) m.currentTime += dt;
-	for (auto& a : arrows) a.marker.currentTime += dt;
-	markers.erase(std::remove_if(markers.begin(), markers.end(), [](Marker m) { return m.currentTime >= m.lifetime; }), markers.end());
-	arrows.erase(std::remove_if(arrows.begin(), arrows.end(), [](Arrow a) { return a.marker.currentTime >= a.marker.lifetime; }), arrows.end());
+	broadphaseType = type;
+	broadphase = CreateBroadphase(type);
+}
 
-	// Integration
-	for (auto& body : rigidbodies)
+void PhysicsWorld::Update(float dt)
+{
+	PROFILE_SCOPE("Physics step");
+
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point stepStart = Clock::now();
+	Clock::time_point phaseStart = stepStart;
+	auto endPhase = [&phaseStart]() {
+		Clock::time_point now = Clock::now();
+		float ms = std::chrono::duration<float, std::milli>(now - phaseStart).count();
+		phaseStart = now;
+		return ms;
+	};
+
+	if (debugDraw)
+		debugDraw->Step(dt);
+
+	// Check 1: overlap, the broadphase finds all pairs with overlapping bounding spheres
 	{
-		RVector3 acceleration = { 0, 0, 0 };
-		if (body.doGravity) acceleration += { 0, -9.8, 0 };
-
-		body.oldPos = body.position;
-		body.velocity += acceleration * dt;
-		body.position += body.velocity * dt;
-
-		float torqueY = 0.0f;
-		body.angularVelocity += torqueY * body.inverseMOI * dt;
-		body.rotation += body.angularVelocity * dt;
+		PROFILE_SCOPE("Broadphase");
+		broadphase->FindPairs(bodies, pairs, jobs);
+		TransformAllBodyVertices();
+
+		// Solve pairs in the same order whichever broadphase found them
+		std::sort(pairs.begin(), pairs.end(), [](const BodyPair& p1, const BodyPair& p2) {
+			return p1.a != p2.a ? p1.a < p2.a : p1.b < p2.b;
+		});
+		PROFILE_COUNT(ProfileCounter::BroadphasePairs, pairs.size());
+		timings.broadphase = endPhase();
 	}
 
-	// Collision & resolution
-	for (int i = 0; i < rigidbodies.size(); i++)
+	// Check 2: Find contacts, every pair on its own so they can run on any thread
 	{
-		for (int j = i + 1; j < rigidbodies.size(); j++)
+		PROFILE_SCOPE("Narrowphase");
+		jointSolver.Begin(bodies);
+		forces.RemoveStale(bodies);
+		manifolds.resize(pairs.size());
+		jobs.ParallelFor((int)pairs.size(), 128, [&](int begin, int end, int) {
+			for (int i = begin; i < end; i++)
+			{
+				// Jointed bodies usually overlap where they're joined
+				if (jointSolver.IsConnected(pairs[i].a, pairs[i].b) || !CollideBodies(pairs[i].a, pairs[i].b, manifolds[i]))
+					manifolds[i].pointCount = 0;
+			}
+		});
+		PROFILE_COUNT(ProfileCounter::NarrowphaseTests, pairs.size());
+
+		// ... then gather them in pair order
+		contactSolver.Begin();
+		for (size_t i = 0; i < pairs.size(); i++)
 		{
-			RigidBody2D& pi = rigidbodies[i];
-			RigidBody2D& pj = rigidbodies[j];
-
-			// Check 1: overlap
-			RVector3 dir = pj.position - pi.position;
-			float distance = dir.Length();
-			
-			if (distance >= pi.boundingRadius + pj.boundingRadius)
+			const BodyPair& pair = pairs[i];
+			const ContactManifold& manifold = manifolds[i];
+			if (manifold.pointCount == 0)
 				continue;
 
-			// Check 2: Find contacts
-			CollisionInfo col;
-			bool collided = CollideSquareSquare(pi, pj, col);
-			if (!collided) continue;
+			// Something moving touched a sleeping body, wake it up so it can react
+			if (bodies.sleeping[pair.a]) WakeBody(pair.a);
+			if (bodies.sleeping[pair.b]) WakeBody(pair.b);
 
-			// Check 3: approaching
-			// Velocities @ point of collision (lever arm formula)
-			RVector3 iContactVel = pi.velocity + RVector3(0, 0, pi.angularVelocity).CrossProduct(col.contact - pi.position);
-			RVector3 jContactVel = pj.velocity + RVector3(0, 0, pj.angularVelocity).CrossProduct(col.contact - pj.position);
-			RVector3 contactVel = jContactVel - iContactVel;
+			contactSolver.AddManifold(bodies, pair.a, pair.b, manifold);
 
-			if (contactVel.DotProduct(col.normal) > 0)
+			//debugDraw->AddArrow(manifold.points[0].position, manifold.normal, RColor::Pink());
+			for (int k = 0; k < manifold.pointCount && debugDraw; k++)
+				debugDraw->AddMarker(manifold.points[k].position, RColor::Green(), 0.1f);
+		}
+
+		// A joint to something moving wakes its other body, a link further along
+		// the chain each step, like bodies woken through contacts
+		for (const JointConstraint& c : jointSolver.constraints)
+		{
+			if (bodies.IsMoving(c.bodyA) || bodies.IsMoving(c.bodyB))
+			{
+				if (bodies.sleeping[c.bodyA]) WakeBody(c.bodyA);
+				if (bodies.sleeping[c.bodyB]) WakeBody(c.bodyB);
+			}
+		}
+		// Springs too, they aren't in islands so they'd keep pulling on a sleeping body
+		for (const ForceGenerator& g : forces.generators)
+		{
+			if (g.type != ForceType::Spring || !g.enabled)
 				continue;
+			int a = bodies.IndexOf(g.bodyA), b = bodies.IndexOf(g.bodyB);
+			if (bodies.IsMoving(a) || bodies.IsMoving(b))
+			{
+				if (bodies.sleeping[a]) WakeBody(a);
+				if (bodies.sleeping[b]) WakeBody(b);
+			}
+		}
+		timings.narrowphase = endPhase();
+	}
 
-			// Collision occurred -> resolve it!
-			// Contact point displacement from center
-			RVector3 dxi = col.contact - pi.position;
-			RVector3 dxj = col.contact - pj.position;
-
-			// Relative contact normals
-			RVector3 rni = dxi.CrossProduct(col.normal);
-			RVector3 rnj = dxj.CrossProduct(col.normal);
-
-			RVector3 impulse = col.normal
-				* (1 + cRestitution) * contactVel.DotProduct(col.normal)
-				/ (pi.inverseMass + pj.inverseMass +
-					rni.DotProduct(rni) * pi.inverseMOI +
-					rnj.DotProduct(rnj) * pj.inverseMOI);
-
-			pi.velocity += impulse * pi.inverseMass;
-			pj.velocity -= impulse * pj.inverseMass;
-			pi.angularVelocity += dxi.CrossProduct(impulse).z * pi.inverseMOI;
-			pj.angularVelocity -= dxj.CrossProduct(impulse).z * pj.inverseMOI;
-
-			pi.position += col.normal * (pi.oldPos - pi.position).DotProduct(col.normal);
-			pj.position += col.normal * (pj.oldPos - pj.position).DotProduct(col.normal);
-
-			//AddArrow(col.contact, iContactVel, RColor::Blue());
-			//AddArrow(col.contact, jContactVel, RColor::Red());
-			//AddArrow(col.contact, contactVel, RColor::Green());
-			//AddArrow(col.contact, col.normal, RColor::Pink());
-			//AddArrow(pi.position, impulse, RColor::Blue());
-			//std::cout << col.normal.ToString() << "\n";
-			AddMarker(col.contact, RColor::Green(), 0.1f);
+	// Islands: bodies connected through contacts or joints, static bodies don't
+	// connect anything, otherwise everything resting on the ground would be one island
+	{
+		PROFILE_SCOPE("Islands");
+		islands.Reset(bodies.Size());
+		for (const ContactConstraint& c : contactSolver.constraints)
+		{
+			if (bodies.IsDynamic(c.bodyA) && bodies.IsDynamic(c.bodyB))
+				islands.Union(c.bodyA, c.bodyB);
+		}
+		for (const JointConstraint& c : jointSolver.constraints)
+		{
+			if (bodies.IsDynamic(c.bodyA) && bodies.IsDynamic(c.bodyB))
+				islands.Union(c.bodyA, c.bodyB);
 		}
+		timings.solve = endPhase();
 	}
 
+	// Integration, with the contacts resolved between the velocity & position updates
+	{
+		PROFILE_SCOPE("Integrate velocities");
+		{
+			PROFILE_SCOPE("Forces");
+			if (forces.Accumulate(bodies, simdLevel, jobs))
+				forces.Apply(bodies, dt, jobs);
+		}
+		IntegrateVelocities(bodies, gravity, dt, simdLevel, &jobs);
+		timings.integrate = endPhase();
+	}
+
+	{
+		PROFILE_SCOPE("Contact solver");
+		contactSolver.restitution = cRestitution;
+		contactSolver.friction = cFriction;
+		contactSolver.linearSlop = LINEAR_SLOP;
+		contactSolver.Prepare(bodies, dt, islands, jobs);
+		jointSolver.warmStarting = contactSolver.warmStarting;
+		jointSolver.Prepare(bodies);
+		contactSolver.WarmStart(bodies, jobs);
+		jointSolver.WarmStart(bodies, jobs);
+
+		// Joints and contacts take turns every iteration, so each sees the other's
+		// latest impulses. Without joints, each island does all its iterations in one go
+		if (jointSolver.constraints.empty())
+			contactSolver.SolveVelocities(bodies, jobs);
+		else
+		{
+			for (int it = 0; it < contactSolver.velocityIterations; it++)
+			{
+				jointSolver.SolveVelocities(bodies, jobs);
+				contactSolver.SolveIteration(bodies, jobs);
+			}
+		}
+		contactSolver.StoreImpulses();
+		jointSolver.StoreImpulses();
+
+		// A normal & a friction impulse per point per iteration, plus one for warm starting
+		PROFILE_COUNT(ProfileCounter::Contacts, contactSolver.ContactPointCount());
+		PROFILE_COUNT(ProfileCounter::Impulses,
+			contactSolver.ContactPointCount() * (2 * contactSolver.velocityIterations + (contactSolver.warmStarting ? 1 : 0)));
+		PROFILE_COUNT(ProfileCounter::Joints, jointSolver.constraints.size());
+		timings.solve += endPhase();
+	}
+
+	{
+		PROFILE_SCOPE("Integrate positions");
+		IntegratePositions(bodies, dt, simdLevel, &jobs);
+		jointSolver.SolvePositions(bodies, jobs);
+		timings.integrate += endPhase();
+	}
+
+	{
+		PROFILE_SCOPE("Continuous collision");
+		SolveContinuousCollisions();
+		timings.continuous = endPhase();
+	}
+
+	{
+		PROFILE_SCOPE("Sleeping");
+		UpdateSleeping(dt);
+		timings.sleep = endPhase();
+	}
+
+	{
+		PROFILE_SCOPE("Particles");
+		particles.Step(dt, gravity, jobs);
+		timings.particles = endPhase();
+	}
+
+	stepCount++;
+
+	timings.total = std::chrono::duration<float, std::milli>(phaseStart - stepStart).count();
+}
+
+static const uint32_t SNAPSHOT_MAGIC = 0x33475633;	// "3VG3" in little endian
+static const uint32_t SNAPSHOT_VERSION = 8;
+
+void PhysicsWorld::SaveSnapshot(WorldSnapshot& snapshot) const
+{
+	SnapshotWriter writer(snapshot.data);
+	writer.Value(SNAPSHOT_MAGIC);
+	writer.Value(SNAPSHOT_VERSION);
+	writer.Value(stepCount);
+	writer.Value(random.state);
+	writer.Value(sleepingCount);
+	bodies.SaveState(writer);
+	contactSolver.SaveCache(writer);
+	jointSolver.SaveState(writer);
+	forces.SaveState(writer);
+}
+
+bool PhysicsWorld::RestoreSnapshot(const WorldSnapshot& snapshot)
+{
+	SnapshotReader reader(snapshot.data);
+	uint32_t magic = 0, version = 0;
+	reader.Value(magic);
+	reader.Value(version);
+	if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION)
+		return false;
+
+	reader.Value(stepCount);
+	reader.Value(random.state);
+	reader.Value(sleepingCount);
+	bool restored = bodies.RestoreState(reader) && contactSolver.RestoreCache(reader) && jointSolver.RestoreState(reader)
+		&& forces.RestoreState(reader) && !reader.Failed();
+	if (!restored)
+	{
+		Init();
+		return false;
+	}
+
+	// Sleeping bodies' world space vertices are only computed once, they may
+	// have been asleep somewhere else in the snapshot
+	worldVertices.clear();
+	worldNormals.clear();
+	vertexStart.clear();
+	if (debugDraw)
+		debugDraw->Clear();
+	return true;
+}
+
+uint64_t PhysicsWorld::HashState() const
+{
+	// The parts' hashes go through FNV-1a again, XOR would let equal parts cancel
+	uint64_t parts[] = { stepCount, random.state, bodies.HashState(), particles.HashState() };
+	uint64_t hash = 14695981039346656037ull;
+	for (uint64_t part : parts)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			hash ^= (part >> (i * 8)) & 0xFF;
+			hash *= 1099511628211ull;
+		}
+	}
+	return hash;
 }
 
 /**
@@ -152,15 +344,14 @@ bool PhysicsWorld::CollidePointLine(
 
 	\param point The point we are testing against.
 	\param vertices The vertices of the shape we are testing against.
+	\param nVerts The number of vertices.
 	\param pointCenter The original center of the shape that the tested point belongs to.
 	\param verticesCenter The center of the shape we are testing against.
 */
 bool PhysicsWorld::CollidePointPolygon(
-	RVector3 point, const std::vector<RVector3>& vertices, RVector3 pointCenter, Vector3 verticesCenter,
+	RVector3 point, const RVector3* vertices, int nVerts, RVector3 pointCenter, Vector3 verticesCenter,
 	CollisionInfo& outInfo)
 {
-	auto nVerts = vertices.size();
-
 	bool contactExists = false;
 	float bestDepth = FLT_MAX;
 	RVector3 bestContact;
@@ -203,40 +394,40 @@ bool PhysicsWorld::CollidePointPolygon(
 *
 */
 bool PhysicsWorld::CollideSquareSquare(
-	const RigidBody2D& rb1, const RigidBody2D& rb2,
+	int body1, int body2,
 	CollisionInfo& outInfo)
 {
-	// Transform shape vertices to world space
-	std::vector<RVector3> s1, s2;
-	RVector3 square[] = { {-1,-1,0}, {-1,1,0}, {1,1,0}, {1,-1,0} };
-	for (int i = 0; i < 4; i++)
-	{
-		s1.push_back(rb1.position + (square[i] * rb1.radius).RotateByQuaternion(RQuaternion::FromAxisAngle({ 0,0,1 }, rb1.rotation)));
-		s2.push_back(rb2.position + (square[i] * rb2.radius).RotateByQuaternion(RQuaternion::FromAxisAngle({ 0,0,1 }, rb2.rotation)));
-	}
-
-	// Find contacts
-	std::vector<CollisionInfo> contacts;
-	for (int i = 0; i < 4; i++)
+	RVector3 pos1 = bodies.position.Get(body1);
+	RVector3 pos2 = bodies.position.Get(body2);
+
+	// Shape vertices are already in world space, both have 4
+	const int corners = 4;
+	const RVector3* s1 = &worldVertices[vertexStart[body1]];
+	const RVector3* s2 = &worldVertices[vertexStart[body2]];
+
+	// Find contacts, at most 2 per corner pair
+	CollisionInfo contacts[2 * corners];
+	int contactCount = 0;
+	for (int i = 0; i < corners; i++)
 	{
 		CollisionInfo info;
 		bool collided;
 
 		// Body 1 corner hits body 2 edge
-		collided = CollidePointPolygon(s1[i], s2, rb1.position, rb2.position, info);
+		collided = CollidePointPolygon(s1[i], s2, corners, pos1, pos2, info);
 		if (collided)
 		{
 			// normal faces from 2->1, make it 1->2
 			info.normal = -info.normal;
-			contacts.push_back(info);
+			contacts[contactCount++] = info;
 		}
 
 		// Body 2 corner hits body 2 edge
-		collided = CollidePointPolygon(s2[i], s1, rb2.position, rb1.position, info);
-		if (collided) contacts.push_back(info);
+		collided = CollidePointPolygon(s2[i], s1, corners, pos2, pos1, info);
+		if (collided) contacts[contactCount++] = info;
 	}
 
-	if (contacts.size() > 0)
+	if (contactCount > 0)
 	{
 		outInfo = contacts[0];
 		return true;
@@ -245,45 +436,487 @@ bool PhysicsWorld::CollideSquareSquare(
 	return false;
 }
 
+/**
+	Finds contacts between two bodies with the narrowphase picked by narrowphaseType.
+	The corner test only works on two 4 cornered polygons, and only ever reports
+	one point. Anything else always goes through CollideShapes.
+*/
+bool PhysicsWorld::CollideBodies(int body1, int body2, ContactManifold& outManifold)
+{
+	WorldShape shape1 = GetWorldShape(body1), shape2 = GetWorldShape(body2);
+	bool quads = shape1.type == ShapeType::Polygon && shape1.count == 4 && shape2.type == ShapeType::Polygon && shape2.count == 4;
+	if (narrowphaseType == NarrowphaseType::CornerTest && quads)
+	{
+		CollisionInfo info;
+		if (!CollideSquareSquare(body1, body2, info))
+			return false;
+
+		outManifold.normal = info.normal;
+		outManifold.pointCount = 1;
+		outManifold.points[0] = { info.contact, info.depth, 0 };
+		return true;
+	}
+
+	return CollideShapes(shape1, shape2, outManifold);
+}
+
+WorldShape PhysicsWorld::GetWorldShape(int body) const
+{
+	const Shape& shape = bodies.shapes.Get(bodies.shape[body]);
+	int start = vertexStart[body];
+	return { shape.type, &worldVertices[start], &worldNormals[start], shape.vertexCount, shape.radius };
+}
 
-void PhysicsWorld::AddMarker(RVector3 position, Color color, float lifetime)
+/**
+	Transforms a body's shape into world space, into its slots in worldVertices.
+*/
+void PhysicsWorld::TransformBodyVertices(int body)
 {
-	markers.push_back({ position, color, lifetime, 0.0f });
+	int start = vertexStart[body];
+	TransformShape(bodies.shapes.Get(bodies.shape[body]), bodies.position.Get(body), bodies.rotation[body],
+		&worldVertices[start], &worldNormals[start]);
 }
 
-void PhysicsWorld::AddArrow(RVector3 pos, RVector3 dir, Color color, float lifetime)
+void PhysicsWorld::TransformAllBodyVertices()
 {
-	arrows.push_back({ { pos, color, lifetime, 0.0f }, dir });
+	// Each body's vertices follow the last one's. Sleeping bodies haven't moved
+	// since they fell asleep, unless bodies being added, removed or reshaped
+	// moved their slots
+	int n = bodies.Size();
+	bool moved = vertexStart.size() != (size_t)n + 1;
+	vertexStart.resize(n + 1);
+	int total = 0;
+	for (int i = 0; i < n; i++)
+	{
+		moved = moved || vertexStart[i] != total;
+		vertexStart[i] = total;
+		total += bodies.shapes.Get(bodies.shape[i]).vertexCount;
+	}
+	vertexStart[n] = total;
+
+	worldVertices.resize(total);
+	worldNormals.resize(total);
+	jobs.ParallelFor(n, 1024, [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+		{
+			if (moved || !bodies.sleeping[i])
+				TransformBodyVertices(i);
+		}
+	});
 }
 
+/**
+	Continuous collision, for bodies that could pass through something in a single
+	step: bullets, and bodies that moved further than their bounding radius. Each one
+	is swept from its last position to its new one and moved back to just before
+	the first thing it would have hit. Its velocity is kept, so next step's
+	speculative contacts stop it at the surface. The bounding radius rather than
+	anything tighter, so bodies jostling in a pile or a chain aren't all swept
+	every step; thin bodies that need it can be made bullets, and ones tunneling
+	wouldn't matter for (like the links of a chain) can turn it off.
+
+	Every time of impact is found before any body is moved back, so the results
+	don't depend on which thread or in what order bodies are swept.
+*/
+void PhysicsWorld::SolveContinuousCollisions()
+{
+	continuousBodies.clear();
+	continuousHitCount = 0;
+	maxMove = 0.0f;
+	if (continuousCollision)
+	{
+		float maxMoveSqr = 0.0f;
+		for (int i = 0; i < bodies.Size(); i++)
+		{
+			float dx = bodies.position.x[i] - bodies.oldPos.x[i];
+			float dy = bodies.position.y[i] - bodies.oldPos.y[i];
+			float moveSqr = dx * dx + dy * dy;
+			float radius = bodies.boundingRadius[i];
+			if (bodies.IsActive(i) && (bodies.bullet[i] || (bodies.continuous[i] && moveSqr > radius * radius)))
+				continuousBodies.push_back(i);
+			maxMoveSqr = std::max(maxMoveSqr, moveSqr);
+		}
+		maxMove = sqrtf(maxMoveSqr);
+	}
+
+	int count = (int)continuousBodies.size();
+	timesOfImpact.resize(count);
+	const AabbTree* tree = count > 0 ? broadphase->SyncTree(bodies) : nullptr;
+	jobs.ParallelFor(count, 4, [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+			timesOfImpact[i] = SweepBody(continuousBodies[i], tree);
+	});
+
+	for (int i = 0; i < count; i++)
+	{
+		float t = timesOfImpact[i];
+		if (t >= 1.0f)
+			continue;
+
+		int body = continuousBodies[i];
+		RVector3 position = Vector3Lerp(bodies.oldPos.Get(body), bodies.position.Get(body), t);
+		bodies.position.Set(body, position);
+		bodies.rotation[body] = Lerp(bodies.oldRotation[body], bodies.rotation[body], t);
+		if (debugDraw)
+			debugDraw->AddMarker(position, RColor::Orange(), 0.5f);
+		continuousHitCount++;
+	}
+}
+
+/**
+	Earliest time of impact, as a fraction of the last step, between a body and
+	everything its swept bounding sphere reaches. 1 if it doesn't hit anything.
+
+	With a tree, the candidates are what it has in the swept box. The tree has
+	bodies where they ended up, so the box is grown by the furthest any body
+	moved. Without one, every body is.
+*/
+float PhysicsWorld::SweepBody(int body, const AabbTree* tree) const
+{
+	RVector3 start = bodies.oldPos.Get(body);
+	RVector3 end = bodies.position.Get(body);
+	RVector3 move = end - start;
+	float reach = bodies.boundingRadius[body];
+
+	float toi = 1.0f;
+	auto sweepAgainst = [&](int other) {
+		if (other == body)
+			return;
+
+		// Closest the two centers get, with both moving in straight lines
+		RVector3 otherStart = bodies.oldPos.Get(other);
+		RVector3 offset = start - otherStart;
+		RVector3 relativeMove = move - (bodies.position.Get(other) - otherStart);
+		float moveSqr = relativeMove.DotProduct(relativeMove);
+		float t = moveSqr > 0.0f ? Clamp(-offset.DotProduct(relativeMove) / moveSqr, 0.0f, 1.0f) : 0.0f;
+		RVector3 closest = offset + relativeMove * t;
+		float reachBoth = reach + bodies.boundingRadius[other];
+		if (closest.DotProduct(closest) > reachBoth * reachBoth)
+			return;
+
+		// Filtered out like in the broadphase, and jointed bodies don't collide,
+		// they'd stop each other dead where they're joined
+		if (!bodies.ShouldCollide(body, other) || jointSolver.IsConnected(body, other))
+			return;
+
+		toi = std::min(toi, TimeOfImpact(body, other, toi));
+	};
+
+	if (tree != nullptr)
+	{
+		float grow = reach + maxMove;
+		Aabb swept = { { std::min(start.x, end.x) - grow, std::min(start.y, end.y) - grow },
+					   { std::max(start.x, end.x) + grow, std::max(start.y, end.y) + grow } };
+		tree->Query(swept, [&](int proxy) {
+			sweepAgainst(tree->GetUserData(proxy));
+			return true;
+		});
+	}
+	else
+	{
+		for (int other = 0; other < bodies.Size(); other++)
+			sweepAgainst(other);
+	}
+	return toi;
+}
+
+/**
+	Time of impact by conservative advancement: moves both bodies along their last
+	step by the gap between them divided by the fastest any of their points close
+	in, which can never step past the moment they touch. The gap is
+	ShapeSeparation, which is never more than the real distance, so steps stay
+	safe.
+
+	Returns when (0 to 1) the bodies come within LINEAR_SLOP of each other, or
+	maxTime if they don't before then. Bodies that start out touching are left to
+	the regular contacts.
+*/
+float PhysicsWorld::TimeOfImpact(int body1, int body2, float maxTime) const
+{
+	RVector3 start1 = bodies.oldPos.Get(body1), move1 = bodies.position.Get(body1) - start1;
+	RVector3 start2 = bodies.oldPos.Get(body2), move2 = bodies.position.Get(body2) - start2;
+	float rotation1 = bodies.oldRotation[body1], turn1 = bodies.rotation[body1] - rotation1;
+	float rotation2 = bodies.oldRotation[body2], turn2 = bodies.rotation[body2] - rotation2;
+
+	// Fastest any point of one body moves towards the other, per unit of time
+	float maxSpeed = (move1 - move2).Length()
+		+ fabsf(turn1) * bodies.boundingRadius[body1] + fabsf(turn2) * bodies.boundingRadius[body2];
+	if (maxSpeed <= 0.0f)
+		return maxTime;
+
+	const Shape& shape1 = bodies.shapes.Get(bodies.shape[body1]);
+	const Shape& shape2 = bodies.shapes.Get(bodies.shape[body2]);
+	RVector3 vertices1[Shape::MAX_VERTICES], normals1[Shape::MAX_VERTICES];
+	RVector3 vertices2[Shape::MAX_VERTICES], normals2[Shape::MAX_VERTICES];
+	WorldShape world1 = { shape1.type, vertices1, normals1, shape1.vertexCount, shape1.radius };
+	WorldShape world2 = { shape2.type, vertices2, normals2, shape2.vertexCount, shape2.radius };
+
+	const float target = LINEAR_SLOP;
+	const float tolerance = 0.25f * LINEAR_SLOP;
+	float t = 0.0f;
+	for (int iteration = 0; iteration < TOI_ITERATIONS; iteration++)
+	{
+		TransformShape(shape1, start1 + move1 * t, rotation1 + turn1 * t, vertices1, normals1);
+		TransformShape(shape2, start2 + move2 * t, rotation2 + turn2 * t, vertices2, normals2);
+		float separation = ShapeSeparation(world1, world2);
+
+		if (separation < target + tolerance)
+			return iteration == 0 ? maxTime : t;
+
+		t += (separation - target) / maxSpeed;
+		if (t >= maxTime)
+			return maxTime;
+	}
+
+	// Still closing in, stop here rather than risk passing through
+	return t;
+}
+
+void PhysicsWorld::WakeBody(int body)
+{
+	if (bodies.sleeping[body])
+		sleepingCount--;
+	bodies.sleeping[body] = 0;
+	bodies.sleepTime[body] = 0.0f;
+}
+
+/**
+	Puts islands to sleep once all their bodies have been slow for timeToSleep.
+*/
+void PhysicsWorld::UpdateSleeping(float dt)
+{
+	int n = bodies.Size();
+	if (!allowSleeping)
+	{
+		for (int i = 0; i < n; i++)
+			WakeBody(i);
+		sleepingCount = 0;
+		return;
+	}
+
+	// An island is as restless as its most restless body
+	float linearTolerance = sleepLinearVelocity * sleepLinearVelocity;
+	float angularTolerance = sleepAngularVelocity * sleepAngularVelocity;
+	islandSleepTime.assign(n, FLT_MAX);
+	for (int i = 0; i < n; i++)
+	{
+		if (!bodies.IsActive(i))
+			continue;
+
+		float vx = bodies.velocity.x[i], vy = bodies.velocity.y[i], vz = bodies.velocity.z[i];
+		float w = bodies.angularVelocity[i];
+		if (vx * vx + vy * vy + vz * vz > linearTolerance || w * w > angularTolerance)
+			bodies.sleepTime[i] = 0.0f;
+		else
+			bodies.sleepTime[i] += dt;
+
+		int island = islands.Find(i);
+		islandSleepTime[island] = std::min(islandSleepTime[island], bodies.sleepTime[i]);
+	}
+
+	sleepingCount = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (bodies.IsActive(i) && islandSleepTime[islands.Find(i)] >= timeToSleep)
+		{
+			bodies.sleeping[i] = 1;
+			bodies.velocity.Set(i, Vector3{ 0, 0, 0 });
+			bodies.angularVelocity[i] = 0.0f;
+			TransformBodyVertices(i); // skipped while asleep, so bring it up to date now
+		}
+		if (bodies.sleeping[i])
+			sleepingCount++;
+	}
+}
+
+
 void PhysicsWorld::Render()
 {
+	PROFILE_SCOPE("Render world");
+	auto renderStart = std::chrono::steady_clock::now();
 	camera.BeginMode();
 
-	for (auto& body : rigidbodies)
+	if (useInstancing && renderer.Load())
+		drawCalls = RenderInstanced();
+	else
+		drawCalls = RenderImmediate();
+
+	camera.EndMode();
+	renderTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+}
+
+// Bodies are drawn between their last two steps, so motion stays smooth when the
+// physics rate and frame rate don't line up
+void PhysicsWorld::InterpolateBody(int body, RVector3& outPosition, float& outRotation) const
+{
+	outPosition = Vector3Lerp(bodies.oldPos.Get(body), bodies.position.Get(body), renderAlpha);
+	outRotation = Lerp(bodies.oldRotation[body], bodies.rotation[body], renderAlpha);
+}
+
+int PhysicsWorld::RenderInstanced()
+{
+	renderer.Begin();
+	bool outlines = false;	// drawn the old way, batched by rlgl into one draw
+
+	for (int i = 0; i < bodies.Size(); i++)
+	{
+		RVector3 pos;
+		float rotation;
+		InterpolateBody(i, pos, rotation);
+
+		if (drawBoundingSpheres)
+		{
+			Color c = bodies.color[i]; c.a = 70;
+			renderer.Add(InstancedRenderer::Mesh::WireSphere, { pos.x, pos.y, pos.z, rotation, bodies.boundingRadius[i], c });
+		}
+		Color c = bodies.sleeping[i] ? ColorBrightness(bodies.color[i], -0.6f) : bodies.color[i];
+		const Shape& shape = bodies.shapes.Get(bodies.shape[i]);
+		if (shape.IsSquare())
+			renderer.Add(InstancedRenderer::Mesh::WireCube, { pos.x, pos.y, pos.z, rotation, shape.boxHalfSize.x * 2, c });
+		else if (shape.type == ShapeType::Circle)
+			renderer.Add(InstancedRenderer::Mesh::WireCircle, { pos.x, pos.y, pos.z, rotation, shape.radius, c });
+		else
+		{
+			DrawShapeOutline(shape, pos, rotation, c);
+			outlines = true;
+		}
+	}
+
+	for (int i = 0; i < particles.Size(); i++)
+	{
+		float x = Lerp(particles.oldX[i], particles.x[i], renderAlpha);
+		float y = Lerp(particles.oldY[i], particles.y[i], renderAlpha);
+		renderer.Add(InstancedRenderer::Mesh::Disc, { x, y, particles.z, 0.0f, particles.radius[i], particles.color[i] });
+	}
+
+	if (drawJoints && DrawJoints())
+		outlines = true;
+
+	int draws = (debugDraw ? debugDraw->Draw(&renderer) : 0) + (outlines ? 1 : 0);
+	return draws + renderer.End();
+}
+
+int PhysicsWorld::RenderImmediate()
+{
+	int calls = 0;
+	for (int i = 0; i < bodies.Size(); i++)
 	{
+		RVector3 pos;
+		float rotation;
+		InterpolateBody(i, pos, rotation);
+
 		rlPushMatrix();
-		rlTranslatef(body.position.x, body.position.y, body.position.z);
-		rlRotatef(body.rotation * RAD2DEG, 0, 0, 1); // rlRotatef ASSUMES ITS IN DEGREES UGHHHHHHHHHHHHHH
+		rlTranslatef(pos.x, pos.y, pos.z);
+		rlRotatef(rotation * RAD2DEG, 0, 0, 1); // rlRotatef ASSUMES ITS IN DEGREES UGHHHHHHHHHHHHHH
 
-		Color c = body.color; c.a = 70;
+		Color c = bodies.color[i]; c.a = 70;
 		if (drawBoundingSpheres)
-			DrawSphereWires(Vector3{}, body.boundingRadius, 8, 8, c);
-		DrawCubeWires(Vector3{}, body.radius * 2, body.radius * 2, body.radius * 2, body.color);
+		{
+			DrawSphereWires(Vector3{}, bodies.boundingRadius[i], 8, 8, c);
+			calls++;
+		}
+		const Shape& shape = bodies.shapes.Get(bodies.shape[i]);
+		Color color = bodies.sleeping[i] ? ColorBrightness(bodies.color[i], -0.6f) : bodies.color[i];
+		if (shape.IsSquare())
+		{
+			float size = shape.boxHalfSize.x * 2;
+			DrawCubeWires(Vector3{}, size, size, size, color);
+		}
+		else
+			DrawShapeOutline(shape, RVector3::Zero(), 0.0f, color);
+		calls++;
 
 		rlPopMatrix();
 	}
 
-	for (auto& marker : markers)
-		DrawSphere(marker.position, 0.05f, marker.color);
+	// Points, a disc each would be far too many draws
+	for (int i = 0; i < particles.Size(); i++)
+	{
+		float x = Lerp(particles.oldX[i], particles.x[i], renderAlpha);
+		float y = Lerp(particles.oldY[i], particles.y[i], renderAlpha);
+		DrawPoint3D(Vector3{ x, y, particles.z }, particles.color[i]);
+	}
+	if (particles.Size() > 0)
+		calls++;
+	if (drawJoints && DrawJoints())
+		calls++;
+
+	return calls + (debugDraw ? debugDraw->Draw(nullptr) : 0);
+}
+
+void PhysicsWorld::DrawShapeOutline(const Shape& shape, RVector3 position, float rotation, Color color) const
+{
+	RVector3 vertices[Shape::MAX_VERTICES], normals[Shape::MAX_VERTICES];
+	TransformShape(shape, position, rotation, vertices, normals);
 
-	for (auto& arrow : arrows)
+	// Rounded cores get each corner's arc, from the normal of the edge before to
+	// the normal of the edge after, and edges pushed out by the radius
+	const int arcSegments = 16;
+	for (int i = 0; i < shape.vertexCount; i++)
 	{
-		Vector3 end = Vector3Add(arrow.marker.position, Vector3Scale(arrow.direction, 1.0f));
-		DrawLine3D(arrow.marker.position, end, arrow.marker.color);
-		DrawSphere(end, 0.05f, arrow.marker.color);
+		RVector3 start = vertices[i], end = vertices[(i + 1) % shape.vertexCount];
+		if (shape.radius <= 0.0f)
+		{
+			DrawLine3D(start, end, color);
+			continue;
+		}
+
+		float from = shape.vertexCount > 1 ? atan2f(normals[(i + shape.vertexCount - 1) % shape.vertexCount].y,
+			normals[(i + shape.vertexCount - 1) % shape.vertexCount].x) : 0.0f;
+		float to = shape.vertexCount > 1 ? atan2f(normals[i].y, normals[i].x) : 2 * PI;
+		if (shape.vertexCount > 1)
+		{
+			// Clockwise winding turns the normals clockwise too
+			while (to > from) to -= 2 * PI;
+			RVector3 offset = normals[i] * shape.radius;
+			DrawLine3D(start + offset, end + offset, color);
+		}
+		for (int k = 0; k < arcSegments; k++)
+		{
+			float a0 = Lerp(from, to, (float)k / arcSegments), a1 = Lerp(from, to, (float)(k + 1) / arcSegments);
+			DrawLine3D(start + RVector3(cosf(a0), sinf(a0), 0) * shape.radius,
+				start + RVector3(cosf(a1), sinf(a1), 0) * shape.radius, color);
+		}
 	}
-		
-	camera.EndMode();
+
+	// A spoke, like the instanced circle, so circles can be seen turning
+	if (shape.type == ShapeType::Circle)
+		DrawLine3D(position, position + RVector3(cosf(rotation), sinf(rotation), 0) * shape.radius, color);
 }
 
+bool PhysicsWorld::DrawJoints() const
+{
+	// Like Box2D draws them: each body's center to its anchor, and the anchors
+	// to each other. Revolute & weld anchors meet, so it's just the two spokes
+	for (const Joint& joint : jointSolver.joints)
+	{
+		if (!bodies.IsValid(joint.bodyA) || !bodies.IsValid(joint.bodyB))
+			continue;
+
+		RVector3 centerA, centerB;
+		float rotationA, rotationB;
+		InterpolateBody(bodies.IndexOf(joint.bodyA), centerA, rotationA);
+		InterpolateBody(bodies.IndexOf(joint.bodyB), centerB, rotationB);
+		RVector3 anchorA = centerA + RVector3(joint.localAnchorAx, joint.localAnchorAy, 0).RotateByQuaternion(RQuaternion::FromAxisAngle({ 0,0,1 }, rotationA));
+		RVector3 anchorB = centerB + RVector3(joint.localAnchorBx, joint.localAnchorBy, 0).RotateByQuaternion(RQuaternion::FromAxisAngle({ 0,0,1 }, rotationB));
+
+		DrawLine3D(centerA, anchorA, LIGHTGRAY);
+		DrawLine3D(anchorA, anchorB, YELLOW);
+		DrawLine3D(anchorB, centerB, LIGHTGRAY);
+	}
+
+	// Springs as a line between their anchors, where the bodies are now
+	bool springs = false;
+	for (int i = 0; i < forces.Count(); i++)
+	{
+		const ForceGenerator& g = forces.generators[i];
+		if (g.type != ForceType::Spring || !bodies.IsValid(g.bodyA) || !bodies.IsValid(g.bodyB))
+			continue;
+
+		RVector3 anchorA, anchorB;
+		forces.GetSpringAnchors(bodies, i, anchorA, anchorB);
+		DrawLine3D(anchorA, anchorB, g.enabled ? SKYBLUE : DARKGRAY);
+		springs = true;
+	}
+	return jointSolver.Count() > 0 || springs;
+}
@@ -1,7 +1,21 @@
 #pragma once
 
 #include "raylib-cpp.hpp"
-#include "rigidbody.h"
+#include "body_store.h"
+#include "broadphase.h"
+#include "contact_solver.h"
+#include "debug_draw.h"
+#include "force_accumulator.h"
+#include "instanced_renderer.h"
+#include "integrator.h"
+#include "islands.h"
+#include "job_system.h"
+#include "joint_solver.h"
+#include "particle_system.h"
+#include "random.h"
+#include "snapshot.h"
+#include "world_query.h"
+#include <memory>
 #include <vector>
 
 struct CollisionInfo {
@@ -10,16 +24,40 @@ struct CollisionInfo {
 	RVector3 normal;
 };
 
-struct Marker {
+struct ContactPoint {
 	RVector3 position;
-	RColor color = RColor::RayWhite();
-	float lifetime = 1.0f;
-	float currentTime = 0.0f;
+	float depth;	// negative for speculative contacts that aren't touching yet
+	uint32_t id;	// which features touch, stable across steps while the contact persists
 };
 
-struct Arrow {
-	Marker marker;
-	RVector3 direction;
+/**
+	Up to two contact points between a pair of bodies, sharing one normal that
+	points from the first body to the second.
+*/
+struct ContactManifold {
+	RVector3 normal;
+	int pointCount = 0;
+	ContactPoint points[2];
+};
+
+enum class NarrowphaseType {
+	SAT = 0,		// separating axis test + clipped manifold
+	CornerTest,		// corner-in-polygon tests, first contact only
+	Count
+};
+
+const char* NarrowphaseTypeName(NarrowphaseType type);
+
+// Milliseconds spent in each part of a step
+struct StepTimings {
+	float broadphase = 0.0f;	// pair finding & world space vertices
+	float narrowphase = 0.0f;	// contact manifolds, gathered into constraints
+	float integrate = 0.0f;		// forces, velocities & positions
+	float solve = 0.0f;			// islands, contact & joint solvers
+	float sleep = 0.0f;
+	float continuous = 0.0f;	// continuous collision
+	float particles = 0.0f;
+	float total = 0.0f;
 };
 
 class PhysicsWorld {
@@ -31,28 +69,183 @@ public:
 
 //private: TODO: add protection
 	float cRestitution = 0.2f;
+	float cFriction = 0.5f;
+	RVector3 gravity = RVector3(0, -9.8f, 0);
+	SimdLevel simdLevel = DetectSimdLevel();
 
 	RCamera3D camera;
-	std::vector<RigidBody2D> rigidbodies;
+	BodyStore bodies;
+	ParticleSystem particles;	// only collide with each other, see ParticleSystem
+
+	// Steps taken since Init, and randomness for anything the world needs it for
+	uint64_t stepCount = 0;
+	Random random;
+
+	// Snapshots of the world's changing state, see WorldSnapshot. Restoring a
+	// snapshot from another version returns false without touching the world, one
+	// that's cut short leaves it empty
+	void SaveSnapshot(WorldSnapshot& snapshot) const;
+	bool RestoreSnapshot(const WorldSnapshot& snapshot);
+
+	/**
+		64-bit hash of the world's state (bodies, particles, step count & random
+		state), for checking two runs stayed bit-identical. The same scenario
+		stepped the same way hashes the same for any thread count, integrator or
+		broadphase, and across builds made with STRICT_DETERMINISM (see
+		src/CMakeLists.txt) on the same platform.
+	*/
+	uint64_t HashState() const;
+
+	// Threads the step is split over
+	JobSystem jobs;
+
+	// Broadphase
+	BroadphaseType broadphaseType = BroadphaseType::AabbTree;
+	std::unique_ptr<Broadphase> broadphase;
+	std::vector<BodyPair> pairs;
+
+	void SetBroadphase(BroadphaseType type);
+
+	// Narrowphase
+	NarrowphaseType narrowphaseType = NarrowphaseType::SAT;
+	std::vector<ContactManifold> manifolds;	// one per broadphase pair, filled in parallel
+	static constexpr float LINEAR_SLOP = 0.005f;
+	// Points this close but not touching yet still make contacts, with a negative depth
+	static constexpr float SPECULATIVE_DISTANCE = 4.0f * LINEAR_SLOP;
+
+	// Contact resolution
+	ContactSolver contactSolver;
+
+	// Joints between bodies, solved in the contact solver's velocity iterations.
+	// Add them with jointSolver.AddDistance etc.
+	JointSolver jointSolver;
+
+	// Force & torque on top of gravity: the bodies' own and the generators', see
+	// ForceAccumulator. Add generators with forces.AddDrag etc.
+	ForceAccumulator forces;
+
+	/**
+		Continuous collision: bullets, and bodies that moved further than their
+		bounding radius in a step (unless they're not continuous), are swept from
+		oldPos to position so they can't tunnel through thin or small bodies when
+		the step is large. See SolveContinuousCollisions.
+	*/
+	bool continuousCollision = true;
+	static constexpr int TOI_ITERATIONS = 20;
+	std::vector<int> continuousBodies;		// swept last step
+	float maxMove = 0.0f;					// furthest any body moved last step
+	std::vector<float> timesOfImpact;
+	int continuousHitCount = 0;				// moved back to their time of impact
+
+	void SolveContinuousCollisions();
+	// tree is the broadphase's, or nullptr to try every body
+	float SweepBody(int body, const AabbTree* tree) const;
+	float TimeOfImpact(int body1, int body2, float maxTime) const;
+
+	// Sleeping: islands of touching bodies that stay slower than the thresholds for
+	// timeToSleep seconds stop being integrated & collided until something hits them
+	bool allowSleeping = true;
+	float sleepLinearVelocity = 0.05f;
+	float sleepAngularVelocity = 0.05f;		// rad/s
+	float timeToSleep = 0.5f;
+	IslandFinder islands;		// from this step's contacts, also used by the solver
+	std::vector<float> islandSleepTime;
+	int sleepingCount = 0;
+
+	void WakeBody(int body);
+	void UpdateSleeping(float dt);
+
+	/**
+		Scene queries, answered with the broadphase's tree when it keeps one (the
+		AABB tree does) and by testing every body when it doesn't. Bodies are
+		tested exactly, and come back as dense indices in the caller's buffers.
+
+		A batch runs in parallel on the job system, after bringing the tree up to
+		date with the bodies (a pass over all of them), so lots of queries are
+		best made in one call. The area queries write up to maxResults bodies for
+		query k at outBodies[k * maxResults], and how many there were in outCounts[k].
+	*/
+	void RayCast(const RayCastInput* rays, int count, RayCastHit* outHits);
+	void QueryPoints(const Vector2* points, int count, int* outBodies, int maxResults, int* outCounts);
+	void QueryAabbs(const Aabb* boxes, int count, int* outBodies, int maxResults, int* outCounts);
+	void QueryCircles(const CircleQuery* circles, int count, int* outBodies, int maxResults, int* outCounts);
+
+	// Batches of one, returning the hit or how many bodies were found
+	RayCastHit RayCast(const RayCastInput& ray);
+	int QueryPoint(Vector2 point, int* outBodies, int maxResults);
+	int QueryAabb(const Aabb& box, int* outBodies, int maxResults);
+	int QueryCircle(const CircleQuery& circle, int* outBodies, int maxResults);
+
+	const AabbTree* queryTree = nullptr;	// for the batch being run
+	template <typename Bounds, typename Test>
+	void QueryArea(int count, const Bounds& boundsOf, const Test& test, int* outBodies, int maxResults, int* outCounts);
+
+	// Stats from the last update
+	StepTimings timings;
+
+	// How far between the previous step and the last one to draw bodies, 0 to 1
+	float renderAlpha = 1.0f;
 
 	bool CollidePointLine(RVector3 point, RVector3 lineStart, RVector3 lineEnd,
 		RVector3& outClosestPoint);
 
-	bool CollidePointPolygon(RVector3 point, const std::vector<RVector3>& vertices, RVector3 pointShapeCenter, Vector3 verticesCenter,
+	bool CollidePointPolygon(RVector3 point, const RVector3* vertices, int nVerts, RVector3 pointShapeCenter, Vector3 verticesCenter,
 							 CollisionInfo& outInfo);
 
-	bool CollideSquareSquare(const RigidBody2D& rb1, const RigidBody2D& rb2,
+	bool CollideSquareSquare(int body1, int body2,
 							 CollisionInfo& outInfos);
 
-	// Debug drawing
-	// TODO: move debug drawing out of physics code
+	// Contacts between shapes in world space, see narrowphase.cpp. CollideShapes
+	// picks one of the others from a table by the two shapes' types
+	bool CollideShapes(const WorldShape& shape1, const WorldShape& shape2, ContactManifold& outManifold) const;
+	bool CollideCircles(const WorldShape& circle1, const WorldShape& circle2, ContactManifold& outManifold) const;
+	bool CollidePolygonCircle(const WorldShape& polygon, const WorldShape& circle, ContactManifold& outManifold) const;
+	bool CollideCirclePolygon(const WorldShape& circle, const WorldShape& polygon, ContactManifold& outManifold) const;
+	bool CollidePolygons(const WorldShape& polygon1, const WorldShape& polygon2, ContactManifold& outManifold) const;
+
+	// Never more than the gap between two shapes' surfaces, negative if they overlap
+	static float ShapeSeparation(const WorldShape& shape1, const WorldShape& shape2);
+
+	bool CollideBodies(int body1, int body2, ContactManifold& outManifold);
+
+	// World space corners & edge normals of every body, refreshed once per step.
+	// Body i's start at vertexStart[i], the last entry is the total
+	std::vector<RVector3> worldVertices;
+	std::vector<RVector3> worldNormals;
+	std::vector<int> vertexStart;
+
+	WorldShape GetWorldShape(int body) const;
+	void TransformBodyVertices(int body);
+	void TransformAllBodyVertices();
+
+	// Drawing
+	// TODO: move the rest of drawing out of physics code: Render, the camera, the
+	// renderer & these flags. They're still here because drawing walks the body
+	// arrays & interpolates them, so it needs a read-only view of the world to
+	// move to first. The debug markers already belong to the scene (debugDraw)
 	bool drawBoundingSpheres = true;
-
-	std::vector<Marker> markers;
-	std::vector<Arrow> arrows;
-
-	void AddMarker(RVector3 position, Color color, float lifetime = 1.0f);
-	void AddArrow(RVector3 pos, RVector3 dir, Color color, float lifetime = 1.0f);
+	bool drawJoints = true;		// and springs
+
+	// One instanced draw per mesh, falls back to drawing every body on its own
+	// where instancing isn't supported
+	bool useInstancing = true;
+	InstancedRenderer renderer;
+
+	// Stats from the last render (CPU side only)
+	int drawCalls = 0;
+	float renderTimeMs = 0.0f;
+
+	void InterpolateBody(int body, RVector3& outPosition, float& outRotation) const;
+	// Lines around a shape that has no mesh of its own
+	void DrawShapeOutline(const Shape& shape, RVector3 position, float rotation, Color color) const;
+	// A line between each joint's & spring's anchors, returns whether it drew any
+	bool DrawJoints() const;
+	int RenderInstanced();
+	int RenderImmediate();
+
+	// Where contact points etc. get marked, compiled out of release builds. It's
+	// the scene's, nothing is marked without one (the benchmarks)
+	DebugDraw* debugDraw = nullptr;
 
 
 };
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+const char* ProfileCounterName(ProfileCounter counter)
+{
+	switch (counter)
+	{
+	case ProfileCounter::BroadphasePairs:	return "Broadphase pairs";
+	case ProfileCounter::NarrowphaseTests:	return "Narrowphase tests";
+	case ProfileCounter::Contacts:			return "Contacts";
+	case ProfileCounter::Impulses:			return "Impulses";
+	case ProfileCounter::Joints:			return "Joints";
+	default:								return "Unknown";
+	}
+}
+
+Profiler& Profiler::Get()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+uint64_t Profiler::NowNs() const
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::NewFrame()
+{
+	uint64_t now = NowNs();
+
+	// The first call only starts a frame, there's nothing before it to keep
+	if (recording && frameStarted)
+	{
+		current.endNs = now;
+
+		// Swapping keeps the events buffers around, so no allocations once they're big enough
+		std::swap(history[frameCount % HISTORY_FRAMES], current);
+		frameCount++;
+	}
+
+	frameStarted = true;
+	current.startNs = now;
+	current.endNs = 0;
+	memset(current.trackMs, 0, sizeof(current.trackMs));
+	memset(current.counters, 0, sizeof(current.counters));
+	current.events.clear();
+}
+
+int Profiler::RegisterTrack(const char* name)
+{
+	for (int i = 0; i < trackCount; i++)
+	{
+		if (strcmp(trackNames[i], name) == 0)
+			return i;
+	}
+
+	// Out of tracks, the rest share the last one
+	if (trackCount == MAX_TRACKS)
+		return MAX_TRACKS - 1;
+
+	trackNames[trackCount] = name;
+	return trackCount++;
+}
+
+void Profiler::BeginScope(int track)
+{
+	openScopes.push_back({ NowNs(), 0, track });
+}
+
+void Profiler::EndScope()
+{
+	OpenScope scope = openScopes.back();
+	openScopes.pop_back();
+
+	uint64_t duration = NowNs() - scope.startNs;
+	if (!openScopes.empty())
+		openScopes.back().childNs += duration;
+
+	// Still balance the scope stack when not recording, recording can be turned
+	// off while scopes are open. Nothing's kept until NewFrame is first called,
+	// so headless runs that never call it (the benches, servers) don't pile up
+	// events
+	if (!recording || !frameStarted)
+		return;
+
+	current.trackMs[scope.track] += (float)((duration - scope.childNs) * 1e-6);
+	current.events.push_back({ scope.startNs, (uint32_t)duration, (uint8_t)scope.track, (uint8_t)openScopes.size() });
+}
+
+const Profiler::Frame& Profiler::GetFrame(int age) const
+{
+	return history[(frameCount - 1 - age) % HISTORY_FRAMES];
+}
+
+bool Profiler::SaveChromeTrace(const char* path) const
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	// Timestamps are in microseconds
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (int age = FrameCount() - 1; age >= 0; age--)
+	{
+		const Frame& frame = GetFrame(age);
+		double frameUs = frame.startNs * 1e-3;
+
+		fprintf(file, "%s{\"name\":\"Frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+			first ? "" : ",\n", frameUs, (frame.endNs - frame.startNs) * 1e-3);
+		first = false;
+
+		for (const Event& event : frame.events)
+		{
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+				trackNames[event.track], event.startNs * 1e-3, event.durationNs * 1e-3);
+		}
+
+		fprintf(file, ",\n{\"name\":\"Counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{", frameUs);
+		for (int c = 0; c < (int)ProfileCounter::Count; c++)
+			fprintf(file, "%s\"%s\":%d", c == 0 ? "" : ",", ProfileCounterName((ProfileCounter)c), frame.counters[c]);
+		fprintf(file, "}}");
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	fclose(file);
+	return true;
+}
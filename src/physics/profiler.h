@@ -0,0 +1,127 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+enum class ProfileCounter {
+	BroadphasePairs = 0,
+	NarrowphaseTests,
+	Contacts,			// contact points handed to the solver
+	Impulses,			// normal & friction impulses applied, warm starting included
+	Joints,				// joints handed to the solver
+	Count
+};
+
+const char* ProfileCounterName(ProfileCounter counter);
+
+/**
+	Records how long named scopes take every frame, and keeps the last
+	HISTORY_FRAMES frames around for graphs & for saving as a Chrome trace
+	(chrome://tracing or ui.perfetto.dev).
+
+	Use the PROFILE_ macros rather than calling it directly, they compile to
+	nothing unless ENABLE_PROFILER is defined. Scopes must only be opened on the
+	main thread; work inside a ParallelFor is timed by the scope around it.
+	Nothing is recorded until the first NewFrame.
+
+	Each scope name gets a track. A track's time in a frame is its self time
+	(minus the scopes nested in it), so stacking the tracks of a frame adds up
+	to the time spent in scopes without counting anything twice.
+*/
+class Profiler {
+
+public:
+	static constexpr int HISTORY_FRAMES = 300;
+	static constexpr int MAX_TRACKS = 32;
+
+	struct Event {
+		uint64_t startNs;	// since the profiler was created
+		uint32_t durationNs;
+		uint8_t track;
+		uint8_t depth;
+	};
+
+	struct Frame {
+		uint64_t startNs = 0;
+		uint64_t endNs = 0;
+		float trackMs[MAX_TRACKS] = {};
+		int counters[(int)ProfileCounter::Count] = {};
+		std::vector<Event> events;
+	};
+
+	static Profiler& Get();
+
+	// Ends the current frame and starts the next one
+	void NewFrame();
+
+	// Returns the track id for a scope name, name must outlive the profiler (use literals)
+	int RegisterTrack(const char* name);
+	void BeginScope(int track);
+	void EndScope();
+
+	void Count(ProfileCounter counter, int amount) { if (recording && frameStarted) current.counters[(int)counter] += amount; }
+
+	bool recording = true;
+
+	int TrackCount() const { return trackCount; }
+	const char* TrackName(int track) const { return trackNames[track]; }
+
+	// Finished frames, 0 is the most recent
+	int FrameCount() const { return frameCount < HISTORY_FRAMES ? frameCount : HISTORY_FRAMES; }
+	const Frame& GetFrame(int age) const;
+
+	// Writes every stored frame as Chrome trace event JSON, returns false if the file couldn't be opened
+	bool SaveChromeTrace(const char* path) const;
+
+private:
+	struct OpenScope {
+		uint64_t startNs;
+		uint64_t childNs;
+		int track;
+	};
+
+	std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	const char* trackNames[MAX_TRACKS];
+	int trackCount = 0;
+
+	Frame current;
+	bool frameStarted = false;
+	Frame history[HISTORY_FRAMES];
+	int frameCount = 0;		// frames finished so far, the newest is history[(frameCount - 1) % HISTORY_FRAMES]
+
+	std::vector<OpenScope> openScopes;
+
+	uint64_t NowNs() const;
+
+};
+
+/**
+	Times the rest of the enclosing block as the scope's frame time.
+*/
+class ProfileScope {
+
+public:
+	explicit ProfileScope(int track) { Profiler::Get().BeginScope(track); }
+	~ProfileScope() { Profiler::Get().EndScope(); }
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef ENABLE_PROFILER
+	// The track is looked up once per call site, not every time the scope runs
+	#define PROFILE_SCOPE(name) \
+		static const int PROFILE_CONCAT(profileTrack, __LINE__) = Profiler::Get().RegisterTrack(name); \
+		ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileTrack, __LINE__))
+	#define PROFILE_COUNT(counter, amount) Profiler::Get().Count(counter, (int)(amount))
+	#define PROFILE_NEW_FRAME() Profiler::Get().NewFrame()
+#else
+	#define PROFILE_SCOPE(name) ((void)0)
+	#define PROFILE_COUNT(counter, amount) ((void)0)
+	#define PROFILE_NEW_FRAME() ((void)0)
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+	PCG32 random number generator. Its whole state is one integer, so it's cheap
+	to snapshot, and unlike the std distributions it gives the same numbers on
+	every platform & standard library.
+*/
+struct Random {
+	uint64_t state = 0x853c49e6748fea9bull;
+
+	void Seed(uint64_t seed)
+	{
+		state = 0;
+		Next();
+		state += seed;
+		Next();
+	}
+
+	uint32_t Next()
+	{
+		uint64_t old = state;
+		state = old * 6364136223846793005ull + 1442695040888963407ull;
+		uint32_t xorShifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+		uint32_t rotation = (uint32_t)(old >> 59);
+		return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+	}
+
+	// In [0, 1), from the top 24 bits so every value is exactly representable
+	float NextFloat() { return (Next() >> 8) * (1.0f / 16777216.0f); }
+
+	float Range(float min, float max) { return min + (max - min) * NextFloat(); }
+};
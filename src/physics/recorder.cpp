@@ -0,0 +1,473 @@
+#include "recorder.h"
+
+#include "scenario_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Quantized values stay within this, so residuals fit in MAX_BITS once zigzagged
+constexpr float QUANTIZED_LIMIT = 1073741824.0f;	// 2^30
+constexpr int MAX_BITS = 34;
+
+// value / step, rounded & clamped (NaNs end up at the bottom)
+int32_t Quantize(float value, float scale)
+{
+	float q = fminf(fmaxf(value * scale, -QUANTIZED_LIMIT), QUANTIZED_LIMIT);
+	return (int32_t)floorf(q + 0.5f);
+}
+
+// Where the last two frames say a value will be: carrying on at the same speed
+int64_t Predict(int32_t last, int32_t beforeLast)
+{
+	return 2 * (int64_t)last - beforeLast;
+}
+
+// Small negative numbers to small unsigned ones: 0, -1, 1, -2... -> 0, 1, 2, 3...
+uint64_t ZigZag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+int64_t UnZigZag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+uint32_t Checksum(const uint8_t* data, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Most bytes PackBlocks can write for count values
+size_t MaxPackedSize(int count)
+{
+	return (size_t)(count + Recorder::BLOCK_SIZE - 1) / Recorder::BLOCK_SIZE * 2 + (size_t)count * MAX_BITS / 8;
+}
+
+// See recorder.h, values have to fit in MAX_BITS
+uint8_t* PackBlocks(uint8_t* out, const uint64_t* values, int count)
+{
+	for (int start = 0; start < count; start += Recorder::BLOCK_SIZE)
+	{
+		int n = std::min(Recorder::BLOCK_SIZE, count - start);
+		uint64_t all = 0;
+		for (int i = 0; i < n; i++)
+			all |= values[start + i];
+		int bits = 0;
+		while (all >> bits)
+			bits++;
+		*out++ = (uint8_t)bits;
+
+		uint64_t buffer = 0;
+		int pending = 0;
+		for (int i = 0; i < n; i++)
+		{
+			buffer |= values[start + i] << pending;
+			pending += bits;
+			while (pending >= 8)
+			{
+				*out++ = (uint8_t)buffer;
+				buffer >>= 8;
+				pending -= 8;
+			}
+		}
+		if (pending > 0)
+			*out++ = (uint8_t)buffer;
+	}
+	return out;
+}
+
+bool UnpackBlocks(const uint8_t*& in, const uint8_t* end, uint64_t* values, int count)
+{
+	for (int start = 0; start < count; start += Recorder::BLOCK_SIZE)
+	{
+		int n = std::min(Recorder::BLOCK_SIZE, count - start);
+		if (in == end)
+			return false;
+		int bits = *in++;
+		if (bits > MAX_BITS || (size_t)(end - in) < ((size_t)n * bits + 7) / 8)
+			return false;
+
+		uint64_t mask = ((uint64_t)1 << bits) - 1;
+		uint64_t buffer = 0;
+		int pending = 0;
+		for (int i = 0; i < n; i++)
+		{
+			while (pending < bits)
+			{
+				buffer |= (uint64_t)*in++ << pending;
+				pending += 8;
+			}
+			values[start + i] = buffer & mask;
+			buffer >>= bits;
+			pending -= bits;
+		}
+	}
+	return true;
+}
+
+}
+
+bool Recorder::Start(const char* path, float stepDt)
+{
+	Stop();
+
+	file = fopen(path, "wb");
+	if (file == nullptr)
+	{
+		TraceLog(LOG_WARNING, "Recorder: %s: can't create file", path);
+		return false;
+	}
+
+	RecordingHeader header = { RECORDING_MAGIC, RECORDING_VERSION, stepDt, POSITION_STEP, ROTATION_STEP };
+	fwrite(&header, sizeof(header), 1, file);
+
+	frameCount = 0;
+	droppedCount = 0;
+	writtenBytes = sizeof(header);
+	writeFailed = false;
+	needKeyframe = true;
+	framesSinceKeyframe = 0;
+	haveKeyframe = false;
+	stopping = false;
+
+	// Every frame the queue can hold, up front, so Capture never allocates one.
+	// Their arrays grow the first time they're used & keep their size after that
+	pool.clear();
+	for (int i = 0; i < MAX_QUEUED_FRAMES; i++)
+		pool.push_back(std::make_unique<Frame>());
+
+#ifndef PLATFORM_WEB
+	writer = std::thread(&Recorder::WriterLoop, this);
+#endif
+	return true;
+}
+
+void Recorder::Stop()
+{
+	if (file == nullptr)
+		return;
+
+#ifndef PLATFORM_WEB
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	queuedCondition.notify_one();
+	writer.join();
+#endif
+
+	if (fclose(file) != 0)
+		writeFailed = true;
+	file = nullptr;
+}
+
+void Recorder::Capture(const BodyStore& bodies, uint64_t step)
+{
+	if (file == nullptr)
+		return;
+	auto start = std::chrono::steady_clock::now();
+
+	std::unique_ptr<Frame> frame;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!pool.empty())
+		{
+			frame = std::move(pool.back());
+			pool.pop_back();
+		}
+	}
+	if (frame == nullptr)
+	{
+		// The writer's behind, and the next frame can't be a delta from this one
+		droppedCount++;
+		needKeyframe = true;
+		return;
+	}
+
+	frame->step = step;
+	frame->keyframe = needKeyframe || bodies.layoutVersion != lastLayout || framesSinceKeyframe >= keyframeInterval;
+	if (frame->keyframe)
+	{
+		frame->bodies = bodies;
+		lastLayout = bodies.layoutVersion;
+		framesSinceKeyframe = 0;
+		needKeyframe = false;
+	}
+	framesSinceKeyframe++;
+	frameCount++;
+
+	frame->x.assign(bodies.position.x.begin(), bodies.position.x.end());
+	frame->y.assign(bodies.position.y.begin(), bodies.position.y.end());
+	frame->rotation.assign(bodies.rotation.begin(), bodies.rotation.end());
+	frame->sleeping.assign(bodies.sleeping.begin(), bodies.sleeping.end());
+
+#ifdef PLATFORM_WEB
+	Encode(*frame);
+	pool.push_back(std::move(frame));
+#else
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(std::move(frame));
+	}
+	queuedCondition.notify_one();
+#endif
+
+	lastCaptureMicroseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Recorder::WriterLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		queuedCondition.wait(lock, [this]() { return stopping || !queued.empty(); });
+		if (queued.empty())
+			break;
+
+		std::unique_ptr<Frame> frame = std::move(queued.front());
+		queued.pop_front();
+		lock.unlock();
+		Encode(*frame);
+		lock.lock();
+		pool.push_back(std::move(frame));
+	}
+}
+
+void Recorder::Encode(const Frame& frame)
+{
+	int count = (int)frame.x.size();
+	const std::vector<float>* values[3] = { &frame.x, &frame.y, &frame.rotation };
+	const float scales[3] = { 1.0f / POSITION_STEP, 1.0f / POSITION_STEP, 1.0f / ROTATION_STEP };
+
+	if (frame.keyframe)
+	{
+		WriteScenarioBinary(frame.bodies, data);
+		data.insert(data.end(), frame.sleeping.begin(), frame.sleeping.end());
+
+		// Nothing to go on yet, so the next frame is predicted to be the same
+		for (int c = 0; c < 3; c++)
+		{
+			last[c].resize(count);
+			for (int i = 0; i < count; i++)
+				last[c][i] = Quantize((*values[c])[i], scales[c]);
+			beforeLast[c] = last[c];
+		}
+		lastSleeping = frame.sleeping;
+		bodyCount = (uint32_t)count;
+		haveKeyframe = true;
+		WriteFrame(frame);
+		return;
+	}
+
+	// Capture makes a keyframe whenever the bodies change, so these always line up
+	if (!haveKeyframe || count != (int)bodyCount)
+		return;
+
+	residuals.resize(count);
+	data.resize(4 * MaxPackedSize(count));
+	uint8_t* out = data.data();
+	for (int c = 0; c < 3; c++)
+	{
+		const float* v = values[c]->data();
+		int32_t* l = last[c].data();
+		int32_t* bl = beforeLast[c].data();
+		for (int i = 0; i < count; i++)
+		{
+			int32_t q = Quantize(v[i], scales[c]);
+			residuals[i] = ZigZag(q - Predict(l[i], bl[i]));
+			bl[i] = l[i];
+			l[i] = q;
+		}
+		out = PackBlocks(out, residuals.data(), count);
+	}
+	for (int i = 0; i < count; i++)
+	{
+		residuals[i] = frame.sleeping[i] ^ lastSleeping[i];
+		lastSleeping[i] = frame.sleeping[i];
+	}
+	out = PackBlocks(out, residuals.data(), count);
+	data.resize(out - data.data());
+
+	WriteFrame(frame);
+}
+
+void Recorder::WriteFrame(const Frame& frame)
+{
+	// After a failed write the file ends in a partial frame, so nothing more can
+	// go after it
+	if (writeFailed)
+		return;
+
+	RecordingFrameHeader header = { frame.step, (uint32_t)data.size(), bodyCount, frame.keyframe ? 1u : 0u,
+		Checksum(data.data(), data.size()) };
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(data.data(), 1, data.size(), file) == data.size();
+	if (!ok)
+	{
+		TraceLog(LOG_WARNING, "Recorder: couldn't write a frame, the recording ends before it");
+		writeFailed = true;
+		return;
+	}
+	writtenBytes += sizeof(header) + data.size();
+}
+
+bool Replay::Open(const char* path)
+{
+	Close();
+	if (!file.Open(path))
+	{
+		TraceLog(LOG_WARNING, "Replay: %s: can't open file", path);
+		return false;
+	}
+
+	if (file.Size() >= sizeof(header))
+		memcpy(&header, file.Data(), sizeof(header));
+	if (file.Size() < sizeof(header) || header.magic != RECORDING_MAGIC)
+	{
+		TraceLog(LOG_WARNING, "Replay: %s: not a recording", path);
+		Close();
+		return false;
+	}
+	if (header.version != RECORDING_VERSION || !(header.stepDt > 0.0f)
+		|| !(header.positionStep > 0.0f) || !(header.rotationStep > 0.0f))
+	{
+		TraceLog(LOG_WARNING, "Replay: %s: unsupported version %u", path, header.version);
+		Close();
+		return false;
+	}
+
+	// Index the frames, stopping at one that's cut short
+	size_t offset = sizeof(header);
+	int keyframe = -1;
+	while (file.Size() - offset >= sizeof(RecordingFrameHeader))
+	{
+		Frame frame;
+		memcpy(&frame.header, file.Data() + offset, sizeof(frame.header));
+		frame.offset = offset + sizeof(frame.header);
+		if (frame.header.size > file.Size() - frame.offset)
+			break;
+
+		if (frame.header.keyframe)
+			keyframe = (int)frames.size();
+		else if (keyframe < 0 || frame.header.bodyCount != frames[keyframe].header.bodyCount)
+		{
+			TraceLog(LOG_WARNING, "Replay: %s: frame %d doesn't go with a keyframe, stopping there", path, (int)frames.size());
+			break;
+		}
+		frame.keyframe = keyframe;
+		frames.push_back(frame);
+		offset = frame.offset + frame.header.size;
+	}
+	if (frames.empty())
+	{
+		TraceLog(LOG_WARNING, "Replay: %s: no frames", path);
+		Close();
+		return false;
+	}
+
+	this->path = path;
+	return true;
+}
+
+void Replay::Close()
+{
+	file.Close();
+	path.clear();
+	frames.clear();
+	decodedFrame = -1;
+}
+
+bool Replay::Seek(int frame, BodyStore& bodies)
+{
+	if (frame < 0 || frame >= FrameCount())
+		return false;
+
+	// Frames only decode forwards, from their keyframe or the last one decoded
+	int keyframe = frames[frame].keyframe;
+	bool ok = true;
+	if (decodedFrame < keyframe || decodedFrame > frame || bodies.layoutVersion != decodedLayout)
+		ok = DecodeKeyframe(keyframe, bodies);
+	while (ok && decodedFrame < frame)
+		ok = DecodeFrame(decodedFrame + 1, bodies);
+
+	if (!ok)
+	{
+		TraceLog(LOG_WARNING, "Replay: %s: can't decode frame %d", path.c_str(), frame);
+		decodedFrame = -1;
+		return false;
+	}
+	decodedLayout = bodies.layoutVersion;
+	return true;
+}
+
+bool Replay::DecodeKeyframe(int frame, BodyStore& bodies)
+{
+	const RecordingFrameHeader& frameHeader = frames[frame].header;
+	const uint8_t* data = file.Data() + frames[frame].offset;
+	size_t count = frameHeader.bodyCount;
+	if (Checksum(data, frameHeader.size) != frameHeader.checksum || frameHeader.size < count)
+		return false;
+
+	size_t sceneSize = frameHeader.size - count;
+	bodies.Clear();
+	if (!ReadScenarioBinary(bodies, data, sceneSize, path.c_str()) || (size_t)bodies.Size() != count)
+		return false;
+	memcpy(bodies.sleeping.data(), data + sceneSize, count);
+
+	const std::vector<float>* values[3] = { &bodies.position.x, &bodies.position.y, &bodies.rotation };
+	const float scales[3] = { 1.0f / header.positionStep, 1.0f / header.positionStep, 1.0f / header.rotationStep };
+	for (int c = 0; c < 3; c++)
+	{
+		last[c].resize(count);
+		for (size_t i = 0; i < count; i++)
+			last[c][i] = Quantize((*values[c])[i], scales[c]);
+		beforeLast[c] = last[c];
+	}
+	decodedFrame = frame;
+	return true;
+}
+
+bool Replay::DecodeFrame(int frame, BodyStore& bodies)
+{
+	const RecordingFrameHeader& frameHeader = frames[frame].header;
+	const uint8_t* in = file.Data() + frames[frame].offset;
+	const uint8_t* end = in + frameHeader.size;
+	int count = bodies.Size();
+	if (Checksum(in, frameHeader.size) != frameHeader.checksum || (int)frameHeader.bodyCount != count)
+		return false;
+
+	// Where the bodies are now is where they were last frame
+	bodies.oldPos.x = bodies.position.x;
+	bodies.oldPos.y = bodies.position.y;
+	bodies.oldRotation = bodies.rotation;
+
+	residuals.resize(count);
+	std::vector<float>* values[3] = { &bodies.position.x, &bodies.position.y, &bodies.rotation };
+	const float steps[3] = { header.positionStep, header.positionStep, header.rotationStep };
+	for (int c = 0; c < 3; c++)
+	{
+		if (!UnpackBlocks(in, end, residuals.data(), count))
+			return false;
+		float* v = values[c]->data();
+		int32_t* l = last[c].data();
+		int32_t* bl = beforeLast[c].data();
+		for (int i = 0; i < count; i++)
+		{
+			int32_t q = (int32_t)(Predict(l[i], bl[i]) + UnZigZag(residuals[i]));
+			bl[i] = l[i];
+			l[i] = q;
+			v[i] = q * steps[c];
+		}
+	}
+
+	if (!UnpackBlocks(in, end, residuals.data(), count) || in != end)
+		return false;
+	for (int i = 0; i < count; i++)
+		bodies.sleeping[i] ^= (uint8_t)residuals[i];
+
+	decodedFrame = frame;
+	return true;
+}
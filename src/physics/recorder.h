@@ -0,0 +1,185 @@
+#pragma once
+
+#include "body_store.h"
+#include "mapped_file.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+	Recordings (.rec) of the bodies in a run, a frame per step, small & cheap
+	enough to leave on and pull up after something's gone wrong.
+
+	After a 20 byte header (magic, version, seconds per step, and the position &
+	rotation quantization steps) come the frames, each a RecordingFrameHeader &
+	its data. A keyframe is the whole body store in the binary scene format (see
+	scenario_file.h), then every body's sleeping flag as a byte. Nothing else
+	about the bodies changes between keyframes: a new one is made every
+	keyframeInterval frames, and as soon as the bodies' layout changes
+	(BodyStore::layoutVersion).
+
+	Every other frame has each body's position x & y and rotation, rounded to a
+	multiple of the steps, less where the two frames before would put it (so bodies
+	at rest or coasting come out as 0 or close), zigzagged so they're small &
+	unsigned. Then a 1 for each body whose sleeping flag flipped. Each of those 4
+	arrays is packed in blocks of BLOCK_SIZE bodies: a byte with the bits the
+	block's biggest value needs, then every value in that many bits, low bits
+	first. A block of sleeping bodies takes one byte.
+
+	A recording cut off by a crash only loses the frames that hadn't been written
+	yet, the last one is dropped if it's cut short.
+*/
+constexpr uint32_t RECORDING_MAGIC = 0x43455233; // "3REC"
+constexpr uint32_t RECORDING_VERSION = 2;
+
+struct RecordingHeader {
+	uint32_t magic;
+	uint32_t version;
+	float stepDt;
+	float positionStep;
+	float rotationStep;
+};
+
+struct RecordingFrameHeader {
+	uint64_t step;			// the world's step count when it was captured
+	uint32_t size;			// of the data after the header
+	uint32_t bodyCount;
+	uint32_t keyframe;		// 1 or 0
+	uint32_t checksum;		// FNV-1a of the data
+};
+
+/**
+	Writes recordings. Capture only copies the arrays that change every step
+	(the whole body store for a keyframe) into a frame from a pool & queues it,
+	a writer thread does the encoding & writing, so a step never waits on the
+	disk. If the writer falls MAX_QUEUED_FRAMES behind, frames are dropped (and
+	the next one is a keyframe) rather than holding the step up.
+
+	The web build has no threads, frames are encoded & written as they're
+	captured there.
+*/
+class Recorder {
+
+public:
+	static constexpr float POSITION_STEP = 1.0f / 1024.0f;
+	static constexpr float ROTATION_STEP = 1.0f / 8192.0f;	// rad
+	static constexpr int BLOCK_SIZE = 32;
+	static constexpr int MAX_QUEUED_FRAMES = 256;
+
+	Recorder() = default;
+	~Recorder() { Stop(); }
+	Recorder(const Recorder&) = delete;
+	Recorder& operator=(const Recorder&) = delete;
+
+	// Starts a new recording, stopping the last one. Returns false if the file
+	// can't be created
+	bool Start(const char* path, float stepDt);
+	// Writes out everything captured so far & closes the file
+	void Stop();
+	bool IsRecording() const { return file != nullptr; }
+
+	// After every step, with the world's step count
+	void Capture(const BodyStore& bodies, uint64_t step);
+
+	int keyframeInterval = 300;
+
+	// Stats since Start, the byte count is updated by the writer
+	int frameCount = 0;
+	int droppedCount = 0;
+	float lastCaptureMicroseconds = 0.0f;
+	std::atomic<uint64_t> writtenBytes{ 0 };
+	std::atomic<bool> writeFailed{ false };
+
+private:
+	struct Frame {
+		uint64_t step = 0;
+		bool keyframe = false;
+		BodyStore bodies;		// keyframes only
+		std::vector<float> x, y, rotation;
+		std::vector<uint8_t> sleeping;
+	};
+
+	FILE* file = nullptr;
+
+	// Frames go from the pool to the queue & back, Start makes MAX_QUEUED_FRAMES
+	// of them. The pool's a stack, so when the writer keeps up the same few frames
+	// (and their arrays) get used over & over
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable queuedCondition;
+	std::deque<std::unique_ptr<Frame>> queued;
+	std::vector<std::unique_ptr<Frame>> pool;
+	bool stopping = false;
+
+	// Capture's side
+	uint32_t lastLayout = 0;
+	int framesSinceKeyframe = 0;
+	bool needKeyframe = true;
+
+	// The writer's side: the last two frames, quantized, and scratch space
+	bool haveKeyframe = false;
+	uint32_t bodyCount = 0;
+	std::vector<int32_t> last[3], beforeLast[3];
+	std::vector<uint8_t> lastSleeping;
+	std::vector<uint64_t> residuals;
+	std::vector<uint8_t> data;
+
+	void WriterLoop();
+	void Encode(const Frame& frame);
+	void WriteFrame(const Frame& frame);
+
+};
+
+/**
+	Plays a recording back into a BodyStore. Opening one maps the file & indexes
+	its frames, then seeking to a frame decodes from the keyframe before it, or
+	from the last frame sought if that's on the way. So playing forwards only
+	decodes one frame each time.
+*/
+class Replay {
+
+public:
+	// Returns false (and logs why) if the file isn't a recording this version can
+	// read
+	bool Open(const char* path);
+	void Close();
+	bool IsOpen() const { return !frames.empty(); }
+
+	int FrameCount() const { return (int)frames.size(); }
+	float StepDt() const { return header.stepDt; }
+	uint64_t StepAt(int frame) const { return frames[frame].header.step; }
+
+	// Replaces what's in bodies with the bodies in frame, and their oldPos &
+	// oldRotation with the frame before's (unless it's a keyframe) so drawing can
+	// interpolate between them. Returns false if the frame can't be decoded
+	bool Seek(int frame, BodyStore& bodies);
+
+private:
+	struct Frame {
+		RecordingFrameHeader header;
+		size_t offset;		// of the data
+		int keyframe;		// the frame it's decoded from
+	};
+
+	MappedFile file;
+	std::string path;
+	RecordingHeader header = {};
+	std::vector<Frame> frames;
+
+	// What's in the bodies we last decoded into
+	int decodedFrame = -1;
+	uint32_t decodedLayout = 0;		// bodies' layoutVersion after decoding
+	std::vector<int32_t> last[3], beforeLast[3];
+	std::vector<uint64_t> residuals;
+
+	bool DecodeKeyframe(int frame, BodyStore& bodies);
+	bool DecodeFrame(int frame, BodyStore& bodies);
+
+};
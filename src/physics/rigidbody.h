@@ -1,19 +1,43 @@
 #pragma once
 
 #include "particle.h"
+#include <cstdint>
 
 class RigidBody2D : public Particle {
 
 public:
 	RVector3 oldPos = RVector3::Zero();
+	float oldRotation = 0.0f;
 	float rotation = 0.0f;
 	float angularVelocity = 0.0f;
 	float inverseMOI = 1.0f;
+	float torque = 0.0f;
+	uint32_t forceGroups = 1;	// which force generators apply to it, see ForceGenerator::mask
+	bool bullet = false;	// always swept for continuous collision, however slow it's moving
+	bool continuous = true;	// swept when it moves fast, see PhysicsWorld::continuousCollision
+	// Moved by its velocity alone, pushing dynamic bodies out of the way. See SetKinematic
+	bool kinematic = false;
+	// Collides with bodies in a layer its mask has & whose mask has its layer, unless
+	// both have the same nonzero group: then always if it's positive, never if negative
+	uint32_t collisionLayer = 1;
+	uint32_t collisionMask = 0xFFFFFFFF;
+	int32_t collisionGroup = 0;
+	int shape = -1;			// in the BodyStore's ShapeRegistry, -1 for a square of half size radius
 
+	// A square shape, the store works out the bounding radius when it's added
 	void SetCubeSideLength(float length)
 	{
 		radius = length / 2;
-		boundingRadius = length * 0.866f;
+		shape = -1;
+	}
+
+	// No mass for contacts & forces to push around, and no gravity
+	void SetKinematic()
+	{
+		kinematic = true;
+		inverseMass = 0.0f;
+		inverseMOI = 0.0f;
+		doGravity = false;
 	}
 
 };
\ No newline at end of file
@@ -0,0 +1,541 @@
+#include "scenario_file.h"
+
+#include "mapped_file.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+struct BinaryHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t bodyCount;
+	uint32_t shapeCount;
+};
+
+// A shape in a binary scene, what ShapeRegistry::AddCopy needs to make it again
+struct BinaryShape {
+	int32_t type;
+	int32_t vertexCount;
+	float radius;
+	Vector2 boxHalfSize;
+	Vector2 vertices[Shape::MAX_VERTICES];
+};
+
+// Bytes per body after the shapes
+constexpr size_t BINARY_BODY_SIZE = 10 * sizeof(float) + sizeof(int32_t) + sizeof(Color) + 4 * sizeof(uint8_t)
+	+ 3 * sizeof(uint32_t);
+
+/**
+	Walks a text scene in place, a line at a time. Tokens are pointers into the
+	mapping, only numbers get copied out (strtof needs a terminated string).
+*/
+struct TextParser {
+	const char* cursor;
+	const char* end;
+	const char* path;
+	int line = 1;
+
+	// Skips spaces & comments, but not the end of the line
+	void SkipSpace()
+	{
+		while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r'))
+			cursor++;
+		if (cursor < end && *cursor == '#')
+		{
+			while (cursor < end && *cursor != '\n')
+				cursor++;
+		}
+	}
+
+	bool AtLineEnd() const { return cursor == end || *cursor == '\n'; }
+
+	// The next run of non-space characters on this line, if there is one
+	bool Token(const char*& start, size_t& length)
+	{
+		SkipSpace();
+		start = cursor;
+		while (cursor < end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n' && *cursor != '#')
+			cursor++;
+		length = cursor - start;
+		return length > 0;
+	}
+
+	bool Number(float& value)
+	{
+		const char* start;
+		size_t length;
+		char buffer[64];
+		if (!Token(start, length) || length >= sizeof(buffer))
+			return false;
+
+		memcpy(buffer, start, length);
+		buffer[length] = '\0';
+		char* parsedEnd;
+		value = strtof(buffer, &parsedEnd);
+		return parsedEnd == buffer + length;
+	}
+
+	bool Vector(Vector3& v) { return Number(v.x) && Number(v.y) && Number(v.z); }
+
+	// Whole numbers too big for a float to hold exactly, like layer bits. 0x for hex
+	bool Integer(long long& value)
+	{
+		const char* start;
+		size_t length;
+		char buffer[64];
+		if (!Token(start, length) || length >= sizeof(buffer))
+			return false;
+
+		memcpy(buffer, start, length);
+		buffer[length] = '\0';
+		char* parsedEnd;
+		value = strtoll(buffer, &parsedEnd, 0);
+		return parsedEnd == buffer + length;
+	}
+
+	bool Fail(const char* message) const
+	{
+		TraceLog(LOG_WARNING, "Scenario: %s:%d: %s", path, line, message);
+		return false;
+	}
+};
+
+bool TokenIs(const char* token, size_t length, const char* word)
+{
+	return strlen(word) == length && memcmp(token, word, length) == 0;
+}
+
+// "circle r", "capsule half_length r", "box half_width half_height" or
+// "polygon n x1 y1 ... xn yn", into shapes
+bool ParseShape(TextParser& parser, ShapeRegistry& shapes, int& outShape)
+{
+	const char* kind;
+	size_t length;
+	if (!parser.Token(kind, length))
+		return false;
+
+	float a = 0.0f, b = 0.0f;
+	if (TokenIs(kind, length, "circle"))
+	{
+		if (!parser.Number(a) || a <= 0.0f)
+			return false;
+		outShape = shapes.AddCircle(a);
+	}
+	else if (TokenIs(kind, length, "capsule") || TokenIs(kind, length, "box"))
+	{
+		if (!parser.Number(a) || !parser.Number(b) || a <= 0.0f || b <= 0.0f)
+			return false;
+		outShape = TokenIs(kind, length, "box") ? shapes.AddBox(a, b) : shapes.AddCapsule(a, b);
+	}
+	else if (TokenIs(kind, length, "polygon"))
+	{
+		// Points past the hull's corners are dropped, so allow a few more than fit
+		float count = 0.0f;
+		if (!parser.Number(count) || count < 3.0f || count > 4.0f * Shape::MAX_VERTICES || count != (int)count)
+			return false;
+
+		std::vector<Vector2> points((int)count);
+		for (Vector2& point : points)
+		{
+			if (!parser.Number(point.x) || !parser.Number(point.y))
+				return false;
+		}
+		outShape = shapes.AddPolygon(points.data(), (int)points.size());
+	}
+	else
+		return false;
+	return outShape >= 0;
+}
+
+/**
+	Reads a body's properties up to the end of the line. Shapes go into shapes,
+	and give the body the MOI that goes with its mass unless it has one.
+*/
+bool ParseBody(TextParser& parser, RigidBody2D& body, ShapeRegistry& shapes)
+{
+	bool hasMOI = false;
+	const char* key;
+	size_t length;
+	while (parser.Token(key, length))
+	{
+		float value = 0.0f;
+		bool ok = true;
+		if (TokenIs(key, length, "position"))
+			ok = parser.Vector(body.position);
+		else if (TokenIs(key, length, "velocity"))
+			ok = parser.Vector(body.velocity);
+		else if (TokenIs(key, length, "rotation"))
+			ok = parser.Number(body.rotation);
+		else if (TokenIs(key, length, "angular_velocity"))
+			ok = parser.Number(body.angularVelocity);
+		else if (TokenIs(key, length, "inverse_mass"))
+			ok = parser.Number(body.inverseMass);
+		else if (TokenIs(key, length, "inverse_moi"))
+		{
+			ok = parser.Number(body.inverseMOI);
+			hasMOI = true;
+		}
+		else if (TokenIs(key, length, "radius"))
+		{
+			ok = parser.Number(body.radius) && body.radius > 0.0f;
+			body.shape = -1;
+		}
+		else if (TokenIs(key, length, "bounding_radius"))
+			ok = parser.Number(value); // worked out from the shape now, older scenes still have it
+		else if (TokenIs(key, length, "shape"))
+			ok = ParseShape(parser, shapes, body.shape);
+		else if (TokenIs(key, length, "size"))
+		{
+			ok = parser.Number(value) && value > 0.0f;
+			if (ok) body.SetCubeSideLength(value);
+		}
+		else if (TokenIs(key, length, "gravity"))
+		{
+			ok = parser.Number(value) && (value == 0.0f || value == 1.0f);
+			body.doGravity = value != 0.0f;
+		}
+		else if (TokenIs(key, length, "bullet"))
+		{
+			ok = parser.Number(value) && (value == 0.0f || value == 1.0f);
+			body.bullet = value != 0.0f;
+		}
+		else if (TokenIs(key, length, "continuous"))
+		{
+			ok = parser.Number(value) && (value == 0.0f || value == 1.0f);
+			body.continuous = value != 0.0f;
+		}
+		else if (TokenIs(key, length, "kinematic"))
+		{
+			ok = parser.Number(value) && (value == 0.0f || value == 1.0f);
+			if (value != 0.0f)
+				body.SetKinematic();
+		}
+		else if (TokenIs(key, length, "layer") || TokenIs(key, length, "mask"))
+		{
+			long long bits = 0;
+			ok = parser.Integer(bits) && bits >= 0 && bits <= 0xFFFFFFFFll;
+			(TokenIs(key, length, "layer") ? body.collisionLayer : body.collisionMask) = (uint32_t)bits;
+		}
+		else if (TokenIs(key, length, "group"))
+		{
+			long long group = 0;
+			ok = parser.Integer(group) && group >= INT32_MIN && group <= INT32_MAX;
+			body.collisionGroup = (int32_t)group;
+		}
+		else if (TokenIs(key, length, "color"))
+		{
+			unsigned char* channels[] = { &body.color.r, &body.color.g, &body.color.b, &body.color.a };
+			for (unsigned char* channel : channels)
+			{
+				ok = ok && parser.Number(value) && value >= 0.0f && value <= 255.0f;
+				*channel = (unsigned char)value;
+			}
+		}
+		else
+			return parser.Fail(TextFormat("unknown property '%.*s'", (int)length, key));
+
+		if (!ok)
+			return parser.Fail(TextFormat("bad value for '%.*s'", (int)length, key));
+	}
+
+	if (body.shape >= 0 && !hasMOI)
+		body.inverseMOI = shapes.Get(body.shape).InverseMOI(body.inverseMass);
+	return true;
+}
+
+bool LoadText(BodyStore& bodies, const MappedFile& file, const char* path)
+{
+	TextParser parser = { (const char*)file.Data(), (const char*)file.Data() + file.Size(), path };
+
+	// Parse everything before adding anything, so a bad file adds nothing
+	std::vector<RigidBody2D> parsed;
+	ShapeRegistry parsedShapes;
+	while (parser.cursor < parser.end)
+	{
+		const char* token;
+		size_t length;
+		if (parser.Token(token, length))
+		{
+			if (!TokenIs(token, length, "body"))
+				return parser.Fail(TextFormat("expected 'body', got '%.*s'", (int)length, token));
+
+			RigidBody2D body;
+			if (!ParseBody(parser, body, parsedShapes))
+				return false;
+			parsed.push_back(body);
+		}
+
+		if (parser.cursor < parser.end)
+		{
+			parser.cursor++; // the newline
+			parser.line++;
+		}
+	}
+
+	bodies.Reserve(bodies.Size() + (int)parsed.size());
+	for (RigidBody2D& body : parsed)
+	{
+		if (body.shape >= 0)
+			body.shape = bodies.shapes.AddCopy(parsedShapes.Get(body.shape));
+		bodies.Add(body);
+	}
+	return true;
+}
+
+// Writes a binary scene through write(data, size)
+template <typename Write>
+void WriteBinary(const BodyStore& bodies, Write write)
+{
+	BinaryHeader header = { SCENARIO_BINARY_MAGIC, SCENARIO_BINARY_VERSION, (uint32_t)bodies.Size(), (uint32_t)bodies.shapes.Count() };
+	write(&header, sizeof(header));
+
+	for (int k = 0; k < bodies.shapes.Count(); k++)
+	{
+		const Shape& shape = bodies.shapes.Get(k);
+		BinaryShape stored = {};
+		stored.type = (int32_t)shape.type;
+		stored.vertexCount = shape.vertexCount;
+		stored.radius = shape.radius;
+		stored.boxHalfSize = shape.boxHalfSize;
+		std::copy(shape.vertices, shape.vertices + Shape::MAX_VERTICES, stored.vertices);
+		write(&stored, sizeof(stored));
+	}
+
+	auto array = [&](const auto& values) { write(values.data(), values.size() * sizeof(values[0])); };
+	array(bodies.position.x); array(bodies.position.y); array(bodies.position.z);
+	array(bodies.velocity.x); array(bodies.velocity.y); array(bodies.velocity.z);
+	array(bodies.rotation);
+	array(bodies.angularVelocity);
+	array(bodies.inverseMass);
+	array(bodies.inverseMOI);
+	array(bodies.shape);
+	array(bodies.color);
+	array(bodies.doGravity);
+	array(bodies.bullet);
+	array(bodies.continuous);
+	array(bodies.kinematic);
+	array(bodies.collisionLayer);
+	array(bodies.collisionMask);
+	array(bodies.collisionGroup);
+}
+
+}
+
+bool ReadScenarioBinary(BodyStore& bodies, const uint8_t* data, size_t size, const char* path)
+{
+	BinaryHeader header;
+	if (size >= sizeof(header))
+		memcpy(&header, data, sizeof(header));
+	if (size < sizeof(header) || header.magic != SCENARIO_BINARY_MAGIC)
+	{
+		TraceLog(LOG_WARNING, "Scenario: %s: not a binary scene", path);
+		return false;
+	}
+	if (header.version != SCENARIO_BINARY_VERSION)
+	{
+		TraceLog(LOG_WARNING, "Scenario: %s: unsupported version %u", path, header.version);
+		return false;
+	}
+	if (size != sizeof(header) + (uint64_t)header.shapeCount * sizeof(BinaryShape) + (uint64_t)header.bodyCount * BINARY_BODY_SIZE)
+	{
+		TraceLog(LOG_WARNING, "Scenario: %s: size doesn't match %u bodies & %u shapes", path, header.bodyCount, header.shapeCount);
+		return false;
+	}
+
+	int count = (int)header.bodyCount;
+	if (count == 0)
+		return true;
+
+	// Check the shapes & every body's shape id before adding anything
+	std::vector<Shape> shapes(header.shapeCount);
+	data += sizeof(header);
+	for (Shape& shape : shapes)
+	{
+		BinaryShape stored;
+		memcpy(&stored, data, sizeof(stored));
+		data += sizeof(stored);
+
+		bool valid = stored.type >= 0 && stored.type < (int)ShapeType::Count
+			&& stored.vertexCount >= 1 && stored.vertexCount <= Shape::MAX_VERTICES;
+		if (valid && stored.type == (int)ShapeType::Circle)
+			valid = stored.radius > 0.0f;
+		else if (valid && stored.type == (int)ShapeType::Capsule)
+			valid = stored.radius > 0.0f && stored.vertexCount == 2 && stored.vertices[1].x > 0.0f;
+		else if (valid && stored.boxHalfSize.x > 0.0f)
+			valid = stored.boxHalfSize.y > 0.0f;
+		if (!valid)
+		{
+			TraceLog(LOG_WARNING, "Scenario: %s: bad shape %d", path, (int)(&shape - shapes.data()));
+			return false;
+		}
+
+		shape.type = (ShapeType)stored.type;
+		shape.vertexCount = stored.vertexCount;
+		shape.radius = stored.radius;
+		shape.boxHalfSize = stored.boxHalfSize;
+		std::copy(stored.vertices, stored.vertices + Shape::MAX_VERTICES, shape.vertices);
+	}
+
+	const uint8_t* shapeIds = data + 10 * count * sizeof(float);
+	for (int i = 0; i < count; i++)
+	{
+		int32_t id;
+		memcpy(&id, shapeIds + i * sizeof(id), sizeof(id));
+		if (id < 0 || id >= (int32_t)shapes.size())
+		{
+			TraceLog(LOG_WARNING, "Scenario: %s: body %d has no shape %d", path, i, id);
+			return false;
+		}
+	}
+
+	std::vector<int> shapeMap(shapes.size());
+	for (size_t k = 0; k < shapes.size(); k++)
+	{
+		shapeMap[k] = bodies.shapes.AddCopy(shapes[k]);
+		if (shapeMap[k] < 0)
+		{
+			TraceLog(LOG_WARNING, "Scenario: %s: bad shape %d", path, (int)k);
+			return false;
+		}
+	}
+
+	int first = bodies.AddBodies(count);
+	auto read = [&](auto& array) {
+		size_t size = count * sizeof(array[0]);
+		memcpy(&array[first], data, size);
+		data += size;
+	};
+
+	read(bodies.position.x); read(bodies.position.y); read(bodies.position.z);
+	read(bodies.velocity.x); read(bodies.velocity.y); read(bodies.velocity.z);
+	read(bodies.rotation);
+	read(bodies.angularVelocity);
+	read(bodies.inverseMass);
+	read(bodies.inverseMOI);
+	read(bodies.shape);
+	read(bodies.color);
+	read(bodies.doGravity);
+	read(bodies.bullet);
+	read(bodies.continuous);
+	read(bodies.kinematic);
+	read(bodies.collisionLayer);
+	read(bodies.collisionMask);
+	read(bodies.collisionGroup);
+	for (int i = first; i < first + count; i++)
+		bodies.SetShape(i, shapeMap[bodies.shape[i]]);
+
+	// New bodies haven't moved yet
+	size_t floatsSize = count * sizeof(float);
+	memcpy(&bodies.oldPos.x[first], &bodies.position.x[first], floatsSize);
+	memcpy(&bodies.oldPos.y[first], &bodies.position.y[first], floatsSize);
+	memcpy(&bodies.oldPos.z[first], &bodies.position.z[first], floatsSize);
+	memcpy(&bodies.oldRotation[first], &bodies.rotation[first], floatsSize);
+	return true;
+}
+
+bool LoadScenarioFile(BodyStore& bodies, const char* path)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		TraceLog(LOG_WARNING, "Scenario: %s: can't open file", path);
+		return false;
+	}
+
+	uint32_t magic = 0;
+	if (file.Size() >= sizeof(BinaryHeader))
+		memcpy(&magic, file.Data(), sizeof(magic));
+
+	if (magic == SCENARIO_BINARY_MAGIC)
+		return ReadScenarioBinary(bodies, file.Data(), file.Size(), path);
+	return LoadText(bodies, file, path);
+}
+
+bool SaveScenarioText(const BodyStore& bodies, const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	// Only what differs from the defaults, %.9g so every float reads back exactly
+	const RigidBody2D defaults;
+	for (int i = 0; i < bodies.Size(); i++)
+	{
+		fprintf(file, "body position %.9g %.9g %.9g", bodies.position.x[i], bodies.position.y[i], bodies.position.z[i]);
+		if (bodies.velocity.x[i] != 0.0f || bodies.velocity.y[i] != 0.0f || bodies.velocity.z[i] != 0.0f)
+			fprintf(file, " velocity %.9g %.9g %.9g", bodies.velocity.x[i], bodies.velocity.y[i], bodies.velocity.z[i]);
+		if (bodies.rotation[i] != defaults.rotation)
+			fprintf(file, " rotation %.9g", bodies.rotation[i]);
+		if (bodies.angularVelocity[i] != defaults.angularVelocity)
+			fprintf(file, " angular_velocity %.9g", bodies.angularVelocity[i]);
+		if (bodies.inverseMass[i] != defaults.inverseMass)
+			fprintf(file, " inverse_mass %.9g", bodies.inverseMass[i]);
+		// Squares are the default shape, anything else needs its MOI so it isn't
+		// worked out from the shape again
+		const Shape& shape = bodies.shapes.Get(bodies.shape[i]);
+		if (bodies.inverseMOI[i] != defaults.inverseMOI || !shape.IsSquare())
+			fprintf(file, " inverse_moi %.9g", bodies.inverseMOI[i]);
+		if (shape.IsSquare())
+		{
+			if (shape.boxHalfSize.x != defaults.radius)
+				fprintf(file, " radius %.9g", shape.boxHalfSize.x);
+		}
+		else if (shape.IsBox())
+			fprintf(file, " shape box %.9g %.9g", shape.boxHalfSize.x, shape.boxHalfSize.y);
+		else if (shape.type == ShapeType::Circle)
+			fprintf(file, " shape circle %.9g", shape.radius);
+		else if (shape.type == ShapeType::Capsule)
+			fprintf(file, " shape capsule %.9g %.9g", shape.vertices[1].x, shape.radius);
+		else
+		{
+			fprintf(file, " shape polygon %d", shape.vertexCount);
+			for (int k = 0; k < shape.vertexCount; k++)
+				fprintf(file, " %.9g %.9g", shape.vertices[k].x, shape.vertices[k].y);
+		}
+		if (bodies.doGravity[i])
+			fprintf(file, " gravity 1");
+		if (bodies.bullet[i])
+			fprintf(file, " bullet 1");
+		if (!bodies.continuous[i])
+			fprintf(file, " continuous 0");
+		if (bodies.kinematic[i])
+			fprintf(file, " kinematic 1");
+		if (bodies.collisionLayer[i] != defaults.collisionLayer)
+			fprintf(file, " layer 0x%x", bodies.collisionLayer[i]);
+		if (bodies.collisionMask[i] != defaults.collisionMask)
+			fprintf(file, " mask 0x%x", bodies.collisionMask[i]);
+		if (bodies.collisionGroup[i] != defaults.collisionGroup)
+			fprintf(file, " group %d", bodies.collisionGroup[i]);
+		Color c = bodies.color[i];
+		if (c.r != defaults.color.r || c.g != defaults.color.g || c.b != defaults.color.b || c.a != defaults.color.a)
+			fprintf(file, " color %d %d %d %d", c.r, c.g, c.b, c.a);
+		fprintf(file, "\n");
+	}
+
+	bool ok = !ferror(file);
+	return fclose(file) == 0 && ok;
+}
+
+bool SaveScenarioBinary(const BodyStore& bodies, const char* path)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	WriteBinary(bodies, [file](const void* data, size_t size) { fwrite(data, 1, size, file); });
+
+	bool ok = !ferror(file);
+	return fclose(file) == 0 && ok;
+}
+
+void WriteScenarioBinary(const BodyStore& bodies, std::vector<uint8_t>& out)
+{
+	out.clear();
+	WriteBinary(bodies, [&out](const void* data, size_t size) {
+		const uint8_t* bytes = (const uint8_t*)data;
+		out.insert(out.end(), bytes, bytes + size);
+	});
+}
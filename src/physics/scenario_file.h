@@ -0,0 +1,55 @@
+#pragma once
+
+#include "body_store.h"
+#include <vector>
+
+/**
+	Scenario files, read through a memory mapping.
+
+	Text scenes (.scene) have one body per line, as "body" followed by any of
+	these properties (the rest keep RigidBody2D's defaults):
+
+		position x y z		velocity x y z		rotation r
+		angular_velocity w	inverse_mass m		inverse_moi i
+		size s (square side)	radius r (square half size)
+		gravity 0|1			bullet 0|1			color r g b a
+		kinematic 0|1 (also zeroes its masses & gravity)
+		continuous 0|1 (0 never sweeps it unless it's a bullet, see PhysicsWorld)
+		layer bits			mask bits			group g		(see BodyStore::ShouldCollide)
+
+	and a shape, instead of the default square:
+
+		shape circle r
+		shape capsule half_length r		(along X)
+		shape box half_width half_height
+		shape polygon n x1 y1 ... xn yn	(the hull of the points, at most 8 corners)
+
+	A body given a shape gets the inverse MOI that goes with it & its mass,
+	unless it has an inverse_moi. bounding_radius is still read but ignored, it
+	comes from the shape. Anything after a # is a comment.
+
+	Binary scenes (.sceneb) are for big generated scenes. After a 16 byte header
+	(magic, version, body count, shape count) come the shapes (see BinaryShape in
+	scenario_file.cpp), then the body arrays, each one count long and in this
+	order: position x/y/z, velocity x/y/z, rotation, angular velocity, inverse
+	mass & inverse MOI as floats, shape as a 32-bit index into the file's
+	shapes, then color as 4 bytes, gravity, bullet, continuous & kinematic as 1
+	byte each, and collision layer, mask & group as 32-bit integers. Values are
+	in the machine's byte order (little-endian on everything we build for).
+	Loading one sizes the body store once and copies each array straight out of
+	the mapping.
+*/
+constexpr uint32_t SCENARIO_BINARY_MAGIC = 0x424E4353; // "SCNB"
+constexpr uint32_t SCENARIO_BINARY_VERSION = 5;
+
+// Adds the bodies in a scene file (either kind, told apart by the magic) to
+// bodies. On errors, logs where and returns false without adding any
+bool LoadScenarioFile(BodyStore& bodies, const char* path);
+
+bool SaveScenarioText(const BodyStore& bodies, const char* path);
+bool SaveScenarioBinary(const BodyStore& bodies, const char* path);
+
+// The binary format in memory, e.g. for the scenes in recordings (see recorder.h).
+// Read adds the bodies like LoadScenarioFile, path is just for the log
+void WriteScenarioBinary(const BodyStore& bodies, std::vector<uint8_t>& out);
+bool ReadScenarioBinary(BodyStore& bodies, const uint8_t* data, size_t size, const char* path);
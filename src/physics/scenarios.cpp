@@ -0,0 +1,236 @@
+#include "scenarios.h"
+
+#include "scenario_file.h"
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+const char* BUILT_IN_NAMES[] = { "Drifting boxes", "Particles", "Chain", "Force fields" };
+
+void LoadBuiltIn(PhysicsWorld& world, int scenario)
+{
+	if (scenario == 0)
+	{
+		// Lots of small boxes drifting around, for comparing broadphases
+		const int columns = 125;
+		const int rows = 80;
+		const float spacing = 1.6f;
+
+		world.random.Seed(3);
+		world.bodies.Reserve(columns * rows);
+		for (int y = 0; y < rows; y++)
+		{
+			for (int x = 0; x < columns; x++)
+			{
+				RigidBody2D rb;
+				rb.position = RVector3((x - columns * 0.5f) * spacing, (y - rows * 0.5f) * spacing, -160);
+				// One at a time, argument evaluation order isn't fixed
+				float vx = world.random.Range(-1.0f, 1.0f);
+				float vy = world.random.Range(-1.0f, 1.0f);
+				rb.velocity = RVector3(vx, vy, 0);
+				rb.rotation = world.random.Range(0.0f, PI);
+				rb.angularVelocity = world.random.Range(-1.0f, 1.0f);
+				rb.SetCubeSideLength(1.0f);
+				rb.color = ColorFromHSV(360.0f * x / columns, 0.6f, 0.9f);
+				world.bodies.Add(rb);
+			}
+		}
+	}
+	if (scenario == 1)
+	{
+		// A million particles poured into a box
+		const int columns = 1000;
+		const int rows = 1000;
+		const float radius = 0.05f;
+		const float spacing = 0.12f;
+
+		ParticleSystem& particles = world.particles;
+		particles.z = -180;
+		particles.boundsMin = { -70, -60 };
+		particles.boundsMax = { 70, 80 };
+
+		world.random.Seed(1);
+		particles.Reserve(columns * rows);
+		for (int y = 0; y < rows; y++)
+		{
+			for (int x = 0; x < columns; x++)
+			{
+				Particle p;
+				float jitterX = world.random.Range(-0.01f, 0.01f);
+				float jitterY = world.random.Range(-0.01f, 0.01f);
+				p.position = RVector3((x - columns * 0.5f) * spacing + jitterX, y * spacing - 50 + jitterY, 0);
+				p.radius = radius;
+				p.doGravity = true;
+				p.color = ColorFromHSV(200.0f + 60.0f * y / rows, 0.7f, 0.9f);
+				particles.Add(p);
+			}
+		}
+	}
+	if (scenario == 2)
+	{
+		// A thousand capsules in a swinging chain
+		AddChain(world, 1000);
+	}
+	if (scenario == 3)
+	{
+		// A disc of circles orbiting an attractor, slowed by drag so they spiral in
+		// & pile up on each other. Every fourth is also in a wind, and above them
+		// boxes bounce on springs under gravity
+		const int count = 10000;
+		const float innerRadius = 10.0f, outerRadius = 60.0f;
+		const float strength = 2000.0f, softening = 2.0f;
+		const float z = -200;
+		const uint32_t swarm = 1, windy = 2, hanging = 4;
+
+		ForceAccumulator& forces = world.forces;
+		forces.AddAttractor(swarm | windy, { 0, 0 }, strength, softening);
+		forces.AddDrag(swarm | windy, 0.02f, 0.0f, 0.1f);
+		forces.AddWind(windy, { 6, 0 }, 0.05f);
+
+		world.random.Seed(7);
+		world.bodies.Reserve(count + 9);
+		int circle = world.bodies.shapes.AddCircle(0.3f);
+		for (int i = 0; i < count; i++)
+		{
+			// Even over the disc's area, going round at the speed that keeps a circular orbit
+			float angle = world.random.Range(0.0f, 2 * PI);
+			float t = world.random.Range(0.0f, 1.0f);
+			float r = sqrtf(innerRadius * innerRadius + t * (outerRadius * outerRadius - innerRadius * innerRadius));
+			float s2 = r * r + softening * softening;
+			float speed = sqrtf(strength * r * r / (s2 * sqrtf(s2)));
+
+			RigidBody2D rb;
+			rb.shape = circle;
+			rb.position = RVector3(r * cosf(angle), r * sinf(angle), z);
+			rb.velocity = RVector3(-speed * sinf(angle), speed * cosf(angle), 0);
+			rb.inverseMOI = world.bodies.shapes.Get(circle).InverseMOI(rb.inverseMass);
+			rb.forceGroups = i % 4 == 0 ? windy : swarm;
+			rb.color = i % 4 == 0 ? SKYBLUE : ColorFromHSV(30.0f + 30.0f * (r - innerRadius) / (outerRadius - innerRadius), 0.7f, 0.95f);
+			world.bodies.Add(rb);
+		}
+
+		RigidBody2D bar;
+		bar.inverseMass = 0.0f;
+		bar.inverseMOI = 0.0f;
+		bar.shape = world.bodies.shapes.AddBox(20.0f, 0.5f);
+		bar.position = RVector3(0, 80, z);
+		bar.color = LIGHTGRAY;
+		BodyHandle barHandle = world.bodies.Add(bar);
+
+		for (int i = 0; i < 8; i++)
+		{
+			RigidBody2D box;
+			box.position = RVector3(-17.5f + i * 5.0f, 72, z);
+			box.SetCubeSideLength(2.0f);
+			box.doGravity = true;
+			box.forceGroups = hanging;
+			box.color = ColorFromHSV(45.0f * i, 0.6f, 0.9f);
+			BodyHandle handle = world.bodies.Add(box);
+
+			// Softer to the right, hung off center so they swing as well as bounce
+			float x = box.position.x;
+			forces.AddSpring(world.bodies, barHandle, handle, { x, 79.5f }, { x + 0.5f, 73.0f }, 40.0f - 4.0f * i, 0.5f);
+		}
+	}
+}
+
+// "04_box_stack" -> "Box stack"
+std::string DisplayName(const char* path)
+{
+	std::string name = GetFileNameWithoutExt(path);
+	size_t start = 0;
+	while (start < name.size() && (isdigit((unsigned char)name[start]) || name[start] == '_'))
+		start++;
+	if (start < name.size())
+		name.erase(0, start);
+
+	std::replace(name.begin(), name.end(), '_', ' ');
+	if (!name.empty())
+		name[0] = (char)toupper((unsigned char)name[0]);
+	return name;
+}
+
+}
+
+/**
+	Capsules pinned together end to end, hanging from a pin & pushed so the whole
+	chain swings. It stretches under its own weight, a long chain needs lots of
+	iterations to hold together. The links far down move several times their size
+	a step, with only other links to tunnel through, so they aren't swept.
+*/
+void AddChain(PhysicsWorld& world, int links)
+{
+	const float linkLength = 0.25f;
+	const float swing = 0.05f;	// rad/s, as if the chain were one rigid rod
+	const float z = -500;
+
+	RigidBody2D pin;
+	pin.inverseMass = 0.0f;
+	pin.inverseMOI = 0.0f;
+	pin.shape = world.bodies.shapes.AddCircle(0.1f);
+	pin.position = RVector3(0, 180, z);
+	pin.color = LIGHTGRAY;
+
+	world.bodies.Reserve(world.bodies.Size() + links + 1);
+	world.jointSolver.joints.reserve(world.jointSolver.joints.size() + links);
+	BodyHandle previous = world.bodies.Add(pin);
+
+	int capsule = world.bodies.shapes.AddCapsule(linkLength * 0.5f, 0.06f);
+	for (int i = 0; i < links; i++)
+	{
+		float depth = (i + 0.5f) * linkLength;
+		RigidBody2D rb;
+		rb.shape = capsule;
+		rb.position = RVector3(pin.position.x, pin.position.y - depth, z);
+		rb.rotation = -PI / 2;
+		rb.velocity = RVector3(swing * depth, 0, 0);
+		rb.angularVelocity = swing;
+		rb.inverseMOI = world.bodies.shapes.Get(capsule).InverseMOI(rb.inverseMass);
+		rb.doGravity = true;
+		rb.continuous = false;
+		rb.color = ColorFromHSV(360.0f * i / links, 0.6f, 0.9f);
+		BodyHandle link = world.bodies.Add(rb);
+		world.jointSolver.AddRevolute(world.bodies, previous, link, { pin.position.x, pin.position.y - i * linkLength });
+		previous = link;
+	}
+}
+
+std::vector<ScenarioInfo> FindScenarios(const char* directory)
+{
+	std::vector<ScenarioInfo> scenarios;
+	if (DirectoryExists(directory))
+	{
+		FilePathList files = LoadDirectoryFilesEx(directory, ".scene;.sceneb", false);
+		for (unsigned int i = 0; i < files.count; i++)
+		{
+			ScenarioInfo info;
+			info.name = DisplayName(files.paths[i]);
+			info.path = files.paths[i];
+			scenarios.push_back(info);
+		}
+		UnloadDirectoryFiles(files);
+
+		std::sort(scenarios.begin(), scenarios.end(),
+			[](const ScenarioInfo& a, const ScenarioInfo& b) { return a.path < b.path; });
+	}
+
+	for (int i = 0; i < (int)(sizeof(BUILT_IN_NAMES) / sizeof(BUILT_IN_NAMES[0])); i++)
+	{
+		ScenarioInfo info;
+		info.name = BUILT_IN_NAMES[i];
+		info.builtIn = i;
+		scenarios.push_back(info);
+	}
+	return scenarios;
+}
+
+bool LoadScenario(PhysicsWorld& world, const ScenarioInfo& scenario)
+{
+	if (scenario.builtIn >= 0)
+	{
+		LoadBuiltIn(world, scenario.builtIn);
+		return true;
+	}
+	return LoadScenarioFile(world.bodies, scenario.path.c_str());
+}
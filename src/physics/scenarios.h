@@ -0,0 +1,28 @@
+#pragma once
+
+#include "physics_world.h"
+#include <string>
+#include <vector>
+
+/**
+	The demo scenes. Shared by the app and the headless benchmark, so both run
+	exactly the same setups.
+
+	Most are scene files (see scenario_file.h) in resources/scenarios, listed in
+	file name order. Generated ones are built in and come after them.
+*/
+struct ScenarioInfo {
+	std::string name;
+	std::string path;		// empty for built in scenarios
+	int builtIn = -1;
+};
+
+// Scene files in directory, then the built in scenarios
+std::vector<ScenarioInfo> FindScenarios(const char* directory);
+
+// Adds the scenario's bodies to a world that's just been Init'ed. Returns
+// false if its file couldn't be loaded
+bool LoadScenario(PhysicsWorld& world, const ScenarioInfo& scenario);
+
+// The Chain scenario's chain with any number of links, for the joint benchmark
+void AddChain(PhysicsWorld& world, int links);
@@ -0,0 +1,271 @@
+#include "shape.h"
+
+#include <algorithm>
+#include <cmath>
+
+const char* ShapeTypeName(ShapeType type)
+{
+	switch (type)
+	{
+	case ShapeType::Circle:		return "Circle";
+	case ShapeType::Capsule:	return "Capsule";
+	case ShapeType::Polygon:	return "Polygon";
+	default:					return "Unknown";
+	}
+}
+
+namespace {
+
+// Kinds of shapes made from sizes, for sharing them
+enum SizedKind { SIZED_CIRCLE = 0, SIZED_CAPSULE, SIZED_BOX };
+
+float Cross(Vector2 a, Vector2 b)
+{
+	return a.x * b.y - a.y * b.x;
+}
+
+// Outward normals of a clockwise core. A segment's two "edges" are its two sides
+void ComputeNormals(Shape& shape)
+{
+	if (shape.vertexCount < 2)
+		return;
+
+	for (int i = 0; i < shape.vertexCount; i++)
+	{
+		Vector2 a = shape.vertices[i], b = shape.vertices[(i + 1) % shape.vertexCount];
+		float dx = b.x - a.x, dy = b.y - a.y;
+		float length = sqrtf(dx * dx + dy * dy);
+		// 0 - rather than unary minus, so axis aligned normals don't get a -0
+		shape.normals[i] = { 0.0f - dy / length, dx / length };
+	}
+}
+
+/**
+	Area & moment of inertia of a polygon about the origin, summed over the
+	triangles between the origin and each edge (like Box2D's b2ComputePolygonMass).
+	Clockwise winding makes every triangle's area negative, hence fabsf.
+*/
+void PolygonMass(const Vector2* vertices, int count, float& outArea, float& outInertia)
+{
+	float area = 0.0f, inertia = 0.0f;
+	for (int i = 0; i < count; i++)
+	{
+		Vector2 e1 = vertices[i], e2 = vertices[(i + 1) % count];
+		float d = Cross(e1, e2);
+		area += 0.5f * d;
+
+		float intx2 = e1.x * e1.x + e2.x * e1.x + e2.x * e2.x;
+		float inty2 = e1.y * e1.y + e2.y * e1.y + e2.y * e2.y;
+		inertia += (0.25f / 3.0f * d) * (intx2 + inty2);
+	}
+	outArea = fabsf(area);
+	outInertia = fabsf(inertia);
+}
+
+}
+
+int ShapeRegistry::AddCircle(float radius)
+{
+	int found = FindSized(SIZED_CIRCLE, radius, 0.0f);
+	if (found >= 0)
+		return found;
+
+	Shape shape;
+	shape.type = ShapeType::Circle;
+	shape.vertexCount = 1;
+	shape.radius = radius;
+	shape.area = PI * radius * radius;
+	shape.unitInertia = 0.5f * radius * radius;
+
+	int id = Add(shape);
+	sized[std::make_tuple(SIZED_CIRCLE, radius, 0.0f)] = id;
+	return id;
+}
+
+int ShapeRegistry::AddCapsule(float halfLength, float radius)
+{
+	int found = FindSized(SIZED_CAPSULE, halfLength, radius);
+	if (found >= 0)
+		return found;
+
+	Shape shape;
+	shape.type = ShapeType::Capsule;
+	shape.vertexCount = 2;
+	shape.vertices[0] = { -halfLength, 0.0f };
+	shape.vertices[1] = { halfLength, 0.0f };
+	shape.radius = radius;
+
+	// A box plus two half circles at its ends. Each half circle's centroid is
+	// 4r / 3pi in from its end, so it goes through the parallel axis theorem twice
+	float rr = radius * radius;
+	float circleArea = PI * rr, boxArea = 4.0f * radius * halfLength;
+	float lc = 4.0f * radius / (3.0f * PI);
+	float circleInertia = circleArea * (0.5f * rr + halfLength * halfLength + 2.0f * halfLength * lc);
+	float boxInertia = boxArea * (4.0f * rr + 4.0f * halfLength * halfLength) / 12.0f;
+	shape.area = circleArea + boxArea;
+	shape.unitInertia = (circleInertia + boxInertia) / shape.area;
+
+	int id = Add(shape);
+	sized[std::make_tuple(SIZED_CAPSULE, halfLength, radius)] = id;
+	return id;
+}
+
+int ShapeRegistry::AddBox(float halfWidth, float halfHeight)
+{
+	int found = FindSized(SIZED_BOX, halfWidth, halfHeight);
+	if (found >= 0)
+		return found;
+
+	Shape shape;
+	shape.type = ShapeType::Polygon;
+	shape.vertexCount = 4;
+	shape.vertices[0] = { -halfWidth, -halfHeight };
+	shape.vertices[1] = { -halfWidth, halfHeight };
+	shape.vertices[2] = { halfWidth, halfHeight };
+	shape.vertices[3] = { halfWidth, -halfHeight };
+	shape.boxHalfSize = { halfWidth, halfHeight };
+	shape.area = 4.0f * halfWidth * halfHeight;
+	shape.unitInertia = (halfWidth * halfWidth + halfHeight * halfHeight) / 3.0f;
+
+	int id = Add(shape);
+	sized[std::make_tuple(SIZED_BOX, halfWidth, halfHeight)] = id;
+	return id;
+}
+
+/**
+	Andrew's monotone chain: sorts the points along X, then walks them left to
+	right for the lower half of the hull and back for the upper half, dropping
+	points that don't turn the right way (collinear ones included). That gives
+	the hull counterclockwise, which is then reversed.
+*/
+int ShapeRegistry::AddPolygon(const Vector2* points, int count)
+{
+	std::vector<Vector2> sorted(points, points + count);
+	std::sort(sorted.begin(), sorted.end(), [](Vector2 a, Vector2 b) { return a.x != b.x ? a.x < b.x : a.y < b.y; });
+
+	std::vector<Vector2> hull(2 * sorted.size());
+	int size = 0;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		int start = size;
+		for (int k = 0; k < (int)sorted.size(); k++)
+		{
+			Vector2 p = pass == 0 ? sorted[k] : sorted[sorted.size() - 1 - k];
+			while (size >= start + 2 && Cross({ hull[size - 1].x - hull[size - 2].x, hull[size - 1].y - hull[size - 2].y },
+				{ p.x - hull[size - 2].x, p.y - hull[size - 2].y }) <= 0.0f)
+				size--;
+			hull[size++] = p;
+		}
+		size--; // the last point starts the other half
+	}
+	if (size < 3 || size > Shape::MAX_VERTICES)
+		return -1;
+
+	Shape shape;
+	shape.type = ShapeType::Polygon;
+	shape.vertexCount = size;
+	for (int i = 0; i < size; i++)
+		shape.vertices[i] = hull[size - 1 - i];
+
+	// Centroid, with the triangles fanned out from the first vertex to keep the
+	// numbers small
+	Vector2 origin = shape.vertices[0];
+	float area = 0.0f;
+	Vector2 centroid = { 0.0f, 0.0f };
+	for (int i = 1; i < size - 1; i++)
+	{
+		Vector2 e1 = { shape.vertices[i].x - origin.x, shape.vertices[i].y - origin.y };
+		Vector2 e2 = { shape.vertices[i + 1].x - origin.x, shape.vertices[i + 1].y - origin.y };
+		float triangleArea = 0.5f * Cross(e1, e2);
+		area += triangleArea;
+		centroid.x += triangleArea * (e1.x + e2.x) / 3.0f;
+		centroid.y += triangleArea * (e1.y + e2.y) / 3.0f;
+	}
+	if (fabsf(area) <= 1e-6f)
+		return -1;
+
+	centroid = { origin.x + centroid.x / area, origin.y + centroid.y / area };
+	for (int i = 0; i < size; i++)
+		shape.vertices[i] = { shape.vertices[i].x - centroid.x, shape.vertices[i].y - centroid.y };
+
+	float inertia;
+	PolygonMass(shape.vertices, size, shape.area, inertia);
+	shape.unitInertia = inertia / shape.area;
+	return Add(shape);
+}
+
+int ShapeRegistry::AddCopy(const Shape& shape)
+{
+	switch (shape.type)
+	{
+	case ShapeType::Circle:		return AddCircle(shape.radius);
+	case ShapeType::Capsule:	return AddCapsule(shape.vertices[1].x, shape.radius);
+	default:
+		break;
+	}
+	if (shape.IsBox())
+		return AddBox(shape.boxHalfSize.x, shape.boxHalfSize.y);
+	if (shape.vertexCount < 3 || shape.vertexCount > Shape::MAX_VERTICES)
+		return -1;
+
+	// Already a hull around its centroid, making it again would move it by
+	// rounding errors
+	Shape copy;
+	copy.vertexCount = shape.vertexCount;
+	std::copy(shape.vertices, shape.vertices + shape.vertexCount, copy.vertices);
+	float inertia;
+	PolygonMass(copy.vertices, copy.vertexCount, copy.area, inertia);
+	if (copy.area <= 0.0f)
+		return -1;
+	copy.unitInertia = inertia / copy.area;
+	return Add(copy);
+}
+
+void ShapeRegistry::Clear()
+{
+	shapes.clear();
+	sized.clear();
+}
+
+int ShapeRegistry::FindSized(int kind, float size1, float size2) const
+{
+	auto found = sized.find(std::make_tuple(kind, size1, size2));
+	return found != sized.end() ? found->second : -1;
+}
+
+// Fills in the normals & bounds, the rest is up to the caller
+int ShapeRegistry::Add(Shape& shape)
+{
+	ComputeNormals(shape);
+
+	float furthest = 0.0f;
+	for (int i = 0; i < shape.vertexCount; i++)
+		furthest = std::max(furthest, sqrtf(shape.vertices[i].x * shape.vertices[i].x + shape.vertices[i].y * shape.vertices[i].y));
+	shape.boundingRadius = furthest + shape.radius;
+
+	// Polygons reach the least far at the nearest edge, rounded cores everywhere
+	// at least their radius (they're centered on their core)
+	shape.innerRadius = shape.radius;
+	if (shape.type == ShapeType::Polygon)
+	{
+		shape.innerRadius = INFINITY;
+		for (int i = 0; i < shape.vertexCount; i++)
+		{
+			float distance = shape.normals[i].x * shape.vertices[i].x + shape.normals[i].y * shape.vertices[i].y;
+			shape.innerRadius = std::min(shape.innerRadius, distance);
+		}
+	}
+
+	shapes.push_back(shape);
+	return (int)shapes.size() - 1;
+}
+
+void TransformShape(const Shape& shape, RVector3 position, float rotation, RVector3* outVertices, RVector3* outNormals)
+{
+	RQuaternion quaternion = RQuaternion::FromAxisAngle({ 0,0,1 }, rotation);
+	for (int i = 0; i < shape.vertexCount; i++)
+	{
+		outVertices[i] = position + RVector3(shape.vertices[i].x, shape.vertices[i].y, 0).RotateByQuaternion(quaternion);
+		outNormals[i] = RVector3(shape.normals[i].x, shape.normals[i].y, 0).RotateByQuaternion(quaternion);
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "raylib-cpp.hpp"
+#include <map>
+#include <tuple>
+#include <vector>
+
+enum class ShapeType {
+	Circle = 0,		// a point, rounded by radius
+	Capsule,		// a segment, rounded by radius
+	Polygon,		// convex, up to Shape::MAX_VERTICES corners
+	Count
+};
+
+const char* ShapeTypeName(ShapeType type);
+
+/**
+	Collision geometry in a body's local space, worked out once when it's added
+	to a ShapeRegistry and shared by every body using it.
+
+	Every shape is a convex core rounded by radius: a circle's core is a point, a
+	capsule's a segment along X and a polygon's its corners (polygons aren't
+	rounded). Cores are wound clockwise like the rest of the narrowphase, normal i
+	belonging to the edge from vertex i to vertex i + 1, and centered on the
+	shape's centroid, which bodies rotate about.
+*/
+struct Shape {
+	static constexpr int MAX_VERTICES = 8;
+
+	ShapeType type = ShapeType::Polygon;
+	int vertexCount = 0;
+	Vector2 vertices[MAX_VERTICES] = {};
+	Vector2 normals[MAX_VERTICES] = {};	// a circle has none
+	float radius = 0.0f;
+
+	float boundingRadius = 0.0f;	// smallest circle around the centroid holding the shape
+	float innerRadius = 0.0f;		// largest circle around the centroid inside it
+	float area = 0.0f;
+	float unitInertia = 0.0f;		// moment of inertia about the centroid, per unit of mass
+
+	Vector2 boxHalfSize = { 0.0f, 0.0f };	// boxes only, which AddBox makes
+
+	bool IsBox() const { return boxHalfSize.x > 0.0f; }
+	bool IsSquare() const { return IsBox() && boxHalfSize.x == boxHalfSize.y; }
+
+	// Inverse moment of inertia for a body of this shape with the given inverse mass
+	float InverseMOI(float inverseMass) const { return inverseMass / unitInertia; }
+};
+
+/**
+	Every shape bodies in a BodyStore can have, referred to by index. Circles,
+	capsules & boxes of a size that was added before come back as the same
+	shape, so a scene of a thousand identical boxes has one. Shapes are never
+	removed one at a time, ids stay valid until Clear.
+*/
+class ShapeRegistry {
+
+public:
+	// Sizes must be positive
+	int AddCircle(float radius);
+	// Along local X, halfLength from the center to each end of the segment
+	int AddCapsule(float halfLength, float radius);
+	int AddBox(float halfWidth, float halfHeight);
+	// Convex hull of the points, moved so its centroid is the origin. Returns -1
+	// if the hull has more than MAX_VERTICES corners or no area
+	int AddPolygon(const Vector2* points, int count);
+	// The same shape as one from another registry (or a file), made the same
+	// way. Returns -1 for a polygon with too few or too many vertices, or no area
+	int AddCopy(const Shape& shape);
+
+	const Shape& Get(int shape) const { return shapes[shape]; }
+	int Count() const { return (int)shapes.size(); }
+	bool IsValid(int shape) const { return shape >= 0 && shape < Count(); }
+	void Clear();
+
+private:
+	std::vector<Shape> shapes;
+	// (type, two sizes) of the circles, capsules & boxes added so far
+	std::map<std::tuple<int, float, float>, int> sized;
+
+	int FindSized(int kind, float size1, float size2) const;
+	int Add(Shape& shape);
+
+};
+
+/**
+	A shape moved into world space, pointing at its vertices & normals wherever
+	they're kept (PhysicsWorld keeps every body's for the step). Z is ignored.
+*/
+struct WorldShape {
+	ShapeType type;
+	const RVector3* vertices;
+	const RVector3* normals;
+	int count;
+	float radius;
+};
+
+// Rotates a shape's core by rotation about Z & moves it to position
+void TransformShape(const Shape& shape, RVector3 position, float rotation, RVector3* outVertices, RVector3* outNormals);
@@ -0,0 +1,17 @@
+#pragma once
+
+/*
+	What the hand written SSE2/AVX2 kernels need (see SimdLevel): SIMD_X86 is
+	defined on x86 with the intrinsics included, and TARGET_AVX2 marks functions
+	that use AVX2, so the rest of the build doesn't have to assume the CPU has it.
+*/
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
@@ -0,0 +1,50 @@
+#include "snapshot.h"
+
+#include "physics_world.h"
+#include <algorithm>
+#include <chrono>
+
+void SnapshotRing::SetCapacity(int capacity)
+{
+	snapshots.resize(std::max(capacity, 0));
+	newest = -1;
+	count = 0;
+}
+
+void SnapshotRing::Push(const PhysicsWorld& world)
+{
+	if (snapshots.empty())
+		return;
+
+	auto start = std::chrono::steady_clock::now();
+
+	newest = (newest + 1) % Capacity();
+	world.SaveSnapshot(snapshots[newest]);
+	count = std::min(count + 1, Capacity());
+
+	lastPushMicroseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool SnapshotRing::Restore(PhysicsWorld& world, int age) const
+{
+	if (age < 0 || age >= count)
+		return false;
+
+	int index = (newest - age + Capacity()) % Capacity();
+	return world.RestoreSnapshot(snapshots[index]);
+}
+
+void SnapshotRing::DropNewest(int dropCount)
+{
+	dropCount = std::min(std::max(dropCount, 0), count);
+	newest = (newest - dropCount + Capacity()) % Capacity();
+	count -= dropCount;
+}
+
+size_t SnapshotRing::MemoryUsed() const
+{
+	size_t bytes = 0;
+	for (const WorldSnapshot& snapshot : snapshots)
+		bytes += snapshot.data.capacity();
+	return bytes;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class PhysicsWorld;
+
+/**
+	Everything that changes while a world steps, copied into one flat buffer: the
+	bodies (with their handle tables), the joints & force generators, the contact
+	impulses kept for warm starting, the random number generator and the step
+	counter. Restoring one and stepping again gives bit-identical results to the
+	first time around.
+
+	Settings (gravity, solver iterations, ...) aren't part of it, and neither is
+	anything rebuilt from scratch every step (pairs, constraints, islands).
+	Particles aren't either, there can be far too many of them to copy each step.
+
+	The buffer is kept between saves, so saving into the same snapshot again only
+	allocates if the world has grown.
+*/
+struct WorldSnapshot {
+	std::vector<uint8_t> data;
+};
+
+// Appends raw values & arrays to a snapshot buffer
+class SnapshotWriter {
+
+public:
+	explicit SnapshotWriter(std::vector<uint8_t>& buffer) : buffer(buffer) { buffer.clear(); }
+
+	void Write(const void* data, size_t size)
+	{
+		const uint8_t* bytes = (const uint8_t*)data;
+		buffer.insert(buffer.end(), bytes, bytes + size);
+	}
+
+	template <typename T>
+	void Value(const T& value) { Write(&value, sizeof(T)); }
+
+	// Length first, then the elements as they are in memory
+	template <typename T>
+	void Array(const std::vector<T>& array)
+	{
+		Value((uint32_t)array.size());
+		Write(array.data(), array.size() * sizeof(T));
+	}
+
+private:
+	std::vector<uint8_t>& buffer;
+
+};
+
+// Reads back what a SnapshotWriter wrote, in the same order. Once a read runs
+// past the end every later one fails too, so callers can check Failed at the end
+class SnapshotReader {
+
+public:
+	explicit SnapshotReader(const std::vector<uint8_t>& buffer) : buffer(buffer) {}
+
+	bool Read(void* data, size_t size)
+	{
+		if (failed || size > buffer.size() - position)
+		{
+			failed = true;
+			return false;
+		}
+		memcpy(data, buffer.data() + position, size);
+		position += size;
+		return true;
+	}
+
+	template <typename T>
+	bool Value(T& value) { return Read(&value, sizeof(T)); }
+
+	template <typename T>
+	bool Array(std::vector<T>& array)
+	{
+		uint32_t count;
+		if (!Value(count))
+			return false;
+		if ((size_t)count * sizeof(T) > buffer.size() - position)
+		{
+			failed = true;
+			return false;
+		}
+		array.resize(count);
+		return Read(array.data(), count * sizeof(T));
+	}
+
+	bool Failed() const { return failed; }
+
+private:
+	const std::vector<uint8_t>& buffer;
+	size_t position = 0;
+	bool failed = false;
+
+};
+
+/**
+	The last few snapshots of a world, for rewinding. Pushing when it's full
+	writes over the oldest one, reusing its buffer.
+*/
+class SnapshotRing {
+
+public:
+	// Forgets every snapshot
+	void SetCapacity(int capacity);
+	int Capacity() const { return (int)snapshots.size(); }
+	int Count() const { return count; }
+
+	void Push(const PhysicsWorld& world);
+
+	// Restores the snapshot pushed age pushes ago (0 is the newest)
+	bool Restore(PhysicsWorld& world, int age) const;
+
+	// Forgets the newest snapshots, e.g. the ones after a snapshot that's been
+	// restored to resimulate from there
+	void DropNewest(int dropCount);
+	void Clear() { count = 0; }
+
+	size_t MemoryUsed() const;
+	float lastPushMicroseconds = 0.0f;
+
+private:
+	std::vector<WorldSnapshot> snapshots;
+	int newest = -1;
+	int count = 0;
+
+};
@@ -0,0 +1,377 @@
+#include "physics_world.h"
+
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+
+// Exact tests against a body's shape. Most are done in the shape's own space,
+// where its core is where the registry keeps it
+
+static Vector2 ToShapeSpace(Vector2 center, float cosR, float sinR, Vector2 point)
+{
+	float dx = point.x - center.x, dy = point.y - center.y;
+	return { cosR * dx + sinR * dy, -sinR * dx + cosR * dy };
+}
+
+static float Dot(Vector2 a, Vector2 b)
+{
+	return a.x * b.x + a.y * b.y;
+}
+
+static float PointSegmentDistance(Vector2 p, Vector2 a, Vector2 b)
+{
+	Vector2 ab = { b.x - a.x, b.y - a.y }, ap = { p.x - a.x, p.y - a.y };
+	float lengthSqr = Dot(ab, ab);
+	float t = lengthSqr > 0.0f ? std::max(0.0f, std::min(Dot(ap, ab) / lengthSqr, 1.0f)) : 0.0f;
+	float dx = ap.x - ab.x * t, dy = ap.y - ab.y * t;
+	return sqrtf(dx * dx + dy * dy);
+}
+
+// From a point to the shape's core, 0 inside a polygon
+static float CoreDistance(const Shape& shape, Vector2 point)
+{
+	if (shape.vertexCount == 1)
+		return PointSegmentDistance(point, shape.vertices[0], shape.vertices[0]);
+
+	if (shape.type == ShapeType::Polygon)
+	{
+		bool inside = true;
+		for (int i = 0; i < shape.vertexCount && inside; i++)
+			inside = Dot(shape.normals[i], { point.x - shape.vertices[i].x, point.y - shape.vertices[i].y }) <= 0.0f;
+		if (inside)
+			return 0.0f;
+	}
+
+	// A segment's two edges are the same one
+	int edges = shape.vertexCount == 2 ? 1 : shape.vertexCount;
+	float distance = INFINITY;
+	for (int i = 0; i < edges; i++)
+		distance = std::min(distance, PointSegmentDistance(point, shape.vertices[i], shape.vertices[(i + 1) % shape.vertexCount]));
+	return distance;
+}
+
+static bool ShapeContainsPoint(const Shape& shape, Vector2 center, float rotation, Vector2 point)
+{
+	Vector2 local = ToShapeSpace(center, cosf(rotation), sinf(rotation), point);
+	return CoreDistance(shape, local) <= shape.radius;
+}
+
+static bool ShapeOverlapsCircle(const Shape& shape, Vector2 center, float rotation, const CircleQuery& circle)
+{
+	Vector2 local = ToShapeSpace(center, cosf(rotation), sinf(rotation), circle.center);
+	return CoreDistance(shape, local) <= shape.radius + circle.radius;
+}
+
+static float PointAabbDistance(Vector2 p, const Aabb& box)
+{
+	float dx = p.x - std::max(box.min.x, std::min(p.x, box.max.x));
+	float dy = p.y - std::max(box.min.y, std::min(p.y, box.max.y));
+	return sqrtf(dx * dx + dy * dy);
+}
+
+/**
+	Separating axis test between the box & the shape's core in world space, on
+	the box's two axes & the core's edge normals. Those are all the axes there
+	are, so a core that isn't separated overlaps. One that is is measured
+	against the radius: corners of each against edges of the other.
+*/
+static bool ShapeOverlapsAabb(const Shape& shape, Vector2 center, float rotation, const Aabb& box)
+{
+	float c = cosf(rotation), s = sinf(rotation);
+	Vector2 vertices[Shape::MAX_VERTICES];
+	Aabb core = { { INFINITY, INFINITY }, { -INFINITY, -INFINITY } };
+	for (int i = 0; i < shape.vertexCount; i++)
+	{
+		Vector2 v = shape.vertices[i];
+		vertices[i] = { center.x + c * v.x - s * v.y, center.y + s * v.x + c * v.y };
+		core = Aabb::Union(core, { vertices[i], vertices[i] });
+	}
+
+	bool separated = !core.Overlaps(box);
+	if (shape.vertexCount >= 2)
+	{
+		float halfX = 0.5f * (box.max.x - box.min.x), halfY = 0.5f * (box.max.y - box.min.y);
+		Vector2 boxCenter = { 0.5f * (box.min.x + box.max.x), 0.5f * (box.min.y + box.max.y) };
+		for (int i = 0; i < shape.vertexCount && !separated; i++)
+		{
+			Vector2 n = shape.normals[i];
+			Vector2 normal = { c * n.x - s * n.y, s * n.x + c * n.y };
+			float boxNearest = Dot(normal, boxCenter) - (halfX * fabsf(normal.x) + halfY * fabsf(normal.y));
+			separated = boxNearest > Dot(normal, vertices[i]);
+		}
+	}
+	if (!separated)
+		return true;
+	if (shape.radius <= 0.0f)
+		return false;
+
+	float distance = INFINITY;
+	for (int i = 0; i < shape.vertexCount; i++)
+		distance = std::min(distance, PointAabbDistance(vertices[i], box));
+	if (shape.vertexCount >= 2)
+	{
+		Vector2 corners[4] = { box.min, { box.min.x, box.max.y }, box.max, { box.max.x, box.min.y } };
+		int edges = shape.vertexCount == 2 ? 1 : shape.vertexCount;
+		for (Vector2 corner : corners)
+		{
+			for (int i = 0; i < edges; i++)
+				distance = std::min(distance, PointSegmentDistance(corner, vertices[i], vertices[(i + 1) % shape.vertexCount]));
+		}
+	}
+	return distance <= shape.radius;
+}
+
+/**
+	Where a ray enters a polygon, clipping it to each edge's half plane (like
+	Box2D's b2RayCastPolygon). Rays that start inside don't hit.
+*/
+static bool PolygonRayCast(const Vector2* vertices, const Vector2* normals, int count, Vector2 origin, Vector2 direction,
+	float maxDistance, float& outDistance, Vector2& outNormal)
+{
+	float lower = 0.0f, upper = maxDistance;
+	int entered = -1;
+	for (int i = 0; i < count; i++)
+	{
+		// The ray is inside this edge's half plane for distances where numerator > denominator * t
+		float numerator = Dot(normals[i], { vertices[i].x - origin.x, vertices[i].y - origin.y });
+		float denominator = Dot(normals[i], direction);
+		if (denominator == 0.0f)
+		{
+			if (numerator < 0.0f)
+				return false;
+		}
+		else if (denominator < 0.0f && numerator < lower * denominator)
+		{
+			lower = numerator / denominator;
+			entered = i;
+		}
+		else if (denominator > 0.0f && numerator < upper * denominator)
+			upper = numerator / denominator;
+
+		if (upper < lower)
+			return false;
+	}
+	if (entered < 0)
+		return false;
+
+	outDistance = lower;
+	outNormal = normals[entered];
+	return true;
+}
+
+static bool CircleRayCast(Vector2 center, float radius, Vector2 origin, Vector2 direction, float maxDistance,
+	float& outDistance, Vector2& outNormal)
+{
+	Vector2 m = { origin.x - center.x, origin.y - center.y };
+	float b = Dot(m, direction);
+	float c = Dot(m, m) - radius * radius;
+	float discriminant = b * b - c;
+	if (c <= 0.0f || b > 0.0f || discriminant < 0.0f)
+		return false;
+
+	float t = -b - sqrtf(discriminant);
+	if (t > maxDistance)
+		return false;
+
+	outDistance = t;
+	outNormal = { (m.x + direction.x * t) / radius, (m.y + direction.y * t) / radius };
+	return true;
+}
+
+/**
+	Ray cast in shape space, then back out. A capsule is its box & two end
+	circles, the ray hits whichever it reaches first. Rays that start inside
+	don't hit.
+*/
+static bool ShapeRayCast(const Shape& shape, Vector2 center, float rotation, const RayCastInput& ray, RayCastHit& outHit)
+{
+	float c = cosf(rotation), s = sinf(rotation);
+	Vector2 origin = ToShapeSpace(center, c, s, ray.origin);
+	if (CoreDistance(shape, origin) <= shape.radius)
+		return false;
+	Vector2 direction = { c * ray.direction.x + s * ray.direction.y, -s * ray.direction.x + c * ray.direction.y };
+
+	float distance = ray.maxDistance;
+	Vector2 normal = { 0.0f, 0.0f };
+	bool hit = false;
+	if (shape.type == ShapeType::Polygon)
+		hit = PolygonRayCast(shape.vertices, shape.normals, shape.vertexCount, origin, direction, distance, distance, normal);
+	else
+	{
+		for (int i = 0; i < shape.vertexCount; i++)
+			hit = CircleRayCast(shape.vertices[i], shape.radius, origin, direction, distance, distance, normal) || hit;
+
+		if (shape.type == ShapeType::Capsule)
+		{
+			float h = shape.vertices[1].x, r = shape.radius;
+			Vector2 box[4] = { { -h, -r }, { -h, r }, { h, r }, { h, -r } };
+			Vector2 boxNormals[4] = { { -1, 0 }, { 0, 1 }, { 1, 0 }, { 0, -1 } };
+			hit = PolygonRayCast(box, boxNormals, 4, origin, direction, distance, distance, normal) || hit;
+		}
+	}
+	if (!hit)
+		return false;
+
+	outHit.distance = distance;
+	outHit.point = { ray.origin.x + ray.direction.x * distance, ray.origin.y + ray.direction.y * distance };
+	outHit.normal = { c * normal.x - s * normal.y, s * normal.x + c * normal.y };
+	return true;
+}
+
+
+void PhysicsWorld::RayCast(const RayCastInput* rays, int count, RayCastHit* outHits)
+{
+	PROFILE_SCOPE("Ray casts");
+	queryTree = broadphase->SyncTree(bodies);
+
+	jobs.ParallelFor(count, 16, [&](int begin, int end, int) {
+		for (int k = begin; k < end; k++)
+		{
+			const RayCastInput& ray = rays[k];
+			RayCastHit& closest = outHits[k];
+			closest = RayCastHit();
+
+			// Ties go to the lower index, so the hit doesn't depend on the tree's shape
+			auto testBody = [&](int body, float maxDistance) {
+				RayCastInput clipped = ray;
+				clipped.maxDistance = maxDistance;
+				RayCastHit hit;
+				Vector2 center = { bodies.position.x[body], bodies.position.y[body] };
+				if (!ShapeRayCast(bodies.shapes.Get(bodies.shape[body]), center, bodies.rotation[body], clipped, hit))
+					return maxDistance;
+				if (closest.body < 0 || hit.distance < closest.distance || (hit.distance == closest.distance && body < closest.body))
+				{
+					closest = hit;
+					closest.body = body;
+				}
+				return hit.distance;
+			};
+
+			if (queryTree != nullptr)
+			{
+				queryTree->RayCast(ray.origin, ray.direction, ray.maxDistance, [&](int proxy, float maxDistance) {
+					return testBody(queryTree->GetUserData(proxy), maxDistance);
+				});
+			}
+			else
+			{
+				float maxDistance = ray.maxDistance;
+				for (int body = 0; body < bodies.Size(); body++)
+					maxDistance = testBody(body, maxDistance);
+			}
+		}
+	});
+}
+
+/**
+	Runs query k against every body whose bounds overlap boundsOf(k), keeping
+	the ones test(k, body) passes.
+*/
+template <typename Bounds, typename Test>
+void PhysicsWorld::QueryArea(int count, const Bounds& boundsOf, const Test& test, int* outBodies, int maxResults, int* outCounts)
+{
+	queryTree = broadphase->SyncTree(bodies);
+
+	jobs.ParallelFor(count, 16, [&](int begin, int end, int) {
+		for (int k = begin; k < end; k++)
+		{
+			Aabb bounds = boundsOf(k);
+			int* results = outBodies + (size_t)k * maxResults;
+			int found = 0;
+
+			auto testBody = [&](int body) {
+				if (test(k, body))
+					results[found++] = body;
+				return found < maxResults;
+			};
+
+			if (maxResults <= 0)
+			{
+				outCounts[k] = 0;
+				continue;
+			}
+
+			if (queryTree != nullptr)
+				queryTree->Query(bounds, [&](int proxy) { return testBody(queryTree->GetUserData(proxy)); });
+			else
+			{
+				for (int body = 0; body < bodies.Size(); body++)
+				{
+					float x = bodies.position.x[body], y = bodies.position.y[body], r = bodies.boundingRadius[body];
+					Aabb bodyBounds = { { x - r, y - r }, { x + r, y + r } };
+					if (bodyBounds.Overlaps(bounds) && !testBody(body))
+						break;
+				}
+			}
+			outCounts[k] = found;
+		}
+	});
+}
+
+void PhysicsWorld::QueryPoints(const Vector2* points, int count, int* outBodies, int maxResults, int* outCounts)
+{
+	PROFILE_SCOPE("Point queries");
+	QueryArea(count,
+		[&](int k) { return Aabb{ points[k], points[k] }; },
+		[&](int k, int body) {
+			Vector2 center = { bodies.position.x[body], bodies.position.y[body] };
+			return ShapeContainsPoint(bodies.shapes.Get(bodies.shape[body]), center, bodies.rotation[body], points[k]);
+		},
+		outBodies, maxResults, outCounts);
+}
+
+void PhysicsWorld::QueryAabbs(const Aabb* boxes, int count, int* outBodies, int maxResults, int* outCounts)
+{
+	PROFILE_SCOPE("Box queries");
+	QueryArea(count,
+		[&](int k) { return boxes[k]; },
+		[&](int k, int body) {
+			Vector2 center = { bodies.position.x[body], bodies.position.y[body] };
+			return ShapeOverlapsAabb(bodies.shapes.Get(bodies.shape[body]), center, bodies.rotation[body], boxes[k]);
+		},
+		outBodies, maxResults, outCounts);
+}
+
+void PhysicsWorld::QueryCircles(const CircleQuery* circles, int count, int* outBodies, int maxResults, int* outCounts)
+{
+	PROFILE_SCOPE("Circle queries");
+	QueryArea(count,
+		[&](int k) {
+			const CircleQuery& circle = circles[k];
+			return Aabb{ { circle.center.x - circle.radius, circle.center.y - circle.radius },
+						 { circle.center.x + circle.radius, circle.center.y + circle.radius } };
+		},
+		[&](int k, int body) {
+			Vector2 center = { bodies.position.x[body], bodies.position.y[body] };
+			return ShapeOverlapsCircle(bodies.shapes.Get(bodies.shape[body]), center, bodies.rotation[body], circles[k]);
+		},
+		outBodies, maxResults, outCounts);
+}
+
+RayCastHit PhysicsWorld::RayCast(const RayCastInput& ray)
+{
+	RayCastHit hit;
+	RayCast(&ray, 1, &hit);
+	return hit;
+}
+
+int PhysicsWorld::QueryPoint(Vector2 point, int* outBodies, int maxResults)
+{
+	int found;
+	QueryPoints(&point, 1, outBodies, maxResults, &found);
+	return found;
+}
+
+int PhysicsWorld::QueryAabb(const Aabb& box, int* outBodies, int maxResults)
+{
+	int found;
+	QueryAabbs(&box, 1, outBodies, maxResults, &found);
+	return found;
+}
+
+int PhysicsWorld::QueryCircle(const CircleQuery& circle, int* outBodies, int maxResults)
+{
+	int found;
+	QueryCircles(&circle, 1, outBodies, maxResults, &found);
+	return found;
+}
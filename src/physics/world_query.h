@@ -0,0 +1,28 @@
+#pragma once
+
+#include "raylib-cpp.hpp"
+#include "aabb_tree.h"
+
+/**
+	Inputs & results for PhysicsWorld's scene queries. Everything is on the XY
+	plane the bodies collide in, z is ignored.
+*/
+
+struct RayCastInput {
+	Vector2 origin;
+	Vector2 direction;			// unit length
+	float maxDistance;
+};
+
+// The closest body a ray hits, body is -1 if it hit nothing
+struct RayCastHit {
+	int body = -1;
+	float distance = 0.0f;
+	Vector2 point = { 0.0f, 0.0f };
+	Vector2 normal = { 0.0f, 0.0f };	// of the surface that was hit, facing the ray
+};
+
+struct CircleQuery {
+	Vector2 center;
+	float radius;
+};
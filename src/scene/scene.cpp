@@ -1,7 +1,11 @@
 #include "scene.h"
 
+#include "physics/profiler.h"
 #include "imgui.h"
 #include "rlImGui.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 
 void Scene::Init()
@@ -17,13 +21,180 @@ void Scene::Init()
 	rlImGuiSetup(true);
 
 	physicsWorld = std::make_unique<PhysicsWorld>();
+	physicsWorld->debugDraw = &debugDraw;
+	history.SetCapacity(historyLength);
+	scenarios = FindScenarios("resources/scenarios");
 	SetScenario(0);
 }
 
-void Scene::Update(float dt)
+void Scene::Unload()
 {
+	recorder.Stop();
 	if (physicsWorld != nullptr)
-		physicsWorld->Update(dt);
+		physicsWorld->renderer.Unload();
+}
+
+void Scene::Update(float dt)
+{
+	if (physicsWorld == nullptr)
+		return;
+
+	if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && !ImGui::GetIO().WantCaptureMouse)
+		PickBody();
+
+	lastSubsteps = 0;
+	if (replaying)
+	{
+		UpdateReplay(dt);
+		return;
+	}
+	if (paused)
+	{
+		accumulator = 0.0f;
+		physicsWorld->renderAlpha = 1.0f;
+		return;
+	}
+
+	PROFILE_SCOPE("Physics");
+	float stepDt = 1.0f / stepRate;
+	accumulator += dt;
+
+	while (accumulator >= stepDt && lastSubsteps < maxSubsteps)
+	{
+		StepPhysics(stepDt);
+		accumulator -= stepDt;
+		lastSubsteps++;
+	}
+
+	// Hit the cap: the world falls behind real time instead of each frame taking
+	// longer to catch up than the last
+	if (accumulator >= stepDt)
+		accumulator = fmodf(accumulator, stepDt);
+
+	physicsWorld->renderAlpha = interpolate ? accumulator / stepDt : 1.0f;
+}
+
+void Scene::StepPhysics(float dt)
+{
+	physicsWorld->Update(dt);
+
+	if (recorder.IsRecording())
+	{
+		PROFILE_SCOPE("Record");
+		recorder.Capture(physicsWorld->bodies, physicsWorld->stepCount);
+	}
+
+	PROFILE_SCOPE("Snapshot");
+	history.Push(*physicsWorld);
+}
+
+void Scene::Rewind(int age)
+{
+	if (age < 0 || age >= history.Count())
+		return;
+
+	paused = true;
+	rewindAge = age;
+	history.Restore(*physicsWorld, rewindAge);
+	physicsWorld->renderAlpha = 1.0f;
+}
+
+void Scene::Resume()
+{
+	// Carrying on from a rewound step makes a new future, the old one is dropped
+	history.DropNewest(rewindAge);
+	rewindAge = 0;
+	paused = false;
+}
+
+void Scene::StartReplay()
+{
+	recorder.Stop();
+	if (!replay.Open(RECORDING_PATH))
+	{
+		recordingStatus = "Couldn't open recording.rec";
+		return;
+	}
+
+	// The world's left with nothing but the replay's bodies, the camera stays put
+	physicsWorld->Init();
+	history.Clear();
+	selectedBody = BodyHandle();
+	replaying = true;
+	replayPaused = false;
+	replayTime = 0.0f;
+	recordingStatus = "";
+	SeekReplay(0);
+}
+
+void Scene::StopReplay()
+{
+	replay.Close();
+	replaying = false;
+	SetScenario(currentScenario);
+}
+
+void Scene::SeekReplay(int frame)
+{
+	replayFrame = std::min(std::max(frame, 0), replay.FrameCount() - 1);
+	if (!replay.Seek(replayFrame, physicsWorld->bodies))
+	{
+		replayPaused = true;
+		recordingStatus = "Replay stopped at a broken frame";
+	}
+}
+
+// Plays frames at the rate they were recorded, interpolating between them like
+// the simulation does between steps
+void Scene::UpdateReplay(float dt)
+{
+	float stepDt = replay.StepDt();
+	if (replayPaused)
+	{
+		replayTime = replayFrame * stepDt;
+		physicsWorld->renderAlpha = 1.0f;
+		return;
+	}
+
+	replayTime += dt;
+	int frame = (int)(replayTime / stepDt);
+	if (frame >= replay.FrameCount() - 1)
+	{
+		frame = replay.FrameCount() - 1;
+		replayPaused = true;
+	}
+	if (frame != replayFrame)
+		SeekReplay(frame);
+	physicsWorld->renderAlpha = interpolate && !replayPaused ? fmodf(replayTime, stepDt) / stepDt : 1.0f;
+}
+
+/**
+	Follows the mouse ray to the plane the bodies are on (every scenario keeps
+	its bodies on one) and selects the body under that point, or nothing.
+*/
+void Scene::PickBody()
+{
+	BodyStore& bodies = physicsWorld->bodies;
+	selectedBody = BodyHandle();
+	if (bodies.Size() == 0)
+		return;
+
+	Ray ray = GetMouseRay(GetMousePosition(), physicsWorld->camera);
+	float planeZ = bodies.position.z[0];
+	if (fabsf(ray.direction.z) < 1e-6f)
+		return;
+	float t = (planeZ - ray.position.z) / ray.direction.z;
+	if (t < 0.0f)
+		return;
+
+	Vector2 point = { ray.position.x + ray.direction.x * t, ray.position.y + ray.direction.y * t };
+	int body;
+	if (physicsWorld->QueryPoint(point, &body, 1) == 0)
+		return;
+
+	selectedBody = bodies.HandleAt(body);
+	revealSelected = true;
+	debugDraw.AddMarker(Vector3{ point.x, point.y, planeZ }, RColor::Yellow(), 0.5f);
 }
 
 void Scene::Render()
@@ -39,7 +210,10 @@ void Scene::Render()
 	}
 
 	physicsWorld->Render();
+
+	PROFILE_SCOPE("GUI");
 	DrawGUI();
+	DrawProfiler();
 
 	ImGui::PopFont();
 	rlImGuiEnd();
@@ -55,6 +229,8 @@ void Scene::DrawGUI()
 		| ImGuiWindowFlags_NoResize;
 
 	DrawFPS(viewport->Size.x - 90, 10);
+	const char* renderStats = TextFormat("Render: %d draw calls, %.2f ms", physicsWorld->drawCalls, physicsWorld->renderTimeMs);
+	DrawText(renderStats, viewport->Size.x - 10 - MeasureText(renderStats, 20), 34, 20, LIME);
 
 	ImVec2 settingsSize = ImVec2(viewport->Size.x / 5, viewport->Size.y / 2);
 	ImGui::SetNextWindowPos(ImVec2(10, 10));
@@ -62,10 +238,13 @@ void Scene::DrawGUI()
 	ImGui::Begin("Settings", NULL, WINDOW_FLAGS);
 
 	// Scenario
-	ImGui::Text("Scenario: %d", currentScenario);
-	ImGui::SameLine();
-	if (ImGui::Button("+"))
-		SetScenario(currentScenario + 1);
+	ImGui::Text("Scenario %d: %s", currentScenario, scenarios[currentScenario].name.c_str());
+	bool canIncrementScenario = currentScenario >= (int)scenarios.size() - 1;
+	if (canIncrementScenario) ImGui::BeginDisabled();
+		ImGui::SameLine();
+		if (ImGui::Button("+"))
+			SetScenario(currentScenario + 1);
+	if (canIncrementScenario) ImGui::EndDisabled();
 
 	bool canDecrementScenario = currentScenario <= 0;
 	if (canDecrementScenario) ImGui::BeginDisabled();
@@ -73,6 +252,10 @@ void Scene::DrawGUI()
 		if (ImGui::Button("-"))
 			SetScenario(currentScenario - 1);
 	if (canDecrementScenario) ImGui::EndDisabled();
+	if (scenarioLoaded)
+		ImGui::Text("%d bodies, loaded in %.1f ms", physicsWorld->bodies.Size(), scenarioLoadMs);
+	else
+		ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "Couldn't load %s", scenarios[currentScenario].path.c_str());
 
 	// Camera
 	ImGui::Checkbox("Turn on orthographic camera", &isCameraOrthographic);
@@ -95,19 +278,174 @@ void Scene::DrawGUI()
 
 	// Other settings
 	ImGui::Checkbox("Draw bounding spheres", &physicsWorld->drawBoundingSpheres);
+	ImGui::Checkbox("Draw joints & springs", &physicsWorld->drawJoints);
+	ImGui::Checkbox("Instanced rendering", &physicsWorld->useInstancing);
 
 	ImGui::PushItemWidth(70);
 	ImGui::InputFloat("Coefficient of restitution", &physicsWorld->cRestitution);
+	ImGui::InputFloat("Coefficient of friction", &physicsWorld->cFriction);
+
+	// Broadphase
+	ImGui::PushItemWidth(150);
+	int broadphase = (int)physicsWorld->broadphaseType;
+	if (ImGui::BeginCombo("Broadphase", BroadphaseTypeName(physicsWorld->broadphaseType)))
+	{
+		for (int i = 0; i < (int)BroadphaseType::Count; i++)
+		{
+			if (ImGui::Selectable(BroadphaseTypeName((BroadphaseType)i), i == broadphase))
+				physicsWorld->SetBroadphase((BroadphaseType)i);
+		}
+		ImGui::EndCombo();
+	}
+	int narrowphase = (int)physicsWorld->narrowphaseType;
+	if (ImGui::BeginCombo("Narrowphase", NarrowphaseTypeName(physicsWorld->narrowphaseType)))
+	{
+		for (int i = 0; i < (int)NarrowphaseType::Count; i++)
+		{
+			if (ImGui::Selectable(NarrowphaseTypeName((NarrowphaseType)i), i == narrowphase))
+				physicsWorld->narrowphaseType = (NarrowphaseType)i;
+		}
+		ImGui::EndCombo();
+	}
+
+	static const SimdLevel supportedSimd = DetectSimdLevel();
+	if (ImGui::BeginCombo("Integrator", SimdLevelName(physicsWorld->simdLevel)))
+	{
+		for (int i = 0; i <= (int)supportedSimd; i++)
+		{
+			if (ImGui::Selectable(SimdLevelName((SimdLevel)i), i == (int)physicsWorld->simdLevel))
+				physicsWorld->simdLevel = (SimdLevel)i;
+		}
+		ImGui::EndCombo();
+	}
+
+	// Timestep
+	ImGui::SliderInt("Step rate (Hz)", &stepRate, 10, 240, "%d", ImGuiSliderFlags_AlwaysClamp);
+	ImGui::SliderInt("Max substeps per frame", &maxSubsteps, 1, 16, "%d", ImGuiSliderFlags_AlwaysClamp);
+	ImGui::Checkbox("Interpolate rendering", &interpolate);
+
+	// Recording & replay
+	if (replaying)
+	{
+		ImGui::Text("Replaying %s, step %llu", RECORDING_PATH, (unsigned long long)replay.StepAt(replayFrame));
+		// Playing on from the end starts over
+		if (ImGui::Checkbox("Pause replay", &replayPaused) && !replayPaused && replayFrame == replay.FrameCount() - 1)
+			SeekReplay(0);
+		int frame = replayFrame;
+		if (ImGui::SliderInt("Frame", &frame, 0, replay.FrameCount() - 1, "%d", ImGuiSliderFlags_AlwaysClamp))
+		{
+			replayPaused = true;
+			SeekReplay(frame);
+		}
+		if (ImGui::Button("Stop replay"))
+			StopReplay();
+	}
+	else
+	{
+		bool recording = recorder.IsRecording();
+		if (ImGui::Checkbox("Record", &recording))
+		{
+			if (!recording)
+				recorder.Stop();
+			else
+				recordingStatus = recorder.Start(RECORDING_PATH, 1.0f / stepRate) ? "" : "Couldn't create recording.rec";
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Replay"))
+			StartReplay();
+		if (recorder.IsRecording())
+			ImGui::Text("%d frames, %.1f MB, %.0f us each, %d dropped%s", recorder.frameCount, recorder.writtenBytes / 1e6,
+				recorder.lastCaptureMicroseconds, recorder.droppedCount, recorder.writeFailed ? ", WRITE FAILED" : "");
+	}
+	if (recordingStatus[0] != '\0')
+		ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "%s", recordingStatus);
+
+	// Rewind, nothing to rewind while replaying
+	bool replayDisabled = replaying;
+	if (replayDisabled) ImGui::BeginDisabled();
+	bool pausedBefore = paused;
+	if (ImGui::Checkbox("Pause", &paused) && pausedBefore)
+		Resume();
+	ImGui::SameLine();
+	if (!paused) ImGui::BeginDisabled();
+		if (ImGui::Button("Step"))
+		{
+			if (rewindAge > 0)
+				Rewind(rewindAge - 1);
+			else
+				StepPhysics(1.0f / stepRate);
+		}
+	if (!paused) ImGui::EndDisabled();
+
+	int rewindStep = -rewindAge;
+	if (ImGui::SliderInt("Rewind (steps)", &rewindStep, 1 - std::max(history.Count(), 1), 0, "%d", ImGuiSliderFlags_AlwaysClamp))
+		Rewind(-rewindStep);
+	ImGui::SliderInt("History length", &historyLength, 0, 600, "%d", ImGuiSliderFlags_AlwaysClamp);
+	if (ImGui::IsItemDeactivatedAfterEdit())
+	{
+		Resume();
+		history.SetCapacity(historyLength);
+		history.Push(*physicsWorld);
+	}
+	ImGui::Text("Snapshots: %d, %.1f MB, %.0f us each", history.Count(), history.MemoryUsed() / 1e6, history.lastPushMicroseconds);
+	if (replayDisabled) ImGui::EndDisabled();
+
+	// Contact solver
+	ImGui::SliderInt("Velocity iterations", &physicsWorld->contactSolver.velocityIterations, 1, 30);
+	ImGui::Checkbox("Warm starting", &physicsWorld->contactSolver.warmStarting);
+	ImGui::Checkbox("Allow sleeping", &physicsWorld->allowSleeping);
+	ImGui::Checkbox("Continuous collision", &physicsWorld->continuousCollision);
+	ImGui::SliderInt("Particle substeps", &physicsWorld->particles.substeps, 1, 8);
+
+	// Force fields, springs can be too many to list
+	for (int i = 0; i < physicsWorld->forces.Count(); i++)
+	{
+		ForceGenerator& generator = physicsWorld->forces.generators[i];
+		if (generator.type == ForceType::Spring)
+			continue;
+		ImGui::PushID(i);
+		ImGui::Checkbox(ForceTypeName(generator.type), &generator.enabled);
+		ImGui::PopID();
+	}
+
+	static const int maxThreads = JobSystem::DefaultThreadCount();
+	int threads = physicsWorld->jobs.ThreadCount();
+	if (ImGui::SliderInt("Threads", &threads, 1, maxThreads))
+		physicsWorld->jobs.SetThreadCount(threads);
+
+	ImGui::Text("Bodies: %d (%d sleeping)", physicsWorld->bodies.Size(), physicsWorld->sleepingCount);
+	ImGui::Text("Broadphase pairs: %d", (int)physicsWorld->pairs.size());
+	ImGui::Text("Contact points: %d (%d islands)", physicsWorld->contactSolver.ContactPointCount(), physicsWorld->contactSolver.IslandCount());
+	ImGui::Text("Joints: %d (%d colors)", physicsWorld->jointSolver.Count(), physicsWorld->jointSolver.ColorCount());
+	if (physicsWorld->particles.Size() > 0)
+		ImGui::Text("Particles: %d (%d cells, %d contacts)", physicsWorld->particles.Size(),
+			physicsWorld->particles.cellCount, physicsWorld->particles.contactCount);
+	const StepTimings& timings = physicsWorld->timings;
+	ImGui::Text("Physics step: %.2f ms (%d this frame)", timings.total, lastSubsteps);
+	ImGui::Text("  broadphase %.2f, narrowphase %.2f", timings.broadphase, timings.narrowphase);
+	ImGui::Text("  integrate %.2f, solve %.2f, sleep %.2f", timings.integrate, timings.solve, timings.sleep);
+	ImGui::Text("  continuous %.2f (%d swept, %d hit)", timings.continuous,
+		(int)physicsWorld->continuousBodies.size(), physicsWorld->continuousHitCount);
+	ImGui::Text("  particles %.2f", timings.particles);
 
 	// Rigidbodies
 	ImGui::Unindent(ImGui::GetTreeNodeToLabelSpacing());
+	if (revealSelected)
+		ImGui::SetNextItemOpen(true);
 	if (ImGui::TreeNode("Rigidbodies"))
 	{
-		for (int rbIdx = 0; rbIdx < physicsWorld->rigidbodies.size(); rbIdx++)
+		for (int rbIdx = 0; rbIdx < physicsWorld->bodies.Size(); rbIdx++)
 		{
-			if (ImGui::TreeNode((void*)(intptr_t)rbIdx, "Body %d", rbIdx))
+			BodyHandle handle = physicsWorld->bodies.HandleAt(rbIdx);
+			bool selected = handle == selectedBody;
+			if (selected && revealSelected)
+				ImGui::SetNextItemOpen(true);
+			bool open = ImGui::TreeNodeEx((void*)(intptr_t)handle.slot, selected ? ImGuiTreeNodeFlags_Selected : 0, "Body %d", rbIdx);
+			if (selected && revealSelected)
+				ImGui::SetScrollHereY();
+			if (open)
 			{
-				RigidBody2D& rb = physicsWorld->rigidbodies[rbIdx];
+				RigidBody2D rb = physicsWorld->bodies.Get(handle);
 
 				if (abs(rb.inverseMass) < 1e-8f) 
 					ImGui::Text("Mass: INF");
@@ -117,13 +455,37 @@ void Scene::DrawGUI()
 					ImGui::Text("Moment of inertia: INF");
 				else ImGui::Text("Moment of inertia: %.3f", 1 / rb.inverseMOI);
 
+				const Shape& shape = physicsWorld->bodies.shapes.Get(rb.shape);
+				if (shape.IsBox())
+					ImGui::Text("Shape: box %.3f x %.3f", shape.boxHalfSize.x * 2, shape.boxHalfSize.y * 2);
+				else
+					ImGui::Text("Shape: %s, %d vertices, radius %.3f", ShapeTypeName(shape.type), shape.vertexCount, shape.radius);
+
 				ImGui::Text("Position: (%.03f, %.03f, %.03f)", rb.position.x, rb.position.y, rb.position.z);
 				ImGui::Text("Velocity: (%.03f, %.03f, %.03f)", rb.velocity.x, rb.velocity.y, rb.velocity.z);
-				ImGui::Text("External force: (%.03f, %.03f, %.03f)", rb.force.x, rb.force.y, rb.force.z);
+				bool forceChanged = ImGui::DragFloat2("External force", &rb.force.x, 0.1f);
+				forceChanged |= ImGui::DragFloat("Torque", &rb.torque, 0.1f);
+				if (forceChanged)
+				{
+					physicsWorld->bodies.Set(handle, rb);
+					physicsWorld->WakeBody(physicsWorld->bodies.IndexOf(handle));
+				}
 				ImGui::Text("Rotation: %.03f rad", rb.rotation);
 				ImGui::Text("Angular velocity: %.03f rad/s", rb.angularVelocity);
 
-				ImGui::Checkbox("Do gravity", &rb.doGravity);
+				ImGui::Text("Sleeping: %s", rb.sleeping ? "yes" : "no");
+				ImGui::Text("Kinematic: %s", rb.kinematic ? "yes" : "no");
+				ImGui::Text("Collision layer 0x%x, mask 0x%x, group %d", rb.collisionLayer, rb.collisionMask, rb.collisionGroup);
+
+				if (ImGui::Checkbox("Do gravity", &rb.doGravity))
+				{
+					physicsWorld->bodies.Set(handle, rb);
+					physicsWorld->WakeBody(physicsWorld->bodies.IndexOf(handle));
+				}
+				if (ImGui::Checkbox("Bullet", &rb.bullet))
+					physicsWorld->bodies.Set(handle, rb);
+				if (ImGui::Checkbox("Continuous", &rb.continuous))
+					physicsWorld->bodies.Set(handle, rb);
 
 				//float color[4] = { rb.color.r, rb.color.g, rb.color.b, rb.color.a };
 				//ImGui::ColorEdit4("Color", (float*)&color, ImGuiColorEditFlags_DisplayHSV | ImGuiColorEditFlags_Uint8);
@@ -139,72 +501,119 @@ void Scene::DrawGUI()
 		}
 		ImGui::TreePop();
 	}
+	revealSelected = false;
 
 
 	ImGui::End();
 }
 
 
-void Scene::SetScenario(int scenario)
+void Scene::DrawProfiler()
 {
-	// Reset & update physics world settings
-	physicsWorld->Init();
-	physicsWorld->camera.projection = isCameraOrthographic ? CAMERA_ORTHOGRAPHIC : CAMERA_PERSPECTIVE;
+	const ImGuiViewport* viewport = ImGui::GetMainViewport();
+	ImGui::SetNextWindowPos(ImVec2(viewport->Size.x - 10, 60), ImGuiCond_FirstUseEver, ImVec2(1, 0));
+	ImGui::SetNextWindowCollapsed(true, ImGuiCond_FirstUseEver);
+	ImGui::Begin("Profiler", NULL, ImGuiWindowFlags_AlwaysAutoResize);
+
+#ifndef ENABLE_PROFILER
+	ImGui::Text("Built without ENABLE_PROFILER");
+#else
+	Profiler& profiler = Profiler::Get();
+	ImGui::Checkbox("Record", &profiler.recording);
+	ImGui::SameLine();
+	if (ImGui::Button("Save Chrome trace"))
+		traceStatus = profiler.SaveChromeTrace("trace.json") ? "Saved to trace.json" : "Couldn't write trace.json";
+	ImGui::SameLine();
+	ImGui::Text("%s", traceStatus);
 
-	// Add current scenario
-	currentScenario = scenario;
-	if (currentScenario == 0)
-	{
-		RigidBody2D rb1 = RigidBody2D();
-		rb1.position = RVector3(- 3, 0.3f, 0);
-		rb1.velocity = RVector3(1, 0, 0);
-		rb1.angularVelocity = PI * 0.25f;
-		rb1.color = BLUE;
+	ImGui::PushItemWidth(150);
+	ImGui::SliderFloat("Graph height (ms)", &profilerGraphMs, 1.0f, 100.0f, "%.0f");
 
-		RigidBody2D rb2 = RigidBody2D();
-		rb2.position = RVector3(3, -0.1f, 0);
-		rb2.velocity = RVector3(-1, 0, 0 );
-		rb2.rotation = PI / 4;
-		rb2.color = RED;
+	// Stacked self times of every track, one column per frame, newest on the right
+	int frames = profiler.FrameCount();
+	int tracks = profiler.TrackCount();
+	auto trackColor = [](int track) { return (ImU32)ImColor::HSV(fmodf(track * 0.618f, 1.0f), 0.6f, 0.9f); };
 
-		physicsWorld->rigidbodies.push_back(rb1);
-		physicsWorld->rigidbodies.push_back(rb2);
-	}
-	if (currentScenario == 1)
-	{
-		float invMasses[] = { 1, 1.0f / 10, 0 };
-		float radii[] = { 1, 10, 100 };
-		float xPoses[] = { -20, 0, 120 };
-		float xVels[] = { 10, 10, 0 };
+	const float columnWidth = 2.0f;
+	ImVec2 size(Profiler::HISTORY_FRAMES * columnWidth, 160);
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	drawList->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y), IM_COL32(20, 20, 20, 220));
 
-		for (int i = 0; i < 3; i++)
+	for (int age = 0; age < frames; age++)
+	{
+		const Profiler::Frame& frame = profiler.GetFrame(age);
+		float x1 = origin.x + size.x - age * columnWidth;
+		float y = origin.y + size.y;
+		for (int t = 0; t < tracks && y > origin.y; t++)
 		{
-			RigidBody2D rb;
-			rb.position = RVector3(xPoses[i], 0, -200);
-			rb.velocity = RVector3(xVels[i], 0, 0);
-			rb.inverseMass = invMasses[i];
-			rb.radius = radii[i];
-			rb.boundingRadius = rb.radius * 1.8f;
-			physicsWorld->rigidbodies.push_back(rb);
+			float height = frame.trackMs[t] / profilerGraphMs * size.y;
+			drawList->AddRectFilled(ImVec2(x1 - columnWidth, fmaxf(y - height, origin.y)), ImVec2(x1, y), trackColor(t));
+			y -= height;
 		}
-		physicsWorld->rigidbodies[1].rotation = PI / 4;
 	}
-	if (currentScenario == 2)
+
+	// 60 fps budget
+	float budgetY = origin.y + size.y * (1.0f - 1000.0f / 60.0f / profilerGraphMs);
+	if (budgetY > origin.y)
+		drawList->AddLine(ImVec2(origin.x, budgetY), ImVec2(origin.x + size.x, budgetY), IM_COL32(255, 255, 255, 100));
+	ImGui::Dummy(size);
+
+	// Legend with averages & peaks over the stored frames
+	for (int t = 0; t < tracks; t++)
 	{
-		RigidBody2D r1, r2;
-		r1.color = RColor::Blue();
-		r1.position = RVector3(0.5f, 0.5f, 3);
-		r1.SetCubeSideLength(0.6f);
-		r1.doGravity = true;
+		float sum = 0.0f, peak = 0.0f;
+		for (int age = 0; age < frames; age++)
+		{
+			float ms = profiler.GetFrame(age).trackMs[t];
+			sum += ms;
+			peak = fmaxf(peak, ms);
+		}
 
-		r2.color = RColor::Red();
-		r2.position = RVector3(0.2f, -2, 3);
-		r2.inverseMass = 0.0f;
-		r2.inverseMOI = 0.0f;
+		ImVec2 swatch = ImGui::GetCursorScreenPos();
+		float lineHeight = ImGui::GetTextLineHeight();
+		drawList->AddRectFilled(swatch, ImVec2(swatch.x + lineHeight, swatch.y + lineHeight), trackColor(t));
+		ImGui::Dummy(ImVec2(lineHeight, lineHeight));
+		ImGui::SameLine();
+		ImGui::Text("%s: %.2f ms avg, %.2f ms peak", profiler.TrackName(t), frames > 0 ? sum / frames : 0.0f, peak);
+	}
 
-		physicsWorld->rigidbodies.push_back(r1);
-		physicsWorld->rigidbodies.push_back(r2);
+	// Counters from the last frame, summed over its physics steps
+	if (frames > 0)
+	{
+		ImGui::Separator();
+		const Profiler::Frame& last = profiler.GetFrame(0);
+		for (int c = 0; c < (int)ProfileCounter::Count; c++)
+			ImGui::Text("%s: %d", ProfileCounterName((ProfileCounter)c), last.counters[c]);
 	}
+#endif
+
+	ImGui::End();
+}
+
+
+void Scene::SetScenario(int scenario)
+{
+	replay.Close();
+	replaying = false;
+
+	// Reset & update physics world settings
+	physicsWorld->Init();
+	physicsWorld->camera.projection = isCameraOrthographic ? CAMERA_ORTHOGRAPHIC : CAMERA_PERSPECTIVE;
+
+	// Add current scenario
+	currentScenario = scenario;
+	accumulator = 0.0f;
+	auto loadStart = std::chrono::steady_clock::now();
+	scenarioLoaded = LoadScenario(*physicsWorld, scenarios[currentScenario]);
+	scenarioLoadMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+
+	// The starting state is the oldest step there is to rewind to
+	paused = false;
+	rewindAge = 0;
+	history.Clear();
+	history.Push(*physicsWorld);
+	selectedBody = BodyHandle();
 
 	// Reset scene settings that are dependant on scenario
 	cameraPos[0] = physicsWorld->camera.position.x;
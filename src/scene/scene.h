@@ -1,6 +1,8 @@
 #pragma once
 
 #include "physics/physics_world.h"
+#include "physics/recorder.h"
+#include "physics/scenarios.h"
 #include "imgui.h"
 #include <memory>
 
@@ -8,6 +10,7 @@ class Scene {
 
 public:
 	void Init();
+	void Unload();	// GPU resources, before the window closes
 	void Update(float dt);
 	void Render();
 
@@ -15,7 +18,46 @@ public:
 
 private:
 	std::unique_ptr<PhysicsWorld> physicsWorld;
+	DebugDraw debugDraw;		// the world's markers, see PhysicsWorld::debugDraw
+	std::vector<ScenarioInfo> scenarios;	// found in resources/scenarios at Init
 	int currentScenario = 0;
+	bool scenarioLoaded = false;
+	float scenarioLoadMs = 0.0f;
+
+	// Fixed timestep: physics always steps by 1 / stepRate, as many times as the
+	// frame time calls for, with the leftover carried over to the next frame
+	int stepRate = 60;			// steps per second
+	int maxSubsteps = 8;		// per frame, the rest is dropped so slow frames can't snowball
+	float accumulator = 0.0f;
+	bool interpolate = true;
+	int lastSubsteps = 0;
+
+	// Rewind: the world is snapshotted after every step, and can be paused &
+	// scrubbed back through the last historyLength steps
+	SnapshotRing history;
+	int historyLength = 120;
+	bool paused = false;
+	int rewindAge = 0;			// steps back from the newest snapshot being shown
+
+	void StepPhysics(float dt);
+	void Rewind(int age);
+	void Resume();
+
+	// Recording every step to RECORDING_PATH, and playing it back in place of
+	// the simulation (only the bodies, none of the joints or particles)
+	static constexpr const char* RECORDING_PATH = "recording.rec";
+	Recorder recorder;
+	Replay replay;
+	bool replaying = false;
+	bool replayPaused = false;
+	float replayTime = 0.0f;	// seconds since its first frame
+	int replayFrame = 0;
+	const char* recordingStatus = "";
+
+	void StartReplay();
+	void StopReplay();
+	void SeekReplay(int frame);
+	void UpdateReplay(float dt);
 
 	// Settings
 	bool isCameraOrthographic = false;
@@ -31,4 +73,16 @@ private:
 
 	void DrawGUI();
 
+	// Clicking a body selects it in the inspector
+	BodyHandle selectedBody;
+	bool revealSelected = false;	// open & scroll to it in the inspector next draw
+
+	void PickBody();
+
+	// Profiler window
+	float profilerGraphMs = 33.3f;
+	const char* traceStatus = "";
+
+	void DrawProfiler();
+
 };
\ No newline at end of file